@@ -0,0 +1,137 @@
+# Generates the ROM catalog header from chip8archive's programs.json, run as
+#   cmake -DPROGRAMS=programs.json -DROMS=roms/ -DOUTPUT=rom_catalog.h -P catalog.cmake
+# Strings go into one table of NUL terminated strings and ROMs into one blob, entries refer to
+# both by offset. Programs for platforms other than CHIP-8 and SCHIP are left out.
+
+cmake_minimum_required(VERSION 3.22)
+
+file(READ ${PROGRAMS} json)
+string(JSON count LENGTH "${json}")
+
+set(strings "")
+set(strings_size 0)
+set(entries "")
+set(blob "")
+set(blob_size 0)
+set(programs 0)
+
+# Appends text to the string table, its offset goes into out_var
+function(add_string text out_var)
+  string(LENGTH "${text}" length)
+  string(REPLACE "\\" "\\\\" escaped "${text}")
+  string(REPLACE "\"" "\\\"" escaped "${escaped}")
+  string(REPLACE "\n" "\\n" escaped "${escaped}")
+  string(REPLACE "\t" "\\t" escaped "${escaped}")
+  set(strings "${strings}    \"${escaped}\\0\"\n" PARENT_SCOPE)
+  set(${out_var} ${strings_size} PARENT_SCOPE)
+  math(EXPR next "${strings_size} + ${length} + 1")
+  set(strings_size ${next} PARENT_SCOPE)
+endfunction()
+
+# Member of the program as text, empty when missing
+function(member info key out_var)
+  string(JSON value ERROR_VARIABLE error GET "${info}" ${key})
+  if(error)
+    set(value "")
+  endif()
+  set(${out_var} "${value}" PARENT_SCOPE)
+endfunction()
+
+# Octo option as an std::optional initializer, {} when missing or of the wrong type
+function(octo_option info key out_var)
+  string(JSON type ERROR_VARIABLE error TYPE "${info}" options ${key})
+  string(JSON value ERROR_VARIABLE error GET "${info}" options ${key})
+  if(error)
+    set(value "{}")
+  elseif(key STREQUAL "tickrate")
+    if(NOT type STREQUAL "NUMBER" OR NOT value MATCHES "^-?[0-9]+$")
+      set(value "{}")
+    endif()
+  elseif(NOT type STREQUAL "BOOLEAN")
+    set(value "{}")
+  elseif(value)
+    set(value "true")
+  else()
+    set(value "false")
+  endif()
+  set(${out_var} "${value}" PARENT_SCOPE)
+endfunction()
+
+if(count GREATER 0)
+  math(EXPR last "${count} - 1")
+  foreach(index RANGE ${last})
+    string(JSON name MEMBER "${json}" ${index})
+    string(JSON info GET "${json}" ${name})
+
+    member("${info}" platform platform)
+    if(NOT platform STREQUAL "chip8" AND NOT platform STREQUAL "schip")
+      continue()
+    endif()
+    set(rom "${ROMS}/${name}.ch8")
+    if(NOT EXISTS "${rom}")
+      message(WARNING "ROM catalog: ${name} has no ${rom}")
+      continue()
+    endif()
+
+    set(authors "")
+    string(JSON author_count ERROR_VARIABLE error LENGTH "${info}" authors)
+    if(NOT error AND author_count GREATER 0)
+      math(EXPR last_author "${author_count} - 1")
+      foreach(author_index RANGE ${last_author})
+        string(JSON author GET "${info}" authors ${author_index})
+        if(authors STREQUAL "")
+          set(authors "${author}")
+        else()
+          set(authors "${authors}, ${author}")
+        endif()
+      endforeach()
+    endif()
+
+    set(fields "")
+    add_string("${name}" offset)
+    list(APPEND fields ${offset})
+    foreach(key title authors release event platform desc)
+      if(NOT key STREQUAL "authors" AND NOT key STREQUAL "platform")
+        member("${info}" ${key} ${key})
+      endif()
+      add_string("${${key}}" offset)
+      list(APPEND fields ${offset})
+    endforeach()
+    list(JOIN fields ", " fields)
+
+    file(SIZE "${rom}" rom_size)
+    file(READ "${rom}" bytes HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${bytes}")
+    set(blob "${blob}    // ${name}\n    ${bytes}\n")
+
+    set(options "")
+    foreach(key tickrate shiftQuirks loadStoreQuirks jumpQuirks logicQuirks clipQuirks)
+      octo_option("${info}" ${key} value)
+      list(APPEND options ${value})
+    endforeach()
+    list(JOIN options ", " options)
+
+    set(entries "${entries}    {${fields}, ${blob_size}, ${rom_size}, {${options}}},\n")
+    math(EXPR blob_size "${blob_size} + ${rom_size}")
+    math(EXPR programs "${programs} + 1")
+  endforeach()
+endif()
+
+if(blob_size EQUAL 0)
+  set(blob "    0,\n")
+endif()
+
+file(WRITE ${OUTPUT}.tmp "// Generated from programs.json by cmake/catalog.cmake for catalog.h, do not edit
+
+inline constexpr char CATALOG_STRINGS[] =
+${strings}    \"\";
+
+inline constexpr uint8_t CATALOG_ROMS[] = {
+${blob}};
+
+inline constexpr std::array<CatalogEntry, ${programs}> CATALOG{{
+${entries}}};
+")
+# Only touch the header when it changed, so that nothing recompiles needlessly
+file(COPY_FILE ${OUTPUT}.tmp ${OUTPUT} ONLY_IF_DIFFERENT)
+file(REMOVE ${OUTPUT}.tmp)
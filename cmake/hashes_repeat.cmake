@@ -0,0 +1,18 @@
+# Runs a ROM twice with chipate-run --hashes and fails unless both runs wrote the same hashes, run as
+#   cmake -DRUN=chipate-run -DROM=random.ch8 -DWORK=dir/ -P hashes_repeat.cmake
+cmake_minimum_required(VERSION 3.22)
+
+file(MAKE_DIRECTORY ${WORK})
+foreach(run a b)
+  execute_process(COMMAND ${RUN} ${ROM} --frames 120 --hashes ${WORK}/${run}.hashes
+                  RESULT_VARIABLE result OUTPUT_QUIET)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "chipate-run failed: ${result}")
+  endif()
+endforeach()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}/a.hashes ${WORK}/b.hashes
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "Two runs of ${ROM} wrote different hashes")
+endif()
@@ -0,0 +1,517 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "analysis.h"
+
+#include "hash.h"
+#include "opcode.h"
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <optional>
+#include <set>
+
+namespace chipate {
+
+namespace {
+
+// More Bnnn targets than this are treated as unresolved
+size_t const MAX_INDIRECT_TARGETS = 64;
+
+// Values lo, lo + step, ... up to hi a register is known to hold
+struct Range {
+    uint8_t lo = 0;
+    uint8_t hi = 0xFF;
+    uint8_t step = 1;
+
+    static Range exact(uint8_t value)
+    {
+        return {value, value, 1};
+    }
+
+    bool isExact() const
+    {
+        return lo == hi;
+    }
+
+    size_t count() const
+    {
+        return (hi - lo) / step + 1;
+    }
+};
+
+uint8_t lowestBit(uint8_t value)
+{
+    return value & -value;
+}
+
+// What is known about the machine at some point of a block, nothing at its start
+struct State {
+    std::array<Range, 16> V;
+    std::optional<uint16_t> I;
+
+    void step(uint16_t data)
+    {
+        auto match = decode(data);
+        if (!match)
+            return;
+
+        unsigned x = (data >> 8) & 0xF;
+        unsigned y = (data >> 4) & 0xF;
+        uint8_t kk = data & 0xFF;
+        uint16_t nnn = data & 0xFFF;
+
+        Range& vx = V[x];
+        Range const vy = V[y];
+
+        switch (match->opcode) {
+        case LD:
+            vx = Range::exact(kk);
+            break;
+        case ADD:
+            vx = vx.hi + kk <= 0xFF ? Range{uint8_t(vx.lo + kk), uint8_t(vx.hi + kk), vx.step}
+                                    : Range{};
+            break;
+        case LDR:
+            vx = vy;
+            break;
+        case AND:
+            if (vy.isExact() && vx.isExact())
+                vx = Range::exact(vx.lo & vy.lo);
+            else if (vy.isExact())
+                vx = vy.lo ? Range{0, std::min(vx.hi, vy.lo), lowestBit(vy.lo)} : Range::exact(0);
+            else
+                vx = {0, std::min(vx.hi, vy.hi), 1};
+            V[0xF] = {};
+            break;
+        case ADDC:
+            if (x == y)
+                vx = vx.hi <= 0x7F ? Range{uint8_t(vx.lo * 2), uint8_t(vx.hi * 2),
+                                           uint8_t(std::min(vx.step * 2, 0x80))}
+                                   : Range{};
+            else if (vx.hi + vy.hi <= 0xFF)
+                vx = {uint8_t(vx.lo + vy.lo), uint8_t(vx.hi + vy.hi),
+                      vy.isExact() ? vx.step : vx.isExact() ? vy.step : uint8_t(1)};
+            else
+                vx = {};
+            V[0xF] = {};
+            break;
+        // Without the shift quirk Vy is shifted instead, only Vx == Vy is the same either way
+        case SHL:
+            vx = x == y && vx.hi <= 0x7F ? Range{uint8_t(vx.lo * 2), uint8_t(vx.hi * 2),
+                                                 uint8_t(std::min(vx.step * 2, 0x80))}
+                                         : Range{};
+            V[0xF] = {};
+            break;
+        case SHR:
+            vx = x == y ? Range{uint8_t(vx.lo >> 1), uint8_t(vx.hi >> 1),
+                                uint8_t(std::max(vx.step >> 1, 1))}
+                        : Range{};
+            V[0xF] = {};
+            break;
+        case RND:
+            vx = kk ? Range{0, kk, lowestBit(kk)} : Range::exact(0);
+            break;
+        case OR:
+        case XOR:
+        case SUB:
+        case SUBN:
+            vx = {};
+            V[0xF] = {};
+            break;
+        case LDRD:
+        case LDK:
+            vx = {};
+            break;
+        case DRW:
+            V[0xF] = {};
+            break;
+        case LDI:
+            I = nnn;
+            break;
+        case ADDI:
+            if (I && vx.isExact())
+                I = (*I + vx.lo) & 0xFFF;
+            else
+                I.reset();
+            break;
+        case LDRM:
+            for (unsigned r = 0; r <= x; ++r)
+                V[r] = {};
+            I.reset();
+            break;
+        case LDS:
+        case LBCD:
+        case LDMR:
+            // Whether I moves depends on quirks
+            if (match->opcode != LBCD)
+                I.reset();
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+bool isSkip(Opcode opcode)
+{
+    return opcode == SE || opcode == SNE || opcode == SER || opcode == SNER || opcode == SKP ||
+           opcode == SKNP;
+}
+
+// Whether the instruction ends a basic block
+bool endsBlock(Opcode opcode)
+{
+    return opcode == JP || opcode == CALL || opcode == RET || opcode == JPO || isSkip(opcode);
+}
+
+class Analyzer {
+public:
+    Analyzer(std::span<uint8_t const> program, uint16_t origin)
+        : program(program)
+        , origin(origin)
+    {}
+
+    Analysis run()
+    {
+        Analysis analysis;
+        analysis.origin = origin;
+        analysis.hash = fnv1a(program);
+        analysis.bytes.assign(program.size(), ByteClass::Unknown);
+
+        roots.insert(origin);
+
+        // Resolving Bnnn can reveal code that resolves more Bnnn, go until nothing new shows up
+        bool changed = true;
+        while (changed) {
+            descend();
+            buildBlocks(analysis);
+            changed = resolveIndirect(analysis);
+        }
+
+        for (uint16_t address: code) {
+            analysis.bytes[address - origin] = ByteClass::Code;
+            analysis.bytes[address + 1 - origin] = ByteClass::Code;
+        }
+        markSprites(analysis);
+        findSubroutines(analysis);
+        findLoops(analysis);
+
+        return analysis;
+    }
+
+private:
+    std::span<uint8_t const> program;
+    uint16_t origin;
+
+    std::set<uint16_t> roots;
+    std::set<uint16_t> code;    // Instruction addresses
+    std::set<uint16_t> leaders; // Block starts
+    std::set<uint16_t> callees;
+    std::map<uint16_t, std::vector<uint16_t>> indirectTargets; // By the Bnnn address
+    std::set<uint16_t> unresolved;
+
+    bool inProgram(uint32_t address) const
+    {
+        return address >= origin && address + 1 < origin + program.size();
+    }
+
+    uint16_t word(uint16_t address) const
+    {
+        return program[address - origin] << 8 | program[address - origin + 1];
+    }
+
+    void descend()
+    {
+        std::vector<uint16_t> pending(roots.begin(), roots.end());
+        for (auto const& [address, targets]: indirectTargets)
+            pending.insert(pending.end(), targets.begin(), targets.end());
+
+        leaders.insert(pending.begin(), pending.end());
+
+        while (!pending.empty()) {
+            uint16_t address = pending.back();
+            pending.pop_back();
+
+            if (!inProgram(address) || code.contains(address))
+                continue;
+
+            uint16_t data = word(address);
+            auto match = decode(data);
+            if (!match)
+                continue;
+
+            code.insert(address);
+
+            uint16_t next = address + 2;
+            uint16_t nnn = data & 0xFFF;
+
+            switch (match->opcode) {
+            case JP:
+                leaders.insert(nnn);
+                pending.push_back(nnn);
+                break;
+            case CALL:
+                callees.insert(nnn);
+                leaders.insert({nnn, next});
+                pending.push_back(nnn);
+                pending.push_back(next);
+                break;
+            case RET:
+            case JPO:
+                break;
+            default:
+                if (isSkip(match->opcode)) {
+                    leaders.insert({next, uint16_t(next + 2)});
+                    pending.push_back(next + 2);
+                }
+                pending.push_back(next);
+                break;
+            }
+        }
+    }
+
+    void buildBlocks(Analysis& analysis)
+    {
+        analysis.blocks.clear();
+
+        for (uint16_t start: leaders) {
+            if (!code.contains(start))
+                continue;
+
+            BasicBlock block{start, start, Exit::Halt, true, {}};
+
+            for (uint16_t address = start; code.contains(address); address += 2) {
+                block.end = address + 2;
+                uint16_t data = word(address);
+                Opcode opcode = decode(data)->opcode;
+                uint16_t next = address + 2;
+
+                if (!endsBlock(opcode)) {
+                    if (leaders.contains(next) && code.contains(next)) {
+                        block.exit = Exit::Fallthrough;
+                        block.successors = {next};
+                        break;
+                    }
+                    continue;
+                }
+
+                if (opcode == JP) {
+                    block.exit = Exit::Jump;
+                    block.successors = {uint16_t(data & 0xFFF)};
+                }
+                else if (opcode == CALL) {
+                    block.exit = Exit::Call;
+                    block.successors = {uint16_t(data & 0xFFF), next};
+                }
+                else if (opcode == RET) {
+                    block.exit = Exit::Return;
+                }
+                else if (opcode == JPO) {
+                    block.exit = Exit::Indirect;
+                    block.resolved = !unresolved.contains(address);
+                    if (auto it = indirectTargets.find(address); it != indirectTargets.end())
+                        block.successors = it->second;
+                }
+                else {
+                    block.exit = Exit::Skip;
+                    block.successors = {next, uint16_t(next + 2)};
+                }
+                break;
+            }
+
+            // Successors that are not code, like jumps out of the program, are dropped
+            std::erase_if(block.successors, [this](uint16_t a) { return !code.contains(a); });
+
+            analysis.blocks.emplace(start, std::move(block));
+        }
+    }
+
+    // Replays every block ending in Bnnn to find the range of V0, true if new targets were found
+    bool resolveIndirect(Analysis const& analysis)
+    {
+        bool changed = false;
+
+        for (auto const& [start, block]: analysis.blocks) {
+            if (block.exit != Exit::Indirect)
+                continue;
+
+            State state;
+            uint16_t last = block.end - 2;
+            for (uint16_t address = start; address < last; address += 2)
+                state.step(word(address));
+
+            Range v0 = state.V[0];
+            uint16_t base = word(last) & 0xFFF;
+
+            if (v0.count() > MAX_INDIRECT_TARGETS) {
+                // Rebuild once more so the block gets marked
+                changed |= unresolved.insert(last).second;
+                continue;
+            }
+
+            auto& targets = indirectTargets[last];
+            if (!targets.empty())
+                continue;
+
+            for (unsigned value = v0.lo; value <= v0.hi; value += v0.step)
+                targets.push_back(base + value);
+            changed = true;
+        }
+
+        return changed;
+    }
+
+    void markSprites(Analysis& analysis)
+    {
+        for (auto const& [start, block]: analysis.blocks) {
+            State state;
+            for (uint16_t address = start; address < block.end; address += 2) {
+                uint16_t data = word(address);
+                if ((data & 0xF000) == DRW && state.I) {
+                    // Dxy0 draws a 16x16 sprite in high resolution
+                    unsigned height = data & 0xF ? data & 0xF : 32;
+                    for (unsigned a = *state.I; a < *state.I + height; ++a)
+                        if (a >= origin && a < origin + program.size() &&
+                            analysis.bytes[a - origin] == ByteClass::Unknown)
+                            analysis.bytes[a - origin] = ByteClass::Sprite;
+                }
+                state.step(data);
+            }
+        }
+    }
+
+    void findSubroutines(Analysis& analysis)
+    {
+        std::vector<uint16_t> entries{origin};
+        for (uint16_t callee: callees)
+            if (callee != origin && analysis.blocks.contains(callee))
+                entries.push_back(callee);
+
+        for (uint16_t entry: entries) {
+            if (!analysis.blocks.contains(entry))
+                continue;
+
+            Subroutine subroutine{entry, entry, entry, false, {}};
+            std::set<uint16_t> visited;
+            std::vector<uint16_t> pending{entry};
+
+            while (!pending.empty()) {
+                uint16_t start = pending.back();
+                pending.pop_back();
+                if (!visited.insert(start).second)
+                    continue;
+
+                auto const& block = analysis.blocks.at(start);
+                subroutine.low = std::min(subroutine.low, block.start);
+                subroutine.high = std::max(subroutine.high, block.end);
+
+                if (block.exit == Exit::Return)
+                    subroutine.returns = true;
+
+                // The callee is a subroutine of its own, only the return address belongs here
+                if (block.exit == Exit::Call) {
+                    if (analysis.blocks.contains(block.end))
+                        pending.push_back(block.end);
+                    continue;
+                }
+
+                pending.insert(pending.end(), block.successors.begin(), block.successors.end());
+            }
+
+            subroutine.blocks.assign(visited.begin(), visited.end());
+            analysis.subroutines.push_back(std::move(subroutine));
+        }
+    }
+
+    void findLoops(Analysis& analysis)
+    {
+        enum class Mark
+        {
+            New,
+            Active,
+            Done
+        };
+        std::map<uint16_t, Mark> marks;
+
+        // Iterative DFS, a successor still on the stack closes a loop
+        for (auto const& subroutine: analysis.subroutines) {
+            std::vector<std::pair<uint16_t, size_t>> stack;
+            if (marks[subroutine.entry] == Mark::New) {
+                stack.push_back({subroutine.entry, 0});
+                marks[subroutine.entry] = Mark::Active;
+            }
+
+            while (!stack.empty()) {
+                auto& [start, index] = stack.back();
+                auto const& successors = analysis.blocks.at(start).successors;
+
+                if (index == successors.size()) {
+                    marks[start] = Mark::Done;
+                    stack.pop_back();
+                    continue;
+                }
+
+                uint16_t successor = successors[index++];
+                auto& mark = marks[successor];
+                if (mark == Mark::Active)
+                    analysis.loops.push_back({successor, start});
+                else if (mark == Mark::New) {
+                    mark = Mark::Active;
+                    stack.push_back({successor, 0});
+                }
+            }
+        }
+    }
+};
+
+} // namespace
+
+ByteClass Analysis::byteClass(uint16_t address) const
+{
+    if (address < origin || address >= origin + bytes.size())
+        return ByteClass::Unknown;
+    return bytes[address - origin];
+}
+
+BasicBlock const* Analysis::blockAt(uint16_t address) const
+{
+    auto it = blocks.upper_bound(address);
+    if (it == blocks.begin())
+        return nullptr;
+    --it;
+    return address < it->second.end ? &it->second : nullptr;
+}
+
+Subroutine const* Analysis::subroutine(uint16_t entry) const
+{
+    auto it = std::lower_bound(subroutines.begin(), subroutines.end(), entry,
+                               [](Subroutine const& s, uint16_t e) { return s.entry < e; });
+    return it != subroutines.end() && it->entry == entry ? &*it : nullptr;
+}
+
+Analysis analyze(std::span<uint8_t const> program, uint16_t origin)
+{
+    return Analyzer(program, origin).run();
+}
+
+std::shared_ptr<Analysis const> analyzeCached(std::span<uint8_t const> program, uint16_t origin)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<uint64_t, uint16_t>, std::shared_ptr<Analysis const>> cache;
+
+    auto key = std::make_pair(fnv1a(program), origin);
+    {
+        std::lock_guard lock(mutex);
+        if (auto it = cache.find(key); it != cache.end())
+            return it->second;
+    }
+
+    // Analyze outside of the lock, two threads racing on the same ROM get equal results
+    auto analysis = std::make_shared<Analysis const>(analyze(program, origin));
+
+    std::lock_guard lock(mutex);
+    return cache.emplace(key, std::move(analysis)).first->second;
+}
+
+} // namespace chipate
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace chipate {
+
+// What a byte of the program was found to be
+enum class ByteClass : uint8_t
+{
+    Unknown, // Not reached by any analyzed path, may still be data or unreachable code
+    Code,    // Part of an instruction reachable from the entry point
+    Sprite   // Drawn by DRW with a statically known I
+};
+
+// How control leaves a basic block
+enum class Exit : uint8_t
+{
+    Fallthrough, // Runs into the next block
+    Jump,        // 1nnn
+    Skip,        // Conditional skip, successors are the next and the skipped-to instruction
+    Call,        // 2nnn, successors are the callee and the return address
+    Return,      // 00EE
+    Indirect,    // Bnnn, successors are the targets the range of V0 allows
+    Halt         // Runs into a word that does not decode or off the end of the program
+};
+
+struct BasicBlock {
+    uint16_t start;
+    uint16_t end; // One past the last instruction
+    Exit exit;
+    bool resolved; // False for Bnnn with too wide a V0 range, its successors are incomplete
+    std::vector<uint16_t> successors;
+};
+
+struct Subroutine {
+    uint16_t entry;
+    uint16_t low;                 // Lowest address of its blocks
+    uint16_t high;                // One past the highest address of its blocks
+    bool returns;                 // Reaches a RET, false for the program entry point
+    std::vector<uint16_t> blocks; // Block starts, sorted, without the callees
+};
+
+// Back edge of the CFG, the block at latch continues at header that is still being visited
+struct Loop {
+    uint16_t header;
+    uint16_t latch;
+};
+
+struct Analysis {
+    uint16_t origin;
+    uint64_t hash;                       // fnv1a() of the program
+    std::vector<ByteClass> bytes;        // One per program byte
+    std::map<uint16_t, BasicBlock> blocks; // By start address
+    std::vector<Subroutine> subroutines; // By entry, the program entry point is the first one
+    std::vector<Loop> loops;
+
+    ByteClass byteClass(uint16_t address) const;
+    BasicBlock const* blockAt(uint16_t address) const;      // Block containing address
+    Subroutine const* subroutine(uint16_t entry) const;     // Subroutine starting at entry
+};
+
+// Builds the CFG by recursive descent from origin. Bnnn is followed when V0 is set within the
+// same block to a small enough range of values.
+Analysis analyze(std::span<uint8_t const> program, uint16_t origin = 0x200);
+
+// analyze() cached by the program hash, safe to call from several threads
+std::shared_ptr<Analysis const> analyzeCached(std::span<uint8_t const> program,
+                                              uint16_t origin = 0x200);
+
+} // namespace chipate
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "aot.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace chipate {
+
+namespace {
+
+// The block starting at address, if it still matches what is in memory
+AotBlock const* findBlock(Chip8 const& chip8, AotProgram const& program, uint16_t address)
+{
+    auto it = std::lower_bound(program.blocks.begin(), program.blocks.end(), address,
+                               [](AotBlock const& b, uint16_t a) { return b.address < a; });
+    if (it == program.blocks.end() || it->address != address)
+        return nullptr;
+
+    auto const& memory = AotAccess::memory(chip8);
+    if (std::memcmp(memory.data() + address, program.rom.data() + (address - 0x200), it->length))
+        return nullptr;
+
+    return &*it;
+}
+
+bool coversBreakpoint(Chip8 const& chip8, AotBlock const& block)
+{
+    for (uint16_t a = block.address + 1; a < block.address + block.length; ++a)
+        if (AotAccess::breakpoint(chip8, a))
+            return true;
+    return false;
+}
+
+} // namespace
+
+RunResult runAot(Chip8& chip8, AotProgram const& program, size_t maxCycles)
+{
+    size_t cycles = 0;
+
+    while (cycles < maxCycles) {
+        if (chip8.waitingForKey())
+            return {cycles, StopReason::KeyWait};
+
+        if (AotAccess::waitForVBlank(chip8))
+            return {cycles, StopReason::VBlank};
+
+        uint16_t pc = AotAccess::PC(chip8);
+
+        if (AotAccess::stopAtBreakpoint(chip8))
+            return {cycles, StopReason::Breakpoint};
+
+        // Translated blocks do not journal, so undo needs every instruction interpreted
+        AotBlock const* block = chip8.journaling() ? nullptr : findBlock(chip8, program, pc);
+        if (block && maxCycles - cycles >= block->instructions && !coversBreakpoint(chip8, *block)) {
+            AotAccess::resumed(chip8);
+            cycles += block->fn(chip8);
+            continue;
+        }
+
+        auto result = chip8.run(1);
+        cycles += result.cycles;
+        if (result.reason != StopReason::Budget)
+            return {cycles, result.reason};
+    }
+
+    return {cycles, StopReason::Budget};
+}
+
+size_t frameAot(Chip8& chip8, AotProgram const& program, size_t maxCycles)
+{
+    size_t cycles = 0;
+
+    while (cycles < maxCycles) {
+        auto result = runAot(chip8, program, maxCycles - cycles);
+        cycles += result.cycles;
+        if (result.reason == StopReason::VBlank || result.reason == StopReason::KeyWait ||
+            !result.cycles)
+            break;
+    }
+
+    chip8.tock();
+    return cycles;
+}
+
+} // namespace chipate
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "chip8.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace chipate {
+
+// Access to the machine for code emitted by chipate-aot
+class AotAccess {
+public:
+    static Registers& V(Chip8& c)
+    {
+        return c.V;
+    }
+    static uint16_t& I(Chip8& c)
+    {
+        return c.I;
+    }
+    static uint16_t& PC(Chip8& c)
+    {
+        return c.PC;
+    }
+    static uint8_t& delayTimer(Chip8& c)
+    {
+        return c.delayTimer;
+    }
+
+    // Interpret a single instruction located at address, PC ends up where the interpreter puts it
+    static void exec(Chip8& c, uint16_t address, uint16_t instruction)
+    {
+        c.PC = address;
+        c.exec(instruction);
+    }
+
+    static std::array<uint8_t, 4096> const& memory(Chip8 const& c)
+    {
+        return c.memory;
+    }
+    static bool waitForVBlank(Chip8 const& c)
+    {
+        return c.waitForVBlank;
+    }
+    static bool breakpoint(Chip8 const& c, uint16_t address)
+    {
+        return c.breakpoints[address & 0x0FFF];
+    }
+    // See Chip8::run()
+    static bool stopAtBreakpoint(Chip8& c)
+    {
+        return c.stopAtBreakpoint();
+    }
+    static void resumed(Chip8& c)
+    {
+        c.resumingFrom.reset();
+    }
+};
+
+// Translated basic block, runs from address and returns the number of instructions executed.
+// Blocks never contain instructions that can fault or stop run(), those are interpreted.
+using AotBlockFn = size_t (*)(Chip8&);
+
+struct AotBlock {
+    uint16_t address;
+    uint16_t length;       // Bytes translated, compared against memory to catch self-modification
+    uint16_t instructions; // Instructions executed by every run of the block
+    AotBlockFn fn;
+};
+
+struct AotProgram {
+    char const* name;
+    std::span<uint8_t const> rom; // Loaded at 0x200
+    std::span<AotBlock const> blocks; // Sorted by address
+};
+
+// Provided by the translation unit chipate-aot generates
+AotProgram const& aotProgram();
+
+// Same contract as Chip8::run(), executing translated blocks where memory still holds the
+// translated code and interpreting everything else
+RunResult runAot(Chip8& chip8, AotProgram const& program, size_t maxCycles);
+
+// Same contract as Chip8::frame()
+size_t frameAot(Chip8& chip8, AotProgram const& program, size_t maxCycles);
+
+} // namespace chipate
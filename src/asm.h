@@ -2,10 +2,152 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace chipate {
-std::vector<uint8_t> assemble(std::string const& source);
-}
+
+struct AsmError {
+    size_t line; // 1-based
+    std::string message;
+};
+
+struct AsmResult {
+    std::vector<uint8_t> bytecode; // Empty when there are errors
+    std::vector<AsmError> errors;
+
+    constexpr bool ok() const
+    {
+        return errors.empty();
+    }
+};
+
+// Where the bytes of a program come from, for profiling and debugging by source line
+struct SourceMap {
+    static constexpr uint32_t NO_LABEL = ~0u;
+
+    struct Label {
+        std::string name;
+        uint16_t address;
+    };
+
+    struct Entry {
+        uint16_t address;
+        uint16_t size;  // 2 for instructions, the byte count of a db line
+        uint32_t file;  // Index into files
+        uint32_t line;  // 1-based
+        uint32_t label; // Index into labels of the enclosing label, NO_LABEL before the first
+    };
+
+    std::vector<std::string> files;
+    std::vector<Label> labels;
+    std::vector<Entry> entries; // Sorted by address
+
+    // The entry covering address, nullptr for padding and addresses outside the program
+    constexpr Entry const* find(uint16_t address) const
+    {
+        auto it = std::upper_bound(entries.begin(), entries.end(), address,
+                                   [](uint16_t a, Entry const& e) { return a < e.address; });
+        if (it == entries.begin() || address >= (it - 1)->address + (it - 1)->size)
+            return nullptr;
+        return &*(it - 1);
+    }
+};
+
+// Two-pass assembly of a program loaded at origin. Besides instructions and db it takes
+// "name:" labels, "name equ value" constants and "org address" that pads up to address.
+// Labels may be used before they are defined, constants only after. Operands can be sums
+// without spaces, as in "ld i sprite+5". With a map, entries for
+// every line emitting bytes are appended to it, naming the last of its files or "" if it has none.
+AsmResult assembleSource(std::string_view source, uint16_t origin = 0x200,
+                         SourceMap* map = nullptr);
+
+// assembleSource() at 0x200 that logs the errors and returns an empty program on failure
+std::vector<uint8_t> assemble(std::string_view source);
+// assemble() through assemblyCache(), for callers that assemble the same sources over and over,
+// like the tests
+std::vector<uint8_t> assembleCached(std::string_view source);
+
+// Bumped whenever the same source may assemble differently, invalidates cached objects
+inline constexpr uint32_t ASM_VERSION = 3;
+
+// Programs by the hash of their source and ASM_VERSION, kept for the life of the cache and also
+// in directory when one is given. Sources with errors are assembled every time.
+class AsmCache {
+public:
+    explicit AsmCache(std::filesystem::path const& directory = {});
+    ~AsmCache();
+    AsmCache(AsmCache const&) = delete;
+    AsmCache& operator=(AsmCache const&) = delete;
+
+    // assemble() of source, from the cache when it assembled before
+    std::vector<uint8_t> get(std::string_view source);
+
+    size_t hits() const
+    {
+        return hitCount;
+    }
+    size_t misses() const
+    {
+        return missCount;
+    }
+    double hitRate() const
+    {
+        size_t hits = hitCount;
+        size_t total = hits + missCount;
+        return total ? static_cast<double>(hits) / total : 0;
+    }
+
+private:
+    std::unordered_map<uint64_t, std::vector<uint8_t>> programs;
+    FILE* records = nullptr; // Appended to on every miss
+    std::atomic<size_t> hitCount = 0;
+    std::atomic<size_t> missCount = 0;
+    std::mutex mutex;
+};
+
+// The cache assembleCached() uses, on disk as well in $CHIPATE_ASM_CACHE when that is set
+AsmCache& assemblyCache();
+
+// Address the linker patches into the nnn field of the instruction at offset, adding the nnn
+// the module was assembled with
+struct Relocation {
+    uint16_t offset;
+    std::string symbol; // Imported symbol, empty for an offset within the module
+};
+
+// Relocatable module assembled at offset 0, every label is exported and every symbol used but not
+// defined is imported
+struct ObjectModule {
+    std::string name;
+    uint64_t hash = 0; // fnv1a() of the source
+    std::vector<uint8_t> code;
+    std::vector<std::pair<std::string, uint16_t>> exports;
+    std::vector<std::string> imports;
+    std::vector<Relocation> relocations;
+    SourceMap map; // Relative to offset 0, files holds name
+};
+
+struct ObjectResult {
+    ObjectModule module;
+    std::vector<AsmError> errors;
+
+    constexpr bool ok() const
+    {
+        return errors.empty();
+    }
+};
+
+// Assembles a module for link(). Labels and imports can only be used as addresses, and org is
+// not allowed as the final address is unknown.
+ObjectResult assembleObject(std::string_view source, std::string name = {});
+
+} // namespace chipate
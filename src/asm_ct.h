@@ -0,0 +1,1010 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "asm.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chipate {
+
+// The assembler itself, constexpr so that assemble_ct() can run it during compilation
+namespace detail {
+
+constexpr bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+constexpr bool is_token_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' ||
+           c == '[' || c == ']' || c == '+';
+}
+
+// Splits a line into tokens: runs of letters, digits, underscores and brackets separated by
+// whitespace. A ';' starts a comment, any other character ends the line.
+class Tokenizer {
+public:
+    constexpr explicit Tokenizer(std::string_view line)
+        : rest(line)
+    {}
+
+    constexpr std::string_view next()
+    {
+        size_t begin = 0;
+        while (begin < rest.size() && is_space(rest[begin]))
+            begin++;
+
+        size_t end = begin;
+        while (end < rest.size() && is_token_char(rest[end]))
+            end++;
+
+        auto token = rest.substr(begin, end - begin);
+        rest = token.empty() ? std::string_view{} : rest.substr(end);
+        return token;
+    }
+
+    // Consumes c if it directly follows the last token
+    constexpr bool consume(char c)
+    {
+        if (rest.empty() || rest[0] != c)
+            return false;
+        rest.remove_prefix(1);
+        return true;
+    }
+
+private:
+    std::string_view rest;
+};
+
+// Numbers in the forms std::stoul took with base 0: 0x for hex, a leading 0 for octal, decimal
+// otherwise. forceHex reads digits without a prefix as hex, as db does.
+constexpr std::optional<unsigned> number(std::string_view arg, bool forceHex = false)
+{
+    unsigned base = 10;
+    if (arg.size() > 2 && arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X')) {
+        arg.remove_prefix(2);
+        base = 16;
+    }
+    else if (forceHex)
+        base = 16;
+    else if (arg.size() > 1 && arg[0] == '0') {
+        arg.remove_prefix(1);
+        base = 8;
+    }
+
+    // By hand as std::from_chars is not constexpr yet
+    if (arg.empty())
+        return std::nullopt;
+    unsigned value = 0;
+    for (char c: arg) {
+        unsigned digit = c >= '0' && c <= '9'   ? c - '0'
+                         : c >= 'a' && c <= 'z' ? c - 'a' + 10
+                         : c >= 'A' && c <= 'Z' ? c - 'A' + 10
+                                                : base;
+        if (digit >= base || value > (~0u - digit) / base)
+            return std::nullopt;
+        value = value * base + digit;
+    }
+    return value;
+}
+
+constexpr std::string decimal(size_t value)
+{
+    std::string text;
+    do
+        text.insert(text.begin(), char('0' + value % 10));
+    while (value /= 10);
+    return text;
+}
+
+constexpr bool is_reg_name(std::string_view arg)
+{
+    return arg.size() == 2 && arg[0] == 'v' && number(arg.substr(1), true).has_value();
+}
+
+// Register names and operand keywords can not be used as symbols
+constexpr bool is_reserved(std::string_view name)
+{
+    return is_reg_name(name) || name == "i" || name == "dt" || name == "st" || name == "f" ||
+           name == "k" || name == "b" || name == "equ" || name == "org" || name == "db";
+}
+
+constexpr bool is_symbol_name(std::string_view name)
+{
+    if (name.empty() || (name[0] >= '0' && name[0] <= '9'))
+        return false;
+    for (char c: name)
+        if (!is_token_char(c) || c == '[' || c == ']' || c == '+')
+            return false;
+    return !is_reserved(name);
+}
+
+// Open addressing with linear probing over one flat array: no allocation per symbol and lookups
+// touch a single cache line in the common case. Names point into the source.
+class SymbolTable {
+public:
+    struct Symbol {
+        std::string_view name;
+        unsigned value;
+        size_t line;
+        bool label; // Relocatable in object modules
+    };
+
+    constexpr Symbol const* find(std::string_view name) const
+    {
+        if (slots.empty())
+            return nullptr;
+        for (size_t i = slot(name);; i = (i + 1) & (slots.size() - 1)) {
+            if (slots[i].name.empty())
+                return nullptr;
+            if (slots[i].name == name)
+                return &slots[i];
+        }
+    }
+
+    // The symbol already defined under that name, or nullptr once it is inserted
+    constexpr Symbol const* insert(std::string_view name, unsigned value, size_t line, bool label)
+    {
+        if (auto existing = find(name))
+            return existing;
+
+        if ((count + 1) * 2 > slots.size())
+            grow();
+
+        size_t i = slot(name);
+        while (!slots[i].name.empty())
+            i = (i + 1) & (slots.size() - 1);
+        slots[i] = {name, value, line, label};
+        count++;
+        return nullptr;
+    }
+
+private:
+    std::vector<Symbol> slots; // Power of two sized, free slots have an empty name
+    size_t count = 0;
+
+    constexpr size_t slot(std::string_view name) const
+    {
+        return fnv1a(name) & (slots.size() - 1);
+    }
+
+    constexpr void grow()
+    {
+        auto old = std::move(slots);
+        slots.assign(std::max<size_t>(64, old.size() * 2), {});
+        for (auto const& symbol: old) {
+            if (symbol.name.empty())
+                continue;
+            size_t i = slot(symbol.name);
+            while (!slots[i].name.empty())
+                i = (i + 1) & (slots.size() - 1);
+            slots[i] = symbol;
+        }
+    }
+};
+
+// How an operand of an object module is fixed up at link time
+enum class Fixup
+{
+    None,
+    Local,  // Label of the module, the value is its offset
+    Import, // Symbol of another module, the value is 0
+};
+
+// Instruction operand, value holds what a number or symbol stands for
+struct Operand {
+    std::string_view text;
+    std::optional<unsigned> value;
+    Fixup fixup = Fixup::None;
+    std::string_view import; // The symbol of an Import fixup, text may add constants to it
+
+    constexpr bool operator==(std::string_view other) const
+    {
+        return text == other;
+    }
+};
+
+inline constexpr size_t MAX_ARGS = 3;
+
+struct Args {
+    std::array<Operand, MAX_ARGS> arg;
+    size_t count = 0;
+
+    constexpr size_t size() const
+    {
+        return count;
+    }
+    constexpr bool empty() const
+    {
+        return count == 0;
+    }
+    constexpr Operand const& operator[](size_t i) const
+    {
+        return arg[i];
+    }
+};
+
+constexpr bool is_reg(Operand const& arg)
+{
+    return is_reg_name(arg.text);
+}
+
+constexpr bool is_index(Operand const& arg)
+{
+    return arg == "i";
+}
+
+constexpr bool is_dt(Operand const& arg)
+{
+    return arg == "dt";
+}
+
+constexpr bool is_st(Operand const& arg)
+{
+    return arg == "st";
+}
+
+constexpr bool is_f(Operand const& arg)
+{
+    return arg == "f";
+}
+
+constexpr bool is_k(Operand const& arg)
+{
+    return arg == "k";
+}
+
+constexpr bool is_b(Operand const& arg)
+{
+    return arg == "b";
+}
+
+constexpr bool is_indirect(Operand const& arg)
+{
+    return arg == "[i]";
+}
+
+constexpr bool is_nibble(Operand const& arg)
+{
+    return arg.value && *arg.value <= 0x0F;
+}
+
+constexpr bool is_byte(Operand const& arg)
+{
+    return arg.value && *arg.value <= 0xFF;
+}
+
+constexpr bool is_address(Operand const& arg)
+{
+    return arg.value && *arg.value <= 0x0FFF;
+}
+
+// The accessors below are only used on arguments the is_* checks accepted
+
+constexpr uint16_t reg(Operand const& arg)
+{
+    return *number(arg.text.substr(1), true);
+}
+
+constexpr uint8_t nibble(Operand const& arg)
+{
+    return static_cast<uint8_t>(*arg.value & 0x0F);
+}
+
+constexpr uint8_t byte(Operand const& arg)
+{
+    return static_cast<uint8_t>(*arg.value & 0xFF);
+}
+
+constexpr uint16_t address(Operand const& arg)
+{
+    return *arg.value & 0x0FFF;
+}
+
+// Encoders return this for operands they do not take, the caller reports it with the line
+inline constexpr uint16_t INVALID = 0xFFFF;
+
+using Encoder = uint16_t (*)(Args const&);
+
+struct Mnemonic {
+    std::string_view name;
+    Encoder encode;
+};
+
+inline constexpr Mnemonic processors[] = {
+    {"cls",
+     [](Args const&) -> uint16_t {
+         return 0x00E0;
+     }          },
+    {"ret",
+     [](Args const&) -> uint16_t {
+         return 0x00EE;
+     }          },
+    {"jp",
+     [](Args const& args) -> uint16_t {
+         if (args.size() == 1 && is_address(args[0])) { // simple jump
+             uint16_t addr = address(args[0]);
+             return 0x1000 | addr;
+         }
+         else if (args.size() == 2 && args[0] == "v0" && is_address(args[1])) { // jump with offset
+             uint16_t addr = address(args[1]);
+             return 0xB000 | addr;
+         }
+         return INVALID;
+     }          },
+    {"call",
+     [](Args const& args) -> uint16_t {
+         if (args.size() == 1 && is_address(args[0])) {
+             uint16_t addr = address(args[0]);
+             return 0x2000 | addr;
+         }
+
+         return INVALID;
+     }          },
+    {"se",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x5000 | (x << 8) | (y << 4);
+         }
+         else if (is_reg(args[0]) && is_byte(args[1])) {
+             auto x = reg(args[0]);
+             auto b = byte(args[1]);
+
+             return 0x3000 | (x << 8) | b;
+         }
+         return INVALID;
+     }          },
+    {"sne",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x9000 | (x << 8) | (y << 4);
+         }
+         else if (is_reg(args[0]) && is_byte(args[1])) {
+             auto x = reg(args[0]);
+             auto b = byte(args[1]);
+
+             return 0x4000 | (x << 8) | b;
+         }
+         return INVALID;
+     }          },
+    {"ld",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x8000 | (x << 8) | (y << 4);
+         }
+         else if (is_reg(args[0]) && is_dt(args[1])) {
+             auto x = reg(args[0]);
+             return 0xF007 | (x << 8);
+         }
+         else if (is_reg(args[0]) && is_k(args[1])) {
+             auto x = reg(args[0]);
+             return 0xF00A | (x << 8);
+         }
+         else if (is_dt(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[1]);
+             return 0xF015 | (x << 8);
+         }
+         else if (is_st(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[1]);
+             return 0xF018 | (x << 8);
+         }
+         else if (is_f(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[1]);
+             return 0xF029 | (x << 8);
+         }
+         else if (is_b(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[1]);
+             return 0xF033 | (x << 8);
+         }
+         else if (is_indirect(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[1]);
+             return 0xF055 | (x << 8);
+         }
+         else if (is_reg(args[0]) && is_indirect(args[1])) {
+             auto x = reg(args[0]);
+             return 0xF065 | (x << 8);
+         }
+         else if (is_index(args[0]) && is_address(args[1])) {
+             auto addr = address(args[1]);
+             return 0xA000 | addr;
+         }
+         else if (is_reg(args[0]) && is_byte(args[1])) {
+             auto x = reg(args[0]);
+             auto b = byte(args[1]);
+             return 0x6000 | (x << 8) | b;
+         }
+         return INVALID;
+     }          },
+    {"add",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x8004 | (x << 8) | (y << 4);
+         }
+         else if (is_index(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[1]);
+
+             return 0xF01E | (x << 8);
+         }
+         else if (is_reg(args[0]) && is_byte(args[1])) {
+             auto x = reg(args[0]);
+             auto b = byte(args[1]);
+
+             return 0x7000 | (x << 8) | b;
+         }
+         return INVALID;
+     }          },
+    {"or",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x8001 | (x << 8) | (y << 4);
+         }
+         return INVALID;
+     }          },
+    {"and",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x8002 | (x << 8) | (y << 4);
+         }
+         return INVALID;
+     }          },
+    {"xor",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x8003 | (x << 8) | (y << 4);
+         }
+         return INVALID;
+     }          },
+    {"sub",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x8005 | (x << 8) | (y << 4);
+         }
+         return INVALID;
+     }          },
+    {"subn",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+
+         if (is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x8007 | (x << 8) | (y << 4);
+         }
+         return INVALID;
+     }          },
+    {"shr",
+     [](Args const& args) -> uint16_t {
+         if (args.empty() || args.size() > 2) {
+             return INVALID;
+         }
+
+         if (args.size() == 2 && is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x8006 | (x << 8) | (y << 4);
+         }
+         else if (args.size() == 1 && is_reg(args[0])) {
+             auto x = reg(args[0]);
+             return 0x8006 | (x << 8);
+         }
+         return INVALID;
+     }          },
+
+    {"shl",
+     [](Args const& args) -> uint16_t {
+         if (args.empty() || args.size() > 2) {
+             return INVALID;
+         }
+
+         if (args.size() == 2 && is_reg(args[0]) && is_reg(args[1])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+
+             return 0x800E | (x << 8) | (y << 4);
+         }
+         else if (args.size() == 1 && is_reg(args[0])) {
+             auto x = reg(args[0]);
+             return 0x800E | (x << 8);
+         }
+         return INVALID;
+     }          },
+    {"rnd",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 2) {
+             return INVALID;
+         }
+         if (is_reg(args[0]) && is_byte(args[1])) {
+             auto x = reg(args[0]);
+             auto b = byte(args[1]);
+             return 0xC000 | (x << 8) | b;
+         }
+         return INVALID;
+     }          },
+    {"drw",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 3) {
+             return INVALID;
+         }
+         if (is_reg(args[0]) && is_reg(args[1]) && is_nibble(args[2])) {
+             auto x = reg(args[0]);
+             auto y = reg(args[1]);
+             auto b = nibble(args[2]);
+             return 0xD000 | (x << 8) | (y << 4) | b;
+         }
+         return INVALID;
+     }          },
+    {"skp",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 1) {
+             return INVALID;
+         }
+         if (is_reg(args[0])) {
+             auto x = reg(args[0]);
+             return 0xE09E | (x << 8);
+         }
+         return INVALID;
+     }          },
+    {"sknp",
+     [](Args const& args) -> uint16_t {
+         if (args.size() != 1) {
+             return INVALID;
+         }
+         if (is_reg(args[0])) {
+             auto x = reg(args[0]);
+             return 0xE0A1 | (x << 8);
+         }
+         return INVALID;
+     }          },
+    {"high",
+     [](Args const&) -> uint16_t {
+         return 0x00FF;
+     }          },
+    {"low",
+     [](Args const&) -> uint16_t {
+         return 0x00FE;
+     }          },
+    {"scd",
+     [](Args const& args) -> uint16_t {
+         if (args.size() == 1 && is_nibble(args[0])) {
+             return 0x00C0 | nibble(args[0]);
+         }
+         return INVALID;
+     }          },
+    {"scl",
+     [](Args const&) -> uint16_t {
+         return 0x00FC;
+     }          },
+    {"scr",
+     [](Args const&) -> uint16_t {
+         return 0x00FB;
+     }          },
+};
+
+// Instructions with an nnn field, the only ones relocations can patch
+constexpr bool is_address_instruction(uint16_t instruction)
+{
+    auto top = instruction >> 12;
+    return top == 0x1 || top == 0x2 || top == 0xA || top == 0xB;
+}
+
+// Perfect hash of the mnemonics: a seed is searched at compile time so that no two of them share
+// a slot, a lookup is then one hash, one load and one compare
+inline constexpr size_t HASH_SLOTS = 64;
+
+constexpr size_t mnemonicHash(std::string_view name, uint32_t seed)
+{
+    uint32_t hash = seed;
+    for (char c: name)
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x01000193;
+    return (hash ^ (hash >> 15)) % HASH_SLOTS;
+}
+
+constexpr bool collisionFree(uint32_t seed)
+{
+    std::array<bool, HASH_SLOTS> used{};
+    for (auto const& mnemonic: processors) {
+        auto slot = mnemonicHash(mnemonic.name, seed);
+        if (used[slot])
+            return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t findSeed()
+{
+    for (uint32_t seed = 1;; ++seed)
+        if (collisionFree(seed))
+            return seed;
+}
+
+inline constexpr uint32_t SEED = findSeed();
+
+constexpr std::array<int8_t, HASH_SLOTS> buildSlots()
+{
+    std::array<int8_t, HASH_SLOTS> slots{};
+    slots.fill(-1);
+    for (size_t i = 0; i < std::size(processors); ++i)
+        slots[mnemonicHash(processors[i].name, SEED)] = static_cast<int8_t>(i);
+    return slots;
+}
+
+inline constexpr auto SLOTS = buildSlots();
+
+constexpr Mnemonic const* findMnemonic(std::string_view name)
+{
+    int8_t index = SLOTS[mnemonicHash(name, SEED)];
+    return index >= 0 && processors[index].name == name ? &processors[index] : nullptr;
+}
+
+static_assert(findMnemonic("sknp") && findMnemonic("sknp")->name == "sknp");
+static_assert(!findMnemonic("nop"));
+
+// Assembles at origin, or at 0 recording exports, imports and relocations into object. Lines
+// that emit bytes are recorded into map when there is one.
+constexpr AsmResult assembleModule(std::string_view source, uint16_t origin, ObjectModule* object,
+                                   SourceMap* map)
+{
+    AsmResult result;
+    result.bytecode.reserve(source.size() / 4);
+
+    auto error = [&result](size_t line, auto&&... parts) {
+        std::string message;
+        (message.append(parts), ...);
+        result.errors.push_back({line, std::move(message)});
+    };
+
+    SymbolTable symbols;
+
+    uint32_t file = 0;
+    uint32_t label = SourceMap::NO_LABEL;
+    if (map) {
+        if (map->files.empty())
+            map->files.emplace_back();
+        file = map->files.size() - 1;
+    }
+
+    // Operand value: a number, or a symbol once pass is 2. Registers and keywords have none.
+    auto term = [&](std::string_view text, size_t line, int pass) -> std::optional<unsigned> {
+        if (text.empty() || is_reserved(text) || text == "[i]")
+            return std::nullopt;
+        if (text[0] >= '0' && text[0] <= '9')
+            return number(text);
+        if (auto symbol = symbols.find(text))
+            return symbol->value;
+        if (pass == 2)
+            error(line, "undefined symbol '", text, "'");
+        return std::nullopt;
+    };
+
+    // A sum of terms, as in sprite+5
+    auto resolve = [&](std::string_view text, size_t line, int pass) -> std::optional<unsigned> {
+        std::optional<unsigned> sum = 0;
+        while (true) {
+            size_t plus = text.find('+');
+            auto value = term(text.substr(0, plus), line, pass);
+            sum = sum && value ? std::optional(*sum + *value) : std::nullopt;
+            if (plus == text.npos)
+                return sum;
+            text.remove_prefix(plus + 1);
+        }
+    };
+
+    // In object modules labels are relative and undefined symbols are imports, an operand can
+    // refer to one of them plus constants
+    auto operand = [&](std::string_view text, size_t line) -> Operand {
+        if (!object)
+            return {text, resolve(text, line, 2)};
+
+        Operand result{text, 0};
+        for (auto rest = text; result.value;) {
+            size_t plus = rest.find('+');
+            auto part = rest.substr(0, plus);
+
+            Fixup fixup = Fixup::None;
+            std::optional<unsigned> value;
+            auto symbol = is_symbol_name(part) ? symbols.find(part) : nullptr;
+            if (is_symbol_name(part) && !symbol) {
+                if (std::find(object->imports.begin(), object->imports.end(), part) ==
+                    object->imports.end())
+                    object->imports.emplace_back(part);
+                fixup = Fixup::Import;
+                result.import = part;
+                value = 0;
+            }
+            else {
+                fixup = symbol && symbol->label ? Fixup::Local : Fixup::None;
+                value = term(part, line, 2);
+            }
+
+            if (fixup != Fixup::None && result.fixup != Fixup::None)
+                value.reset(); // The linker adds a single address
+            if (fixup != Fixup::None)
+                result.fixup = fixup;
+            result.value = value ? std::optional(*result.value + *value) : std::nullopt;
+
+            if (plus == rest.npos)
+                break;
+            rest.remove_prefix(plus + 1);
+        }
+        return result;
+    };
+
+    // Pass 1 lays out the program and collects labels and constants, pass 2 encodes with every
+    // symbol known. Instructions are always two bytes, so forward references need no fixups.
+    for (int pass = 1; pass <= 2; ++pass) {
+        std::string_view rest = source;
+        uint32_t address = origin;
+        size_t lineNumber = 0;
+
+        while (!rest.empty()) {
+            size_t end = rest.find('\n');
+            auto line = rest.substr(0, end);
+            rest = end == rest.npos ? std::string_view{} : rest.substr(end + 1);
+            ++lineNumber;
+
+            Tokenizer tokens(line);
+
+            auto mnemonic = tokens.next();
+
+            if (!mnemonic.empty() && tokens.consume(':')) {
+                if (pass == 1 && !is_symbol_name(mnemonic))
+                    error(lineNumber, "invalid label name '", mnemonic, "'");
+                else if (pass == 1) {
+                    if (auto previous = symbols.insert(mnemonic, address, lineNumber, true))
+                        error(lineNumber, "'", mnemonic, "' already defined at line ",
+                              decimal(previous->line));
+                    else if (object)
+                        object->exports.emplace_back(mnemonic, address);
+                }
+                else if (map) {
+                    label = map->labels.size();
+                    map->labels.push_back({std::string(mnemonic), static_cast<uint16_t>(address)});
+                }
+                mnemonic = tokens.next();
+            }
+
+            if (mnemonic.empty())
+                continue;
+
+            if (mnemonic == "org" && object) {
+                if (pass == 1)
+                    error(lineNumber, "org is not allowed in relocatable modules");
+                continue;
+            }
+
+            if (mnemonic == "org") {
+                auto target = tokens.next();
+                auto value = resolve(target, lineNumber, 1);
+                if (!value || *value > 0x1000)
+                    error(lineNumber, "invalid org address '", target, "'");
+                else if (*value < address)
+                    error(lineNumber, "org ", target, " moves backwards");
+                else if (pass == 2)
+                    result.bytecode.resize(result.bytecode.size() + (*value - address));
+                if (value && *value >= address)
+                    address = *value;
+                continue;
+            }
+
+            if (mnemonic == "db") {
+                uint32_t start = address;
+                for (auto a = tokens.next(); !a.empty(); a = tokens.next()) {
+                    // Bare hex as always, symbols only where that does not parse
+                    auto value = number(a, true);
+                    auto symbol = value ? nullptr : symbols.find(a);
+                    if (symbol)
+                        value = symbol->value;
+                    if (pass == 2 && object && symbol && symbol->label)
+                        error(lineNumber, "label '", a, "' can not be a db byte in a module");
+                    else if (pass == 2 && (!value || *value > 0xFF))
+                        error(lineNumber, "invalid byte value for db '", a, "'");
+                    else if (pass == 2)
+                        result.bytecode.push_back(*value);
+                    address++;
+                }
+                if (pass == 2 && map && address > start)
+                    map->entries.push_back({static_cast<uint16_t>(start),
+                                            static_cast<uint16_t>(address - start), file,
+                                            static_cast<uint32_t>(lineNumber), label});
+                continue;
+            }
+
+            auto second = tokens.next();
+            if (second == "equ") {
+                auto text = tokens.next();
+                if (pass == 2)
+                    continue;
+                auto value = resolve(text, lineNumber, 1);
+                // Aliases of labels, constants added or not, move with them
+                size_t labels = 0;
+                for (auto terms = text;;) {
+                    size_t plus = terms.find('+');
+                    auto part = terms.substr(0, plus);
+                    auto aliased = is_symbol_name(part) ? symbols.find(part) : nullptr;
+                    if (aliased && aliased->label)
+                        labels++;
+                    if (plus == terms.npos)
+                        break;
+                    terms.remove_prefix(plus + 1);
+                }
+                if (!is_symbol_name(mnemonic))
+                    error(lineNumber, "invalid constant name '", mnemonic, "'");
+                else if (!value)
+                    error(lineNumber, "invalid value for ", mnemonic, " '", text, "'");
+                else if (object && labels > 1)
+                    error(lineNumber, "'", mnemonic, "' adds up more than one label");
+                else if (auto previous = symbols.insert(mnemonic, *value, lineNumber, labels > 0))
+                    error(lineNumber, "'", mnemonic, "' already defined at line ",
+                          decimal(previous->line));
+                continue;
+            }
+
+            address += 2;
+            if (pass == 1)
+                continue;
+
+            auto processor = findMnemonic(mnemonic);
+            if (!processor) {
+                error(lineNumber, "unknown instruction '", mnemonic, "'");
+                continue;
+            }
+
+            Args args;
+            size_t errors = result.errors.size();
+            bool tooMany = false;
+            for (auto a = second; !a.empty(); a = tokens.next()) {
+                if (args.count == MAX_ARGS) {
+                    tooMany = true;
+                    break;
+                }
+                args.arg[args.count++] = operand(a, lineNumber);
+            }
+
+            // Undefined symbols were reported already
+            if (result.errors.size() != errors)
+                continue;
+
+            uint16_t instruction = tooMany ? INVALID : processor->encode(args);
+            if (instruction == INVALID) {
+                error(lineNumber, "invalid arguments for ", mnemonic, ": '", line, "'");
+                continue;
+            }
+
+            for (size_t i = 0; object && i < args.size(); ++i) {
+                if (args[i].fixup == Fixup::None)
+                    continue;
+                if (i + 1 != args.size() || !is_address_instruction(instruction))
+                    error(lineNumber, "'", args[i].text, "' can only be used as an address");
+                else
+                    object->relocations.push_back(
+                        {static_cast<uint16_t>(address - 2),
+                         args[i].fixup == Fixup::Import ? std::string(args[i].import) : ""});
+            }
+
+            result.bytecode.push_back((instruction >> 8) & 0xFF);
+            result.bytecode.push_back(instruction & 0xFF);
+
+            if (map)
+                map->entries.push_back({static_cast<uint16_t>(address - 2), 2, file,
+                                        static_cast<uint32_t>(lineNumber), label});
+        }
+
+        if (!result.errors.empty())
+            break;
+    }
+
+    if (!result.errors.empty())
+        result.bytecode.clear();
+
+    return result;
+}
+
+} // namespace detail
+
+// String literal as a template argument
+template<size_t N>
+struct AsmSource {
+    char text[N];
+
+    consteval AsmSource(char const (&source)[N])
+    {
+        std::copy_n(source, N, text);
+    }
+
+    constexpr std::string_view view() const
+    {
+        return {text, N - 1};
+    }
+};
+
+// Not constexpr, so assembling a source with errors in assemble_ct() fails to compile
+void assemble_ct_source_has_errors();
+
+// Program assembled at 0x200 during compilation, as in constexpr auto p = assemble_ct<R"(...)">()
+template<AsmSource Source>
+consteval auto assemble_ct()
+{
+    constexpr size_t SIZE = [] {
+        auto result = detail::assembleModule(Source.view(), 0x200, nullptr, nullptr);
+        if (!result.ok())
+            assemble_ct_source_has_errors();
+        return result.bytecode.size();
+    }();
+
+    auto result = detail::assembleModule(Source.view(), 0x200, nullptr, nullptr);
+    std::array<uint8_t, SIZE> program{};
+    std::copy(result.bytecode.begin(), result.bytecode.end(), program.begin());
+    return program;
+}
+
+} // namespace chipate
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "bisect.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace chipate {
+
+namespace {
+
+size_t const MEMORY_LINES = 8; // Differing bytes listed one by one, the rest are counted
+
+using StatePair = std::pair<MachineState, MachineState>;
+
+std::unique_ptr<Chip8> machine(EngineConfig const& config, MachineState const& state)
+{
+    auto chip8 = std::make_unique<Chip8>();
+    chip8->setQuirks(config.quirks);
+    chip8->setFusion(config.fusion);
+    chip8->restore(state);
+    return chip8;
+}
+
+bool differ(StatePair const& states)
+{
+    return hashState(states.first) != hashState(states.second);
+}
+
+// Both engines from their states for a number of frames, A on a thread of its own
+StatePair runFrames(EngineConfig const& a, EngineConfig const& b, StatePair const& from,
+                    size_t frames, size_t tickRate)
+{
+    StatePair to;
+    auto run = [&](EngineConfig const& config, MachineState const& state, MachineState& result) {
+        auto chip8 = machine(config, state);
+        for (size_t frame = 0; frame < frames; ++frame)
+            chip8->frame(tickRate);
+        result = chip8->state();
+    };
+
+    std::jthread worker(run, std::cref(a), std::cref(from.first), std::ref(to.first));
+    run(b, from.second, to.second);
+    worker.join();
+    return to;
+}
+
+// The first count instructions of a frame, stopping where frame() would. One at a time, so no
+// fused code runs.
+MachineState runInstructions(EngineConfig const& config, MachineState const& state, size_t count,
+                             size_t tickRate)
+{
+    auto chip8 = machine(config, state);
+    size_t cycles = 0;
+    while (cycles < std::min(count, tickRate)) {
+        auto result = chip8->run(1);
+        cycles += result.cycles;
+        if (result.reason == StopReason::VBlank || result.reason == StopReason::KeyWait ||
+            !result.cycles)
+            break;
+    }
+    return chip8->state();
+}
+
+// First point in (agree, differ] where differs() holds, given it does not at agree and does at
+// differ
+template <typename Differs>
+size_t firstDiffering(size_t agree, size_t differ, Differs differs)
+{
+    while (differ - agree > 1) {
+        size_t middle = agree + (differ - agree) / 2;
+        (differs(middle) ? differ : agree) = middle;
+    }
+    return differ;
+}
+
+uint16_t opcodeAt(MachineState const& state, uint16_t pc)
+{
+    pc = std::min<uint16_t>(pc, state.memory.size() - 2);
+    return state.memory[pc] << 8 | state.memory[pc + 1];
+}
+
+} // namespace
+
+std::optional<Divergence> bisect(std::span<uint8_t const> rom, EngineConfig const& a,
+                                 EngineConfig const& b, BisectOptions const& options)
+{
+    size_t interval = std::max<size_t>(options.interval, 1);
+
+    // Snapshot k is after min(k * interval, frames) frames
+    std::vector<MachineState> snapshotsA;
+    std::vector<MachineState> snapshotsB;
+    auto record = [&](EngineConfig const& config, std::vector<MachineState>& snapshots) {
+        auto chip8 = std::make_unique<Chip8>();
+        chip8->init(rom, config.quirks);
+        chip8->seedRandom(options.seed);
+        chip8->setFusion(config.fusion);
+        snapshots.push_back(chip8->state());
+        for (size_t frame = 0; frame < options.frames;) {
+            for (size_t end = std::min(frame + interval, options.frames); frame < end; ++frame)
+                chip8->frame(options.tickRate);
+            snapshots.push_back(chip8->state());
+        }
+    };
+    {
+        std::jthread worker(record, std::cref(a), std::ref(snapshotsA));
+        record(b, snapshotsB);
+    }
+
+    auto snapshot = [&](size_t k) {
+        return StatePair{snapshotsA[k], snapshotsB[k]};
+    };
+    size_t last = snapshotsA.size() - 1;
+    if (!differ(snapshot(last)))
+        return std::nullopt;
+
+    size_t k = firstDiffering(0, last, [&](size_t k) { return differ(snapshot(k)); });
+    size_t from = (k - 1) * interval;
+    auto framesFrom = [&](size_t frame) {
+        return runFrames(a, b, snapshot(k - 1), frame - from, options.tickRate);
+    };
+    size_t after = firstDiffering(from, std::min(k * interval, options.frames),
+                                  [&](size_t frame) { return differ(framesFrom(frame)); });
+
+    Divergence divergence;
+    divergence.frame = after - 1;
+    StatePair start = framesFrom(divergence.frame);
+
+    auto instructions = [&](size_t count) {
+        return StatePair{runInstructions(a, start.first, count, options.tickRate),
+                         runInstructions(b, start.second, count, options.tickRate)};
+    };
+    MachineState before = start.first;
+    StatePair end;
+    if (differ(instructions(options.tickRate))) {
+        size_t count = firstDiffering(0, options.tickRate,
+                                      [&](size_t count) { return differ(instructions(count)); });
+        divergence.instruction = count;
+        before = instructions(count - 1).first;
+        end = instructions(count);
+    }
+    else {
+        end = framesFrom(after);
+    }
+
+    divergence.pc = before.PC;
+    divergence.opcode = opcodeAt(before, before.PC);
+    divergence.a = end.first;
+    divergence.b = end.second;
+    divergence.fields = stateDifferences(end.first, end.second);
+    return divergence;
+}
+
+std::vector<std::string> stateDifferences(MachineState const& a, MachineState const& b)
+{
+    std::vector<std::string> fields;
+    auto compare = [&](char const* name, unsigned left, unsigned right, int digits) {
+        if (left == right)
+            return;
+        char line[96];
+        snprintf(line, sizeof(line), "%s: %0*x / %0*x", name, digits, left, digits, right);
+        fields.push_back(line);
+    };
+    char name[32];
+
+    for (size_t x = 0; x < a.V.size(); ++x) {
+        snprintf(name, sizeof(name), "V%zX", x);
+        compare(name, a.V[x], b.V[x], 2);
+    }
+    compare("PC", a.PC, b.PC, 3);
+    compare("I", a.I, b.I, 3);
+    compare("SP", a.SP, b.SP, 2);
+    compare("DT", a.delayTimer, b.delayTimer, 2);
+    compare("ST", a.soundTimer, b.soundTimer, 2);
+    compare("waiting for key", a.waitForKey, b.waitForKey, 1);
+    compare("key register", a.waitForKeyReg, b.waitForKeyReg, 1);
+    compare("hires", a.hiResMode, b.hiResMode, 1);
+    compare("waiting for vblank", a.waitForVBlank, b.waitForVBlank, 1);
+    compare("keys", a.keys, b.keys, 4);
+    compare("RND", a.rng, b.rng, 8);
+    for (size_t slot = 0; slot < a.S.size(); ++slot) {
+        snprintf(name, sizeof(name), "S[%zu]", slot);
+        compare(name, a.S[slot], b.S[slot], 3);
+    }
+
+    size_t bytes = 0;
+    for (size_t address = 0; address < a.memory.size(); ++address) {
+        if (a.memory[address] == b.memory[address])
+            continue;
+        if (bytes++ < MEMORY_LINES) {
+            snprintf(name, sizeof(name), "memory[%03zx]", address);
+            compare(name, a.memory[address], b.memory[address], 2);
+        }
+    }
+    if (bytes > MEMORY_LINES)
+        fields.push_back("memory: " + std::to_string(bytes - MEMORY_LINES) + " more bytes");
+
+    size_t pixels = 0;
+    for (size_t column = 0; column < a.FB.size(); ++column)
+        pixels += (a.FB[column] ^ b.FB[column]).count();
+    if (pixels)
+        fields.push_back("frame buffer: " + std::to_string(pixels) + " pixels");
+
+    return fields;
+}
+
+} // namespace chipate
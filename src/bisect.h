@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "chip8.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace chipate {
+
+// How a machine executes, runs that only differ in this have to agree
+struct EngineConfig {
+    Quirks quirks;
+    bool fusion = true;
+};
+
+struct BisectOptions {
+    size_t frames = 600;
+    size_t tickRate = 10;
+    size_t interval = 64; // Frames between snapshots
+    uint32_t seed = 1;    // For RND, the same in both runs
+};
+
+struct Divergence {
+    size_t frame; // Both agree before it and differ after it
+    // Instructions into the frame after which the states differ, nullopt when stepping through
+    // the frame one instruction at a time agrees and only running it whole does not
+    std::optional<size_t> instruction;
+    uint16_t pc;     // Of the instruction, or of the frame start without one
+    uint16_t opcode; // At pc
+    MachineState a;  // Right after the instruction or the frame
+    MachineState b;
+    std::vector<std::string> fields; // Those that differ, as in stateDifferences()
+};
+
+// Runs the ROM on both engines in parallel for options.frames frames, keeping snapshots every
+// interval frames. Binary searches the snapshots, then the frames between the last two, then the
+// instructions of the frame for the first point the states differ. The search assumes runs stay
+// apart once they diverge. nullopt when they agree to the end.
+std::optional<Divergence> bisect(std::span<uint8_t const> rom, EngineConfig const& a,
+                                 EngineConfig const& b, BisectOptions const& options = {});
+
+// One line per differing field, like "V3: 04 / 05", memory and stack slots by address
+std::vector<std::string> stateDifferences(MachineState const& a, MachineState const& b);
+
+} // namespace chipate
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "rom.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+namespace chipate {
+
+// A program of the chip8archive. Its strings are offsets into CATALOG_STRINGS and its ROM is a
+// range of CATALOG_ROMS, all generated at build time, so nothing is parsed or allocated at startup.
+struct CatalogEntry {
+    uint32_t name;
+    uint32_t title;
+    uint32_t authors; // Joined with ", "
+    uint32_t release;
+    uint32_t event;
+    uint32_t platform;
+    uint32_t desc;
+    uint32_t romOffset;
+    uint32_t romSize;
+    OctoOptions options;
+};
+
+#include "rom_catalog.h"
+
+constexpr char const* catalogString(uint32_t offset)
+{
+    return CATALOG_STRINGS + offset;
+}
+
+constexpr std::span<uint8_t const> catalogRom(CatalogEntry const& entry)
+{
+    return {CATALOG_ROMS + entry.romOffset, entry.romSize};
+}
+
+} // namespace chipate
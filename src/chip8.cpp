@@ -2,11 +2,13 @@
 
 #include "chip8.h"
 
+#include "hash.h"
 #include "log.h"
 #include "opcode.h"
 
+#include <algorithm>
 #include <cstdint>
-#include <random>
+#include <type_traits>
 #include <stdlib.h>
 
 using namespace chipate;
@@ -19,46 +21,228 @@ uint8_t const ROM_DATA[]{
     0xF0, 0xE0, 0x90, 0x90, 0x90, 0xE0, 0xF0, 0x80, 0xF0, 0x80, 0xF0, 0xF0, 0x80, 0xF0, 0x80, 0x80,
 };
 
+namespace {
+
+// Quirks fixed at compile time, so the checks in the handlers fold away
+template <Quirks P>
+struct StaticQuirks {
+    static constexpr bool shiftVxOnly = P.shiftVxOnly;
+    static constexpr bool loadStoreIAdd = P.loadStoreIAdd;
+    static constexpr bool jumpWithVx = P.jumpWithVx;
+    static constexpr bool logicNoVF = P.logicNoVF;
+    static constexpr bool spriteWrap = P.spriteWrap;
+    static constexpr bool legacySchipScroll = P.legacySchipScroll;
+};
+
+size_t fusionLength(Fusion fusion)
+{
+    switch (fusion) {
+    case Fusion::None:
+        return 1;
+    case Fusion::LoadIDraw:
+    case Fusion::SkipJump:
+    case Fusion::AddSkip:
+    case Fusion::TimerSkip:
+        return 2;
+    case Fusion::AddSkipJump:
+    case Fusion::TimerSkipJump:
+        return 3;
+    case Fusion::Count:
+        break;
+    }
+    return 1;
+}
+
+bool isSkipImmediate(uint16_t data)
+{
+    return (data & 0xF000) == SE || (data & 0xF000) == SNE;
+}
+
+bool isJump(uint16_t data)
+{
+    return (data & 0xF000) == JP;
+}
+
+bool sameVx(uint16_t a, uint16_t b)
+{
+    return (a & 0x0F00) == (b & 0x0F00);
+}
+
+// Whether a 3xkk/4xkk skip is taken for the given Vx value
+bool skipTaken(uint16_t skip, uint8_t vx)
+{
+    bool equal = vx == (skip & 0x00FF);
+    return (skip & 0xF000) == SE ? equal : !equal;
+}
+
+uint64_t memoryTerm(size_t address, uint8_t value)
+{
+    return mix64(address << 8 | value);
+}
+
+uint64_t columnTerm(size_t column, std::bitset<64> const& pixels)
+{
+    return mix64(pixels.to_ullong() ^ mix64(column | 0x10000));
+}
+
+// Everything but memory and the frame buffer, combined with their rolling hashes
+uint64_t combineHash(MachineState const& state, uint64_t memoryHash, uint64_t screenHash)
+{
+    uint8_t const fields[]{static_cast<uint8_t>(state.PC >> 8),
+                           static_cast<uint8_t>(state.PC),
+                           static_cast<uint8_t>(state.I >> 8),
+                           static_cast<uint8_t>(state.I),
+                           state.SP,
+                           state.delayTimer,
+                           state.soundTimer,
+                           state.waitForKey,
+                           state.waitForKeyReg,
+                           state.hiResMode,
+                           state.waitForVBlank,
+                           static_cast<uint8_t>(state.rng >> 24),
+                           static_cast<uint8_t>(state.rng >> 16),
+                           static_cast<uint8_t>(state.rng >> 8),
+                           static_cast<uint8_t>(state.rng)};
+
+    uint64_t hash = fnv1a(state.V);
+    hash = fnv1a(fields, hash);
+    for (uint16_t slot: state.S)
+        hash = fnv1a(std::array{static_cast<uint8_t>(slot >> 8), static_cast<uint8_t>(slot)}, hash);
+    return mix64(hash ^ memoryHash) ^ mix64(screenHash + 1);
+}
+
+// Undo records following the old PC in a journal entry, tags 0 to 15 hold the old Vx
+enum UndoTag : uint8_t
+{
+    UNDO_I = 16, // Old I
+    UNDO_STACK,  // Old SP and the slot CALL writes
+    UNDO_TIMERS, // Old delay and sound timers
+    UNDO_FLAGS,  // Old waits and resolution, and the register a key press goes to
+    UNDO_MEMORY, // Address, length and the old bytes
+    UNDO_COLUMN, // Column index and its old pixels
+    UNDO_SCREEN, // The whole old frame buffer
+    UNDO_RANDOM  // Old RND generator
+};
+
+} // namespace
+
+uint64_t chipate::hashState(MachineState const& state)
+{
+    uint64_t memoryHash = 0;
+    for (size_t a = 0; a < state.memory.size(); ++a)
+        memoryHash ^= memoryTerm(a, state.memory[a]);
+
+    uint64_t screenHash = 0;
+    for (size_t c = 0; c < state.FB.size(); ++c)
+        screenHash ^= columnTerm(c, state.FB[c]);
+
+    return combineHash(state, memoryHash, screenHash);
+}
+
+char const* chipate::fusionName(Fusion fusion)
+{
+    switch (fusion) {
+    case Fusion::None:
+        return "none";
+    case Fusion::LoadIDraw:
+        return "ld i + drw";
+    case Fusion::SkipJump:
+        return "se/sne + jp";
+    case Fusion::AddSkip:
+        return "add + se/sne";
+    case Fusion::AddSkipJump:
+        return "add + se/sne + jp";
+    case Fusion::TimerSkip:
+        return "ld dt + se/sne";
+    case Fusion::TimerSkipJump:
+        return "ld dt + se/sne + jp";
+    case Fusion::Count:
+        break;
+    }
+    return "unknown";
+}
+
 Chip8::Chip8()
-    : memory{}
-    , FB{}
-    , S{}
-    , V{}
-    , PC(0x200)
-    , I(0)
-    , SP(0)
-    , delayTimer(0)
-    , soundTimer(0)
-    , waitForKey(false)
-    , waitForKeyReg(0)
-    , hiResMode(false)
-{}
-
-void Chip8::init(std::vector<uint8_t> const& program, Quirks const& quirks)
+    : MachineState{}
 {
-    this->quirks = quirks;
-    srand(static_cast<unsigned int>(time(nullptr)));
-    memory.fill(0);
-    FB.fill(0);
-    S.fill(0);
-    V.fill(0);
     PC = 0x200;
-    I = 0;
-    SP = 0;
-    delayTimer = 0;
-    soundTimer = 0;
-    waitForKey = false;
-    waitForKeyReg = 0;
-    hiResMode = false;
+    selectInterpreter();
+}
 
-    std::copy(ROM_DATA, ROM_DATA + 0x200, memory.begin());
+void Chip8::init(std::span<uint8_t const> program, Quirks const& quirks, uint32_t seed)
+{
+    // Power on state, cleared with the font in place
+    static MachineState const BOOT = [] {
+        MachineState state{};
+        state.PC = 0x200;
+        std::copy(std::begin(ROM_DATA), std::end(ROM_DATA), state.memory.begin());
+        return state;
+    }();
+
+    this->quirks = quirks;
+    selectInterpreter();
+    restore(BOOT);
+    seedRandom(seed);
+    resetPcCounts();
 
     // Load program into memory starting at address 0x200
+    if (program.size() > MAX_ROM_SIZE) {
+        loge("Program of %zu bytes does not fit in memory, loading the first %zu", program.size(),
+             MAX_ROM_SIZE);
+        program = program.first(MAX_ROM_SIZE);
+    }
     std::copy(program.begin(), program.end(), memory.begin() + 0x200);
+    rehash();
 
     logi("Program loaded, size: %zu bytes", program.size());
 }
 
+void Chip8::restore(MachineState const& state)
+{
+    static_cast<MachineState&>(*this) = state;
+    resumingFrom.reset();
+    fusionDecoded.reset();
+    undoJournal.clear();
+    rehash();
+}
+
+uint64_t Chip8::stateHash() const
+{
+    return combineHash(*this, memoryHash, screenHash);
+}
+
+void Chip8::rehash()
+{
+    memoryHash = 0;
+    toggleMemoryHash(0, memory.size());
+    screenHash = 0;
+    toggleScreenHash(0, FB.size());
+}
+
+void Chip8::toggleMemoryHash(size_t address, size_t length)
+{
+    for (size_t a = address; a < std::min(address + length, memory.size()); ++a)
+        memoryHash ^= memoryTerm(a, memory[a]);
+}
+
+void Chip8::toggleScreenHash(size_t column, size_t count)
+{
+    for (size_t c = column; c < std::min(column + count, FB.size()); ++c)
+        screenHash ^= columnTerm(c, FB[c]);
+}
+
+void Chip8::patch(uint16_t address, std::span<uint8_t const> bytes)
+{
+    size_t offset = std::min<size_t>(address, memory.size());
+    size_t length = std::min(bytes.size(), memory.size() - offset);
+    toggleMemoryHash(offset, length);
+    std::copy_n(bytes.begin(), length, memory.begin() + offset);
+    toggleMemoryHash(offset, length);
+    invalidateFusion(address, length);
+
+    logd("Patched %zu bytes @ %x", length, address);
+}
+
 void Chip8::tock()
 {
     if (delayTimer)
@@ -84,14 +268,411 @@ void Chip8::tick()
 
     logd("Fetch @%x: %x", PC, currentInstruction);
 
+    if (!pcHits.empty())
+        pcHits[PC]++;
+    if (journaling())
+        recordUndo(currentInstruction);
+
     if (!exec(currentInstruction))
         loge("Execution failed at PC: %x", PC);
 }
 
+bool Chip8::stopAtBreakpoint()
+{
+    // Once per arrival, so that resuming from a breakpoint runs past it
+    if (!breakpoints[PC & 0x0FFF] || resumingFrom == PC)
+        return false;
+    resumingFrom = PC;
+    return true;
+}
+
+RunResult Chip8::run(size_t maxCycles)
+{
+    size_t cycles = 0;
+
+    while (cycles < maxCycles) {
+        if (waitForKey)
+            return {cycles, StopReason::KeyWait};
+
+        if (waitForVBlank)
+            return {cycles, StopReason::VBlank};
+
+        if (PC > memory.size() - 2) {
+            loge("PC out of memory: %x", PC);
+            return {cycles, StopReason::Fault};
+        }
+
+        if (stopAtBreakpoint())
+            return {cycles, StopReason::Breakpoint};
+        resumingFrom.reset();
+
+        if (fusionEnabled && pcHits.empty() && !journaling()) {
+            Fusion fusion = fusionAt(PC);
+            size_t length = fusionLength(fusion);
+
+            // Fused instructions can not stop midway, so they must fit the budget and must not
+            // cover a breakpoint
+            if (fusion != Fusion::None && maxCycles - cycles >= length && !breakpoints[PC + 2] &&
+                (length < 3 || !breakpoints[PC + 4])) {
+                cycles += execFused(fusion);
+                if (fusionProfiling)
+                    fusionCounts[static_cast<size_t>(fusion)]++;
+                continue;
+            }
+        }
+
+        uint16_t currentInstruction = static_cast<uint16_t>(memory[PC + 1]) | (memory[PC] << 8);
+        bool soundWasOff = soundTimer == 0;
+
+        cycles++;
+        if (!pcHits.empty())
+            pcHits[PC]++;
+        if (journaling())
+            recordUndo(currentInstruction);
+
+        if (!exec(currentInstruction)) {
+            loge("Execution failed at PC: %x", PC);
+            return {cycles, StopReason::Fault};
+        }
+
+        if (soundWasOff && soundTimer)
+            return {cycles, StopReason::Sound};
+    }
+
+    return {cycles, StopReason::Budget};
+}
+
+size_t Chip8::frame(size_t maxCycles)
+{
+    size_t cycles = 0;
+
+    while (cycles < maxCycles) {
+        auto result = run(maxCycles - cycles);
+        cycles += result.cycles;
+        if (result.reason == StopReason::VBlank || result.reason == StopReason::KeyWait ||
+            !result.cycles)
+            break;
+    }
+
+    tock();
+    return cycles;
+}
+
+Fusion Chip8::fusionAt(uint16_t address)
+{
+    if (fusionDecoded[address])
+        return fusionCache[address];
+
+    auto word = [this](size_t a) -> uint16_t {
+        return a + 1 < memory.size() ? memory[a] << 8 | memory[a + 1] : 0;
+    };
+
+    uint16_t first = word(address);
+    uint16_t second = word(address + 2);
+    uint16_t third = word(address + 4);
+
+    Fusion fusion = Fusion::None;
+
+    if ((first & 0xF000) == LDI && (second & 0xF000) == DRW)
+        fusion = Fusion::LoadIDraw;
+    else if (isSkipImmediate(first) && isJump(second))
+        fusion = Fusion::SkipJump;
+    else if ((first & 0xF000) == ADD && isSkipImmediate(second) && sameVx(first, second))
+        fusion = isJump(third) ? Fusion::AddSkipJump : Fusion::AddSkip;
+    else if ((first & 0xF0FF) == LDRD && isSkipImmediate(second) && sameVx(first, second))
+        fusion = isJump(third) ? Fusion::TimerSkipJump : Fusion::TimerSkip;
+
+    // Sequences running off the end of memory are left to the regular fetch
+    if (address + 2 * fusionLength(fusion) > memory.size())
+        fusion = Fusion::None;
+
+    fusionCache[address] = fusion;
+    fusionDecoded[address] = true;
+
+    return fusion;
+}
+
+// Executes the sequence fusionAt() found at PC, returns the number of instructions it covered
+size_t Chip8::execFused(Fusion fusion)
+{
+    uint16_t first = memory[PC] << 8 | memory[PC + 1];
+    uint16_t second = memory[PC + 2] << 8 | memory[PC + 3];
+    Instruction head(first, V);
+
+    switch (fusion) {
+    case Fusion::LoadIDraw:
+        I = head.nnn();
+        PC += 4;
+        exec_draw(Instruction(second, V));
+        return 2;
+
+    case Fusion::SkipJump:
+        if (skipTaken(first, head.vx())) {
+            PC += 4;
+            return 1;
+        }
+        PC = second & 0x0FFF;
+        return 2;
+
+    case Fusion::AddSkip:
+    case Fusion::AddSkipJump:
+    case Fusion::TimerSkip:
+    case Fusion::TimerSkipJump: {
+        bool add = fusion == Fusion::AddSkip || fusion == Fusion::AddSkipJump;
+        bool jump = fusion == Fusion::AddSkipJump || fusion == Fusion::TimerSkipJump;
+
+        if (add)
+            head.vx() += head.kk();
+        else
+            head.vx() = delayTimer;
+
+        if (skipTaken(second, head.vx())) {
+            PC += 6;
+            return 2;
+        }
+        if (!jump) {
+            PC += 4;
+            return 2;
+        }
+        PC = (memory[PC + 4] << 8 | memory[PC + 5]) & 0x0FFF;
+        return 3;
+    }
+
+    case Fusion::None:
+    case Fusion::Count:
+        break;
+    }
+
+    return 0;
+}
+
+void Chip8::invalidateFusion(uint16_t address, size_t length)
+{
+    // A fusion covers up to three instructions, so starts up to 5 bytes before a write see it
+    size_t begin = address >= 5 ? address - 5 : 0;
+    size_t end = std::min(memory.size(), static_cast<size_t>(address) + length);
+
+    for (size_t a = begin; a < end; ++a)
+        fusionDecoded[a] = false;
+}
+
+// Journals what instruction is about to overwrite, a few bytes for most of them
+void Chip8::recordUndo(uint16_t instruction)
+{
+    undoEntry.clear();
+    auto word = [&](uint16_t value) {
+        undoEntry.push_back(value >> 8);
+        undoEntry.push_back(value & 0xFF);
+    };
+    auto bytes = [&](void const* data, size_t size) {
+        auto begin = static_cast<uint8_t const*>(data);
+        undoEntry.insert(undoEntry.end(), begin, begin + size);
+    };
+    auto reg = [&](uint8_t x) {
+        undoEntry.push_back(x);
+        undoEntry.push_back(V[x]);
+    };
+    auto index = [&] {
+        undoEntry.push_back(UNDO_I);
+        word(I);
+    };
+    auto flags = [&] {
+        undoEntry.push_back(UNDO_FLAGS);
+        undoEntry.push_back(waitForKey | hiResMode << 1 | waitForVBlank << 2);
+        undoEntry.push_back(waitForKeyReg);
+    };
+    auto store = [&](size_t length) {
+        size_t address = std::min<size_t>(I, memory.size());
+        length = std::min(length, memory.size() - address);
+        undoEntry.push_back(UNDO_MEMORY);
+        word(address);
+        undoEntry.push_back(length);
+        bytes(memory.data() + address, length);
+    };
+    auto screen = [&] {
+        undoEntry.push_back(UNDO_SCREEN);
+        bytes(FB.data(), sizeof(FB));
+    };
+
+    word(PC);
+
+    Instruction i(instruction, V);
+    OpcodeMatch const* match = decode(instruction);
+    switch (match ? match->opcode : Opcode{}) {
+    case CLS:
+    case SCRD:
+    case SCRL:
+    case SCRR:
+        screen();
+        break;
+    case HIRS:
+    case LORS:
+        flags();
+        break;
+    case RET:
+    case CALL:
+        undoEntry.push_back(UNDO_STACK);
+        undoEntry.push_back(SP);
+        word(SP < S.size() ? S[SP] : 0);
+        break;
+    case LD:
+    case ADD:
+    case LDR:
+    case LDRD:
+        reg(i.x());
+        break;
+    case RND:
+        reg(i.x());
+        undoEntry.push_back(UNDO_RANDOM);
+        word(rng >> 16);
+        word(rng & 0xFFFF);
+        break;
+    case OR:
+    case AND:
+    case XOR:
+    case ADDC:
+    case SUB:
+    case SHR:
+    case SUBN:
+    case SHL:
+        reg(i.x());
+        reg(0xF);
+        break;
+    case LDI:
+    case ADDI:
+        index();
+        break;
+    case LDS: // Out of range digits are masked in Vx
+        reg(i.x());
+        index();
+        break;
+    case DRW: {
+        reg(0xF);
+        flags();
+        // The frame buffer is column major, so the sprite touches up to 8 columns
+        size_t screenWidth = hiResMode ? 128 : 64;
+        size_t x0 = i.vx() % screenWidth;
+        for (size_t x = x0; x < std::min(x0 + 8, screenWidth); ++x) {
+            undoEntry.push_back(UNDO_COLUMN);
+            undoEntry.push_back(x);
+            bytes(&FB[x], sizeof(FB[x]));
+        }
+        break;
+    }
+    case LDK:
+        reg(i.x());
+        flags();
+        break;
+    case LDDR:
+    case LDSR:
+        undoEntry.push_back(UNDO_TIMERS);
+        undoEntry.push_back(delayTimer);
+        undoEntry.push_back(soundTimer);
+        break;
+    case LBCD:
+        store(3);
+        break;
+    case LDMR:
+        store(i.x() + 1);
+        index();
+        break;
+    case LDRM:
+        for (uint8_t x = 0; x <= i.x(); ++x)
+            reg(x);
+        index();
+        break;
+    default: // Jumps and skips only move PC
+        break;
+    }
+
+    undoJournal.push(undoEntry);
+}
+
+bool Chip8::stepBack()
+{
+    if (!undoJournal.pop(undoEntry))
+        return false;
+
+    uint8_t const* at = undoEntry.data();
+    uint8_t const* end = at + undoEntry.size();
+    auto word = [&] {
+        uint16_t value = at[0] << 8 | at[1];
+        at += 2;
+        return value;
+    };
+    auto bytes = [&](void* data, size_t size) {
+        std::copy_n(at, size, static_cast<uint8_t*>(data));
+        at += size;
+    };
+
+    PC = word();
+    resumingFrom.reset();
+    while (at < end) {
+        uint8_t tag = *at++;
+        if (tag < V.size()) {
+            V[tag] = *at++;
+            continue;
+        }
+
+        switch (tag) {
+        case UNDO_I:
+            I = word();
+            break;
+        case UNDO_STACK:
+            SP = *at++;
+            if (SP < S.size())
+                S[SP] = word();
+            else
+                at += 2;
+            break;
+        case UNDO_TIMERS:
+            delayTimer = *at++;
+            soundTimer = *at++;
+            break;
+        case UNDO_FLAGS:
+            waitForKey = *at & 1;
+            hiResMode = *at >> 1 & 1;
+            waitForVBlank = *at >> 2 & 1;
+            waitForKeyReg = at[1];
+            at += 2;
+            break;
+        case UNDO_MEMORY: {
+            uint16_t address = word();
+            uint8_t length = *at++;
+            toggleMemoryHash(address, length);
+            bytes(memory.data() + address, length);
+            toggleMemoryHash(address, length);
+            invalidateFusion(address, length);
+            break;
+        }
+        case UNDO_COLUMN: {
+            uint8_t x = *at++;
+            toggleScreenHash(x, 1);
+            bytes(&FB[x], sizeof(FB[x]));
+            toggleScreenHash(x, 1);
+            break;
+        }
+        case UNDO_SCREEN:
+            toggleScreenHash(0, FB.size());
+            bytes(FB.data(), sizeof(FB));
+            toggleScreenHash(0, FB.size());
+            break;
+        case UNDO_RANDOM:
+            rng = static_cast<uint32_t>(word()) << 16;
+            rng |= word();
+            break;
+        }
+    }
+
+    logt("Stepped back to PC: %x", PC);
+    return true;
+}
+
 void Chip8::setKey(int key, bool pressed)
 {
     uint8_t k = static_cast<uint8_t>(key);
-    K[k] = pressed;
+    if (k < 16)
+        keys = pressed ? keys | 1 << k : keys & ~(1 << k);
     if (waitForKey && pressed) {
         V[waitForKeyReg] = k;
         waitForKey = false;
@@ -99,15 +680,35 @@ void Chip8::setKey(int key, bool pressed)
     }
 }
 
-bool Chip8::exec(uint16_t data)
+void Chip8::selectInterpreter()
+{
+    if (quirks == CHIP8_QUIRKS)
+        interpreter = &Chip8::execAs<StaticQuirks<CHIP8_QUIRKS>>;
+    else if (quirks == SCHIP_1_0_QUIRKS)
+        interpreter = &Chip8::execAs<StaticQuirks<SCHIP_1_0_QUIRKS>>;
+    else if (quirks == SCHIP_MODERN_QUIRKS)
+        interpreter = &Chip8::execAs<StaticQuirks<SCHIP_MODERN_QUIRKS>>;
+    else
+        interpreter = &Chip8::execAs<Quirks>;
+}
+
+template <typename Q>
+bool Chip8::execAs(uint16_t data)
 {
-    auto match =
-        std::find_if(opcodeMatches.begin(), opcodeMatches.end(),
-                     [data](auto const& match) { return (data & match.mask) == match.opcode; });
+    if constexpr (std::is_same_v<Q, Quirks>)
+        return exec(data, quirks);
+    else
+        return exec(data, Q{});
+}
+
+template <typename Q>
+bool Chip8::exec(uint16_t data, Q const& q)
+{
+    auto match = decode(data);
 
     step();
 
-    if (match == opcodeMatches.end()) {
+    if (!match) {
         loge("Unknown instruction: @%x: %x", PC, data);
         return false;
     }
@@ -146,11 +747,11 @@ bool Chip8::exec(uint16_t data)
     case SUB:
         return exec_subr(instruction);
     case SHR:
-        return exec_shrr(instruction);
+        return exec_shrr(instruction, q);
     case SUBN:
         return exec_subn(instruction);
     case SHL:
-        return exec_shlr(instruction);
+        return exec_shlr(instruction, q);
     case SNER:
         return exec_sknr(instruction);
     case LDI:
@@ -188,11 +789,11 @@ bool Chip8::exec(uint16_t data)
     case LORS:
         return exec_lors(instruction);
     case SCRD:
-        return exec_scrd(instruction);
+        return exec_scrd(instruction, q);
     case SCRL:
-        return exec_scrl(instruction);
+        return exec_scrl(instruction, q);
     case SCRR:
-        return exec_scrr(instruction);
+        return exec_scrr(instruction, q);
     }
 
     loge("Unknown opcode: %x", match->opcode);
@@ -204,7 +805,9 @@ bool Chip8::exec_clrs(Instruction i)
 {
     (void)i;
 
+    toggleScreenHash(0, FB.size());
     FB.fill(0);
+    toggleScreenHash(0, FB.size());
 
     logt("CLS executed, frame buffer cleared");
 
@@ -318,7 +921,7 @@ bool Chip8::exec_orrg(Instruction i)
 {
     i.vx() |= i.vy();
 
-    Vf = 0;
+    V[0xF] = 0;
 
     logt("OR V%d | V%d = %x", i.x(), i.y(), i.vx());
 
@@ -330,7 +933,7 @@ bool Chip8::exec_andr(Instruction i)
 {
     i.vx() &= i.vy();
 
-    Vf = 0;
+    V[0xF] = 0;
 
     logt("AND V%d & V%d = %x", i.x(), i.y(), i.vx());
 
@@ -342,7 +945,7 @@ bool Chip8::exec_xorr(Instruction i)
 {
     i.vx() ^= i.vy();
 
-    Vf = 0;
+    V[0xF] = 0;
 
     logt("XOR V%d ^ V%d = %x", i.x(), i.y(), i.vx());
 
@@ -356,8 +959,8 @@ bool Chip8::exec_addc(Instruction i)
 
     i.vx() += i.vy();
 
-    Vf = carry;
-    logt("ADDC V%d + V%d = %x, V[f]: %x", i.x(), i.y(), i.vx(), Vf);
+    V[0xF] = carry;
+    logt("ADDC V%d + V%d = %x, V[f]: %x", i.x(), i.y(), i.vx(), V[0xF]);
 
     return true;
 }
@@ -368,25 +971,26 @@ bool Chip8::exec_subr(Instruction i)
     uint8_t carry = i.vx() >= i.vy();
 
     i.vx() -= i.vy();
-    Vf = carry;
-    logt("SUB V%d - V%d = %x, V[f]: %x", i.x(), i.y(), i.vx(), Vf);
+    V[0xF] = carry;
+    logt("SUB V%d - V%d = %x, V[f]: %x", i.x(), i.y(), i.vx(), V[0xF]);
 
     return true;
 }
 
 // 8xy6     Shift Vx right by 1, set VF to least significant bit prior to shift (SHR Vx)
-bool Chip8::exec_shrr(Instruction i)
+template <typename Q>
+bool Chip8::exec_shrr(Instruction i, Q const& q)
 {
     uint8_t v = i.vx();
-    if (!quirks.shiftVxOnly)
+    if (!q.shiftVxOnly)
         v = i.vy();
 
     uint8_t carry = v & 0x01;
 
     i.vx() = v >> 1;
 
-    Vf = carry;
-    logt("SHR V%d = %x, V[f]: %x", i.x(), i.vx(), Vf);
+    V[0xF] = carry;
+    logt("SHR V%d = %x, V[f]: %x", i.x(), i.vx(), V[0xF]);
 
     return true;
 }
@@ -397,24 +1001,25 @@ bool Chip8::exec_subn(Instruction i)
     uint8_t carry = i.vy() >= i.vx();
 
     i.vx() = i.vy() - i.vx();
-    Vf = carry;
-    logt("SUBN V%d - V%d = %x, V[f]: %x", i.x(), i.y(), i.vx(), Vf);
+    V[0xF] = carry;
+    logt("SUBN V%d - V%d = %x, V[f]: %x", i.x(), i.y(), i.vx(), V[0xF]);
 
     return true;
 }
 
 // 8xyE     Shift Vx left by 1, set VF to most significant bit prior to shift (SHL Vx)
-bool Chip8::exec_shlr(Instruction i)
+template <typename Q>
+bool Chip8::exec_shlr(Instruction i, Q const& q)
 {
     uint8_t v = i.vx();
-    if (!quirks.shiftVxOnly)
+    if (!q.shiftVxOnly)
         v = i.vy();
 
     uint8_t carry = (v >> 7) & 0x01;
 
     i.vx() = v << 1;
-    Vf = carry;
-    logt("SHL V%d = %x, V[f]: %x", i.x(), i.vx(), Vf);
+    V[0xF] = carry;
+    logt("SHL V%d = %x, V[f]: %x", i.x(), i.vx(), V[0xF]);
 
     return true;
 }
@@ -456,11 +1061,9 @@ bool Chip8::exec_jmpv(Instruction i)
 // Cxkk     Set Vx = random byte AND kk (RND Vx, kk)
 bool Chip8::exec_rand(Instruction i)
 {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 255);
-
-    i.vx() = dis(gen) & i.kk();
+    // Linear congruential step, the high byte is the best distributed
+    rng = rng * 1664525 + 1013904223;
+    i.vx() = (rng >> 24) & i.kk();
 
     logt("RND V%d: %x", i.x(), i.vx());
 
@@ -470,7 +1073,7 @@ bool Chip8::exec_rand(Instruction i)
 // Dxyn     Draw sprite at (Vx, Vy) with height n (DRW Vx, Vy, n)
 bool Chip8::exec_draw(Instruction i)
 {
-    Vf = 0;
+    V[0xF] = 0;
 
     size_t screenWidth = hiResMode ? 128 : 64;
     size_t screenHeight = hiResMode ? 64 : 32;
@@ -478,6 +1081,8 @@ bool Chip8::exec_draw(Instruction i)
     uint8_t x0 = i.vx() % screenWidth;
     uint8_t y0 = i.vy() % screenHeight;
 
+    toggleScreenHash(x0, std::min<size_t>(8, screenWidth - x0));
+
     for (int col = 0; col < 8; col++) {
         for (int row = 0; row < i.n(); row++) {
             auto x = (col + x0);
@@ -495,6 +1100,8 @@ bool Chip8::exec_draw(Instruction i)
         }
     }
 
+    toggleScreenHash(x0, std::min<size_t>(8, screenWidth - x0));
+
     logt("DRW V%d[%d], V%d[%d], %x", i.x(), i.vx(), i.y(), i.vy(), i.n());
     waitForVBlank = true;
     return true;
@@ -503,7 +1110,7 @@ bool Chip8::exec_draw(Instruction i)
 // Ex9E     Skip next instruction if key with the value of Vx is pressed (SKP Vx)
 bool Chip8::exec_skip(Instruction i)
 {
-    if (K[i.vx()]) {
+    if (keyDown(i.vx())) {
         step();
         logt("SKP +PC: %x, Key: %d", PC, i.vx());
     }
@@ -517,7 +1124,7 @@ bool Chip8::exec_skip(Instruction i)
 // ExA1     Skip next instruction if key with the value of Vx is not pressed (SKNP Vx)
 bool Chip8::exec_sknp(Instruction i)
 {
-    if (!K[i.vx()]) {
+    if (!keyDown(i.vx())) {
         step();
         logt("SKNP +PC: %x, Key: %d", PC, i.vx());
     }
@@ -591,10 +1198,15 @@ bool Chip8::exec_ldsp(Instruction i)
 // Fx33     Store BCD representation of Vx in memory locations I, I+1, and I+2 (LBCD Vx)
 bool Chip8::exec_lbcd(Instruction i)
 {
+    invalidateFusion(I, 3);
+    toggleMemoryHash(I, 3);
+
     memory[I] = i.vx() / 100;
     memory[I + 1] = (i.vx() / 10) % 10;
     memory[I + 2] = i.vx() % 10;
 
+    toggleMemoryHash(I, 3);
+
     logt("LBCD %d @ %x", i.vx(), I);
 
     return true;
@@ -605,9 +1217,14 @@ bool Chip8::exec_strg(Instruction i)
 {
     uint8_t x = i.x();
 
+    invalidateFusion(I, x + 1);
+    toggleMemoryHash(I, x + 1);
+
     for (uint8_t j = 0; j <= x; ++j)
         memory[I + j] = V[j];
 
+    toggleMemoryHash(I, x + 1);
+
     I += x + 1;
 
     logt("LDMR V0-V%d @ %x", x, I);
@@ -653,21 +1270,24 @@ bool Chip8::exec_lors(Instruction i)
 }
 
 // 00FD     Scroll down n pixels (SCRD n)
-bool Chip8::exec_scrd(Instruction i)
+template <typename Q>
+bool Chip8::exec_scrd(Instruction i, Q const& q)
 {
     size_t maxCols = hiRes() ? 128 : 64;
     size_t maxRows = hiRes() ? 64 : 32;
     uint8_t n = i.n();
 
-    if (!hiRes() && quirks.legacySchipScroll)
+    if (!hiRes() && q.legacySchipScroll)
         n /= 2;
 
+    toggleScreenHash(0, maxCols);
     for (size_t r = maxRows - 1; r >= n; --r)
         for (size_t c = 0; c < maxCols; ++c)
             FB[c][r] = FB[c][r - n];
     for (size_t r = 0; r < n; ++r)
         for (size_t c = 0; c < maxCols; ++c)
             FB[c][r] = 0;
+    toggleScreenHash(0, maxCols);
 
     logt("SCRD %d", n);
 
@@ -675,23 +1295,26 @@ bool Chip8::exec_scrd(Instruction i)
 }
 
 // 00FC     Scroll left 4 pixels (SCRL)
-bool Chip8::exec_scrl(Instruction i)
+template <typename Q>
+bool Chip8::exec_scrl(Instruction i, Q const& q)
 {
     (void)i;
     uint8_t n = 4;
 
-    if (!hiRes() && quirks.legacySchipScroll)
+    if (!hiRes() && q.legacySchipScroll)
         n /= 2;
 
     size_t maxCols = hiRes() ? 128 : 64;
     size_t maxRows = hiRes() ? 64 : 32;
 
+    toggleScreenHash(0, maxCols);
     for (size_t c = 0; c < maxCols - n; c++)
         for (size_t r = 0; r < maxRows; r++)
             FB[c][r] = FB[c + n][r];
     for (size_t c = maxCols - n; c < maxCols; c++)
         for (size_t r = 0; r < maxRows; r++)
             FB[c][r] = 0;
+    toggleScreenHash(0, maxCols);
 
     logt("SCRL %d", n);
 
@@ -699,23 +1322,26 @@ bool Chip8::exec_scrl(Instruction i)
 }
 
 // 00FB     Scroll right 4 pixels (SCRR)
-bool Chip8::exec_scrr(Instruction i)
+template <typename Q>
+bool Chip8::exec_scrr(Instruction i, Q const& q)
 {
     (void)i;
     uint8_t n = 4;
 
-    if (!hiRes() && quirks.legacySchipScroll)
+    if (!hiRes() && q.legacySchipScroll)
         n /= 2;
 
     size_t maxCols = hiRes() ? 128 : 64;
     size_t maxRows = hiRes() ? 64 : 32;
 
+    toggleScreenHash(0, maxCols);
     for (size_t c = maxCols - n; c > 0; c--)
         for (size_t r = 0; r < maxRows; r++)
             FB[c + n - 1][r] = FB[c - 1][r];
     for (size_t c = 0; c < n; c++)
         for (size_t r = 0; r < maxRows; r++)
             FB[c][r] = 0;
+    toggleScreenHash(0, maxCols);
 
     logt("SCRL %d", n);
 
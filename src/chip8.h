@@ -2,11 +2,16 @@
 
 #pragma once
 
+#include "journal.h"
+
+#include <algorithm>
 #include <array>
 #include <bitset>
 #include <cstdint>
-#include <map>
+#include <optional>
 #include <raylib.h>
+#include <span>
+#include <type_traits>
 #include <vector>
 
 namespace chipate {
@@ -26,8 +31,31 @@ struct Quirks {
     bool spriteWrap = false;
     // Legacy SCHIP scroll n/2
     bool legacySchipScroll = false;
+
+    bool operator==(Quirks const&) const = default;
 };
 
+// Presets with a dedicated interpreter instantiation, any other combination runs on the
+// generic one that checks the flags at runtime
+inline constexpr Quirks CHIP8_QUIRKS{};
+
+inline constexpr Quirks SCHIP_1_0_QUIRKS{.shiftVxOnly = true,
+                                         .loadStoreIAdd = true,
+                                         .jumpWithVx = true,
+                                         .logicNoVF = true,
+                                         .spriteWrap = true,
+                                         .legacySchipScroll = true};
+
+inline constexpr Quirks SCHIP_MODERN_QUIRKS{.shiftVxOnly = true,
+                                            .loadStoreIAdd = true,
+                                            .jumpWithVx = true,
+                                            .logicNoVF = true,
+                                            .spriteWrap = true,
+                                            .legacySchipScroll = false};
+
+// Programs load at 0x200, anything longer does not fit in memory
+inline constexpr size_t MAX_ROM_SIZE = 0x1000 - 0x200;
+
 struct Instruction {
     Instruction(uint16_t d, Registers& regs)
         : data(d)
@@ -67,16 +95,106 @@ struct Instruction {
     }
 };
 
-class Chip8 {
+// Why run() returned control to the caller
+enum class StopReason
+{
+    Budget,     // maxCycles instructions executed
+    VBlank,     // DRW executed, waiting for tock()
+    KeyWait,    // Fx0A executed, waiting for setKey()
+    Sound,      // Sound timer started
+    Breakpoint, // PC reached a breakpoint
+    Fault       // Invalid instruction, stack error or PC out of memory
+};
+
+// Common instruction sequences run() executes as a single operation
+enum class Fusion : uint8_t
+{
+    None,
+    LoadIDraw,     // Annn, Dxyn
+    SkipJump,      // 3xkk/4xkk, 1nnn
+    AddSkip,       // 7xkk, 3xkk/4xkk on the same Vx
+    AddSkipJump,   // 7xkk, 3xkk/4xkk, 1nnn loop counter
+    TimerSkip,     // Fx07, 3xkk/4xkk on the same Vx
+    TimerSkipJump, // Fx07, 3xkk/4xkk, 1nnn delay loop
+    Count
+};
+
+char const* fusionName(Fusion fusion);
+
+using FusionStats = std::array<uint64_t, static_cast<size_t>(Fusion::Count)>;
+
+struct RunResult {
+    size_t cycles;
+    StopReason reason;
+};
+
+// Everything a program can observe or change. Trivially copyable, so a snapshot, fork or reset is
+// a single copy and states pack tightly in arrays. The registers come first, in one cache line.
+struct alignas(64) MachineState {
+    Registers V; // V0 to VF
+    uint16_t PC; // Program counter
+    uint16_t I;  // Index register
+    uint8_t SP;  // Stack pointer
+
+    // Timers
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+
+    bool waitForKey;
+    uint8_t waitForKeyReg;
+
+    bool hiResMode;
+    bool waitForVBlank;
+
+    uint16_t keys; // Bit k set while key k is down
+    uint32_t rng;  // Generator RND draws from, so that runs from a snapshot repeat
+
+    std::array<uint16_t, 16> S; // Stack
+    std::array<uint8_t, 4096> memory;
+    std::array<std::bitset<64>, 128> FB; // LowRes Frame buffer
+};
+
+static_assert(std::is_trivially_copyable_v<MachineState>);
+
+// Hash of the registers, memory and frame buffer, what Chip8::stateHash() keeps up to date
+uint64_t hashState(MachineState const& state);
+
+// The state is a base so that the interpreter names registers and memory directly
+class Chip8 : private MachineState {
 public:
     Chip8();
-    void init(std::vector<uint8_t> const& program, Quirks const& quirks = {});
+    // RND starts from seed, so machines started alike hash alike frame by frame. Programs longer
+    // than MAX_ROM_SIZE are cut short.
+    void init(std::span<uint8_t const> program, Quirks const& quirks = {}, uint32_t seed = 0);
+    // Writes into memory of a running machine and drops what was decoded from it, nothing is reset
+    void patch(uint16_t address, std::span<uint8_t const> bytes);
     void tick();
     void tock();
+    // Execute up to maxCycles instructions, stopping early on the first event
+    RunResult run(size_t maxCycles);
+    // Spend one frame worth of cycles, only waits end it early, then tock(). Returns cycles run.
+    size_t frame(size_t maxCycles);
     void setKey(int key, bool pressed);
+
+    // The whole machine as a program sees it, copy it to snapshot or fork a run
+    MachineState const& state() const
+    {
+        return *this;
+    }
+    // Continues from a snapshot of this or another machine, quirks and settings stay
+    void restore(MachineState const& state);
+    // Reseeds RND, init() takes a fixed seed so that runs and their hashes repeat
+    void seedRandom(uint32_t seed)
+    {
+        rng = seed;
+    }
+    // Same as hashState(state()). Memory and the frame buffer are hashed as they are written, so
+    // only the registers are gone over.
+    uint64_t stateHash() const;
     void setQuirks(Quirks const& quirks)
     {
         this->quirks = quirks;
+        selectInterpreter();
     }
 
     bool hiRes() const
@@ -84,8 +202,75 @@ public:
         return hiResMode;
     }
 
+    bool waitingForKey() const
+    {
+        return waitForKey;
+    }
+
+    void setBreakpoint(uint16_t address, bool enabled = true)
+    {
+        breakpoints[address & 0x0FFF] = enabled;
+    }
+    void clearBreakpoints()
+    {
+        breakpoints.reset();
+    }
+
+    void setFusion(bool enabled)
+    {
+        fusionEnabled = enabled;
+    }
+    // Count how often each fusion fires, see fusionStats()
+    void setFusionProfiling(bool enabled)
+    {
+        fusionProfiling = enabled;
+    }
+    FusionStats const& fusionStats() const
+    {
+        return fusionCounts;
+    }
+    void resetFusionStats()
+    {
+        fusionCounts.fill(0);
+    }
+
+    // Count executed instructions by address, see pcCounts(). Fusions are off meanwhile, so
+    // that every instruction is counted at its own address.
+    void setPcProfiling(bool enabled)
+    {
+        pcHits.assign(enabled ? memory.size() : 0, 0);
+    }
+    std::span<uint64_t const> pcCounts() const
+    {
+        return pcHits;
+    }
+    void resetPcCounts()
+    {
+        std::fill(pcHits.begin(), pcHits.end(), 0);
+    }
+
+    // Journal up to bytes of undo records, 0 turns it off. Each instruction records only the values
+    // it overwrites, so stepBack() undoes one at a time. Fusions are off meanwhile. Timers counting
+    // down and key presses are not instructions, stepping back leaves them as they are.
+    void setJournal(size_t bytes)
+    {
+        undoJournal.reserve(bytes);
+    }
+    bool journaling() const
+    {
+        return undoJournal.capacity();
+    }
+    size_t journalEntries() const
+    {
+        return undoJournal.size();
+    }
+    // Undoes the last journaled instruction, false once the journal is empty
+    bool stepBack();
+
     // Grant tests access to internals without adding public accessors
     friend class Chip8TestAccess;
+    // Ahead-of-time translated code works on the machine state directly
+    friend class AotAccess;
 
     std::array<std::bitset<64>, 128> fb() const
     {
@@ -93,31 +278,60 @@ public:
     }
 
 private:
-    std::array<uint8_t, 4096> memory;
-    std::array<std::bitset<64>, 128> FB; // LowRes Frame buffer
-    std::array<uint16_t, 16> S;          // Stack
-    std::array<uint8_t, 16> V;           // V0 to VF
-    uint8_t& Vf = V[0x0F];
+    Quirks quirks;
 
-    uint16_t PC; // Program counter
-    uint16_t I;  // Index register
-    uint8_t SP;  // Stack pointer
+    std::bitset<4096> breakpoints;
+    // Where the last run() stopped on a breakpoint, the next one executes past it once
+    std::optional<uint16_t> resumingFrom;
 
-    std::map<uint8_t, bool> K;
+    bool stopAtBreakpoint();
 
-    Quirks quirks;
+    // Predecoded fusions by address, only valid where fusionDecoded is set
+    std::array<Fusion, 4096> fusionCache;
+    std::bitset<4096> fusionDecoded;
+    bool fusionEnabled = true;
+    bool fusionProfiling = false;
+    FusionStats fusionCounts{};
 
-    // Timers
-    uint8_t delayTimer;
-    uint8_t soundTimer;
+    std::vector<uint64_t> pcHits; // Empty unless profiling
 
-    bool waitForKey;
-    uint8_t waitForKeyReg;
+    // Rolling hashes, the XOR of one term per memory byte and one per frame buffer column. Writes
+    // toggle the terms of the old values out before and of the new ones in after.
+    uint64_t memoryHash = 0;
+    uint64_t screenHash = 0;
 
-    bool hiResMode;
-    bool waitForVBlank;
+    void rehash();
+    void toggleMemoryHash(size_t address, size_t length);
+    void toggleScreenHash(size_t column, size_t count);
+
+    Journal undoJournal;
+    std::vector<uint8_t> undoEntry; // Being recorded or undone
+
+    void recordUndo(uint16_t instruction);
+
+    bool keyDown(uint8_t key) const
+    {
+        return key < 16 && (keys >> key & 1);
+    }
+
+    Fusion fusionAt(uint16_t address);
+    size_t execFused(Fusion fusion);
+    void invalidateFusion(uint16_t address, size_t length);
+
+    // Interpreter instantiation for the current quirks, picked by selectInterpreter()
+    bool (Chip8::*interpreter)(uint16_t);
+
+    bool exec(uint16_t instruction)
+    {
+        return (this->*interpreter)(instruction);
+    }
+
+    void selectInterpreter();
 
-    bool exec(uint16_t instruction);
+    template <typename Q>
+    bool execAs(uint16_t instruction);
+    template <typename Q>
+    bool exec(uint16_t instruction, Q const& q);
 
     bool exec_clrs(Instruction i);
     bool exec_retn(Instruction i);
@@ -134,9 +348,11 @@ private:
     bool exec_xorr(Instruction i);
     bool exec_addc(Instruction i);
     bool exec_subr(Instruction i);
-    bool exec_shrr(Instruction i);
+    template <typename Q>
+    bool exec_shrr(Instruction i, Q const& q);
     bool exec_subn(Instruction i);
-    bool exec_shlr(Instruction i);
+    template <typename Q>
+    bool exec_shlr(Instruction i, Q const& q);
     bool exec_sknr(Instruction i);
     bool exec_ldix(Instruction i);
     bool exec_jmpv(Instruction i);
@@ -157,9 +373,12 @@ private:
     // Super Chip-48
     bool exec_hirs(Instruction i);
     bool exec_lors(Instruction i);
-    bool exec_scrd(Instruction i);
-    bool exec_scrl(Instruction i);
-    bool exec_scrr(Instruction i);
+    template <typename Q>
+    bool exec_scrd(Instruction i, Q const& q);
+    template <typename Q>
+    bool exec_scrl(Instruction i, Q const& q);
+    template <typename Q>
+    bool exec_scrr(Instruction i, Q const& q);
 
     bool push(uint16_t data);
     bool pop(uint16_t& data);
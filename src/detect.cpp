@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "detect.h"
+
+#include "hash.h"
+#include "log.h"
+#include "opcode.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+
+namespace chipate {
+
+namespace {
+
+// Bumped whenever scoring changes, so that older detections are not used
+int const DETECT_VERSION = 2;
+
+size_t const COMBINATIONS = 4;   // Of the quirks the interpreter honours, see combination()
+size_t const SCREEN_SAMPLE = 60; // Frames between looks at the screen
+size_t const EARLY_HALT = 60;    // Frames, halting before means the ROM gave up
+
+size_t const FAULT_PENALTY = 1000;
+size_t const OUT_OF_BOUNDS_PENALTY = 10;
+size_t const OUT_OF_BOUNDS_COUNTED = 100;
+size_t const SCREEN_PENALTY = 20;
+size_t const HALT_PENALTY = 50;
+
+uint8_t quirkBits(Quirks const& quirks)
+{
+    return quirks.shiftVxOnly | quirks.loadStoreIAdd << 1 | quirks.jumpWithVx << 2 |
+           quirks.logicNoVF << 3 | quirks.spriteWrap << 4 | quirks.legacySchipScroll << 5;
+}
+
+Quirks quirksFromBits(uint8_t bits)
+{
+    return {.shiftVxOnly = bool(bits & 1),
+            .loadStoreIAdd = bool(bits >> 1 & 1),
+            .jumpWithVx = bool(bits >> 2 & 1),
+            .logicNoVF = bool(bits >> 3 & 1),
+            .spriteWrap = bool(bits >> 4 & 1),
+            .legacySchipScroll = bool(bits >> 5 & 1)};
+}
+
+// Run index of the quirks. Only shiftVxOnly and legacySchipScroll change what the interpreter
+// does, running the others as well would only repeat runs.
+size_t combination(Quirks const& quirks)
+{
+    return quirks.shiftVxOnly | quirks.legacySchipScroll << 1;
+}
+
+// quirks with the honoured ones set as in a combination
+Quirks withCombination(Quirks quirks, size_t bits)
+{
+    quirks.shiftVxOnly = bits & 1;
+    quirks.legacySchipScroll = bits >> 1 & 1;
+    return quirks;
+}
+
+// Notes what the instruction at PC is about to do
+void inspect(MachineState const& state, size_t frame, QuirkRun& run)
+{
+    size_t const MEMORY = state.memory.size();
+    uint16_t data = state.memory[state.PC] << 8 | state.memory[state.PC + 1];
+    uint8_t x = data >> 8 & 0xF;
+
+    // Running the font or whatever else lies below the program
+    if (state.PC < 0x200)
+        run.outOfBounds++;
+
+    OpcodeMatch const* match = decode(data);
+    switch (match ? match->opcode : Opcode{}) {
+    case JP:
+        if ((data & 0x0FFF) == state.PC && !run.haltedFrame)
+            run.haltedFrame = frame;
+        break;
+    case JPO:
+        // The interpreter always adds V0, jumpWithVx is not implemented
+        if (size_t(state.V[0]) + (data & 0x0FFF) > MEMORY - 2)
+            run.outOfBounds++;
+        break;
+    case DRW:
+        if (size_t(state.I) + (data & 0xF) > MEMORY)
+            run.outOfBounds++;
+        break;
+    case LBCD:
+        if (state.I < 0x200 || size_t(state.I) + 3 > MEMORY)
+            run.outOfBounds++;
+        break;
+    case LDMR:
+        if (state.I < 0x200 || size_t(state.I) + x + 1 > MEMORY)
+            run.outOfBounds++;
+        break;
+    case LDRM:
+        if (size_t(state.I) + x + 1 > MEMORY)
+            run.outOfBounds++;
+        break;
+    case HIRS:
+    case LORS:
+    case SCRD:
+    case SCRL:
+    case SCRR:
+        run.superChip = true;
+        break;
+    default:
+        break;
+    }
+}
+
+// A blank screen after the first second, or one mostly lit, is unlikely to be what was meant
+bool badScreen(Chip8 const& chip8)
+{
+    size_t width = chip8.hiRes() ? 128 : 64;
+    size_t height = chip8.hiRes() ? 64 : 32;
+
+    std::bitset<64> visible(height == 64 ? ~0ull : (1ull << height) - 1);
+
+    size_t lit = 0;
+    for (size_t column = 0; column < width; ++column)
+        lit += (chip8.state().FB[column] & visible).count();
+    return !lit || lit * 2 > width * height;
+}
+
+QuirkRun score(std::span<uint8_t const> rom, Quirks const& quirks, DetectOptions const& options)
+{
+    QuirkRun run{.quirks = quirks};
+    auto chip8 = std::make_unique<Chip8>();
+    chip8->init(rom, quirks);
+    chip8->seedRandom(1);
+
+    for (size_t frame = 0; frame < options.frames && !run.fault; ++frame) {
+        // Every key in turn, held for four frames and released for four
+        for (int key = 0; key < 16; ++key)
+            chip8->setKey(key, key == static_cast<int>(frame / 8 % 16) && frame % 8 < 4);
+
+        size_t cycles = 0;
+        while (cycles < options.tickRate) {
+            MachineState const& state = chip8->state();
+            if (!state.waitForKey && !state.waitForVBlank && state.PC < state.memory.size() - 1)
+                inspect(state, frame, run);
+
+            auto result = chip8->run(1);
+            cycles += result.cycles;
+            if (result.reason == StopReason::Fault) {
+                run.fault = true;
+                break;
+            }
+            if (result.reason == StopReason::VBlank || result.reason == StopReason::KeyWait ||
+                !result.cycles)
+                break;
+        }
+        chip8->tock();
+
+        if (frame % SCREEN_SAMPLE == SCREEN_SAMPLE - 1 && badScreen(*chip8))
+            run.badScreens++;
+    }
+
+    run.penalty = run.fault * FAULT_PENALTY +
+                  std::min(run.outOfBounds, OUT_OF_BOUNDS_COUNTED) * OUT_OF_BOUNDS_PENALTY +
+                  run.badScreens * SCREEN_PENALTY +
+                  (run.haltedFrame && *run.haltedFrame < EARLY_HALT) * HALT_PENALTY;
+    return run;
+}
+
+// Ties go to CHIP-8 unless the ROM runs SCHIP instructions
+size_t pickPreset(std::vector<QuirkRun> const& runs)
+{
+    bool superChip = std::any_of(runs.begin(), runs.end(),
+                                 [](QuirkRun const& run) { return run.superChip; });
+    std::array<size_t, 3> order = superChip ? std::array<size_t, 3>{1, 2, 0}
+                                            : std::array<size_t, 3>{0, 1, 2};
+
+    size_t best = order[0];
+    for (size_t preset: order)
+        if (runs[combination(QUIRK_PRESETS[preset].quirks)].penalty <
+            runs[combination(QUIRK_PRESETS[best].quirks)].penalty)
+            best = preset;
+    return best;
+}
+
+} // namespace
+
+QuirkDetection detectQuirks(std::span<uint8_t const> rom, DetectOptions const& options)
+{
+    QuirkDetection detection;
+    detection.runs.resize(COMBINATIONS);
+
+    std::atomic<size_t> next = 0;
+    auto worker = [&] {
+        for (size_t bits = next++; bits < COMBINATIONS; bits = next++)
+            detection.runs[bits] = score(rom, withCombination(CHIP8_QUIRKS, bits), options);
+    };
+    {
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::jthread> pool;
+        try {
+            for (size_t t = 1; t < std::min(threads, COMBINATIONS); ++t)
+                pool.emplace_back(worker);
+        }
+        catch (std::system_error const&) {
+            // No threads, as in a browser without them, the calling thread does the rest
+        }
+        worker();
+    }
+
+    // The preset's quirks, with the honoured ones of a healthier run if there is one
+    detection.preset = pickPreset(detection.runs);
+    Quirks const& preset = QUIRK_PRESETS[detection.preset].quirks;
+    detection.quirks = preset;
+    size_t penalty = detection.runs[combination(preset)].penalty;
+    for (size_t bits = 0; bits < COMBINATIONS; ++bits) {
+        if (detection.runs[bits].penalty < penalty) {
+            penalty = detection.runs[bits].penalty;
+            detection.quirks = withCombination(preset, bits);
+        }
+    }
+
+    logi("Detected %s quirks, penalty %zu", QUIRK_PRESETS[detection.preset].name,
+         detection.runs[combination(preset)].penalty);
+    return detection;
+}
+
+QuirkCache::QuirkCache(std::filesystem::path const& directory)
+{
+    if (directory.empty())
+        return;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        logw("Quirk cache %s unusable: %s", directory.c_str(), error.message().c_str());
+        return;
+    }
+
+    // Records of ROM hash, preset and quirk bits, a record cut short by a crash ends the file
+    auto path = directory / ("quirks-v" + std::to_string(DETECT_VERSION) + ".bin");
+    if (FILE* file = fopen(path.c_str(), "rb")) {
+        uint8_t record[10];
+        while (fread(record, 1, sizeof(record), file) == sizeof(record)) {
+            uint64_t hash = 0;
+            for (int i = 0; i < 8; ++i)
+                hash |= static_cast<uint64_t>(record[i]) << (8 * i);
+            if (record[8] < QUIRK_PRESETS.size())
+                detections[hash] = {.preset = record[8], .quirks = quirksFromBits(record[9])};
+        }
+        fclose(file);
+    }
+
+    records = fopen(path.c_str(), "ab");
+    if (!records)
+        logw("Quirk cache %s is read only", path.c_str());
+}
+
+QuirkCache::~QuirkCache()
+{
+    if (records)
+        fclose(records);
+}
+
+QuirkDetection QuirkCache::get(std::span<uint8_t const> rom)
+{
+    uint64_t hash = fnv1a(rom);
+    {
+        std::lock_guard lock(mutex);
+        if (auto it = detections.find(hash); it != detections.end()) {
+            hitCount++;
+            return it->second;
+        }
+        missCount++;
+    }
+
+    // Not under the lock, detection runs on threads of its own
+    auto detection = detectQuirks(rom);
+
+    std::lock_guard lock(mutex);
+    detections[hash] = {.preset = detection.preset, .quirks = detection.quirks};
+    if (records) {
+        uint8_t record[10];
+        for (int i = 0; i < 8; ++i)
+            record[i] = hash >> (8 * i);
+        record[8] = detection.preset;
+        record[9] = quirkBits(detection.quirks);
+        if (fwrite(record, 1, sizeof(record), records) != sizeof(record) || fflush(records))
+            logw("Failed to write to the quirk cache");
+    }
+    return detection;
+}
+
+QuirkCache& quirkCache()
+{
+    static QuirkCache cache([] {
+        if (char const* directory = getenv("CHIPATE_QUIRK_CACHE"))
+            return std::filesystem::path(directory);
+        if (char const* cache = getenv("XDG_CACHE_HOME"))
+            return std::filesystem::path(cache) / "chipate";
+        if (char const* home = getenv("HOME"))
+            return std::filesystem::path(home) / ".cache" / "chipate";
+        return std::filesystem::path();
+    }());
+    return cache;
+}
+
+} // namespace chipate
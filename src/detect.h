@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "chip8.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace chipate {
+
+struct QuirkPreset {
+    char const* name;
+    Quirks quirks;
+};
+
+// In the order of the GUI selector
+inline constexpr std::array<QuirkPreset, 3> QUIRK_PRESETS{{{"chip8", CHIP8_QUIRKS},
+                                                           {"schip-1.0", SCHIP_1_0_QUIRKS},
+                                                           {"schip-modern", SCHIP_MODERN_QUIRKS}}};
+
+// How a ROM behaved under one combination of quirks, lower penalties look healthier
+struct QuirkRun {
+    Quirks quirks;
+    bool fault = false;                // Invalid instruction, stack error or PC out of memory
+    size_t outOfBounds = 0;            // Accesses past memory, stores into the interpreter area
+    size_t badScreens = 0;             // Samples with a blank or mostly lit screen
+    std::optional<size_t> haltedFrame; // First frame it jumped to itself
+    bool superChip = false;            // Ran SCHIP instructions
+    size_t penalty = 0;
+};
+
+struct QuirkDetection {
+    size_t preset = 0;         // Into QUIRK_PRESETS
+    Quirks quirks;             // Best of all combinations, the preset may be one of equals
+    std::vector<QuirkRun> runs; // Every combination that runs differently, empty when cached
+};
+
+struct DetectOptions {
+    size_t frames = 300; // Five seconds
+    size_t tickRate = 15;
+};
+
+// Runs the ROM under every combination of the quirks the interpreter honours in parallel, pressing
+// every key in turn, and picks the preset whose run looks the healthiest
+QuirkDetection detectQuirks(std::span<uint8_t const> rom, DetectOptions const& options = {});
+
+// Detections by ROM hash, kept on disk when a directory is given
+class QuirkCache {
+public:
+    explicit QuirkCache(std::filesystem::path const& directory = {});
+    ~QuirkCache();
+    QuirkCache(QuirkCache const&) = delete;
+    QuirkCache& operator=(QuirkCache const&) = delete;
+
+    // detectQuirks() of rom, from the cache when it ran before
+    QuirkDetection get(std::span<uint8_t const> rom);
+
+    size_t hits() const
+    {
+        return hitCount;
+    }
+    size_t misses() const
+    {
+        return missCount;
+    }
+
+private:
+    std::unordered_map<uint64_t, QuirkDetection> detections;
+    FILE* records = nullptr; // Appended to on every miss
+    size_t hitCount = 0;
+    size_t missCount = 0;
+    std::mutex mutex;
+};
+
+// On disk in $CHIPATE_QUIRK_CACHE, or else under $XDG_CACHE_HOME or ~/.cache
+QuirkCache& quirkCache();
+
+} // namespace chipate
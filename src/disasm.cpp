@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "disasm.h"
+
+#include "opcode.h"
+
+#include <cstdio>
+#include <string_view>
+
+namespace chipate {
+
+namespace {
+
+// Longest line is "drw vf vf 0xf" or "db 0xff 0xff"
+size_t const MAX_MNEMONIC = 16;
+
+size_t formatDb(char* out, uint16_t data)
+{
+    return snprintf(out, MAX_MNEMONIC, "db 0x%02x 0x%02x", data >> 8, data & 0xFF);
+}
+
+// Expands the table format of the decoded instruction. Falls back to db when the word has bits
+// set that neither the opcode nor the operands cover, assemble() would not give them back.
+size_t format(char* out, uint16_t data)
+{
+    auto match = decode(data);
+    if (!match)
+        return formatDb(out, data);
+
+    uint16_t covered = match->mask;
+    size_t length = 0;
+
+    for (char const* it = match->format; *it; ++it) {
+        if (*it != '{') {
+            out[length++] = *it;
+            continue;
+        }
+
+        std::string_view field(it + 1);
+        field = field.substr(0, field.find('}'));
+        it += field.size() + 1;
+
+        static char const hex[] = "0123456789abcdef";
+        if (field == "x") {
+            out[length++] = hex[(data >> 8) & 0xF];
+            covered |= 0x0F00;
+        }
+        else if (field == "y") {
+            out[length++] = hex[(data >> 4) & 0xF];
+            covered |= 0x00F0;
+        }
+        else if (field == "n") {
+            length += snprintf(out + length, MAX_MNEMONIC - length, "0x%x", data & 0xF);
+            covered |= 0x000F;
+        }
+        else if (field == "kk") {
+            length += snprintf(out + length, MAX_MNEMONIC - length, "0x%02x", data & 0xFF);
+            covered |= 0x00FF;
+        }
+        else if (field == "nnn") {
+            length += snprintf(out + length, MAX_MNEMONIC - length, "0x%03x", data & 0xFFF);
+            covered |= 0x0FFF;
+        }
+    }
+
+    if (data & ~covered)
+        return formatDb(out, data);
+
+    return length;
+}
+
+} // namespace
+
+std::string disassemble(uint16_t data)
+{
+    char line[MAX_MNEMONIC];
+    return std::string(line, format(line, data));
+}
+
+std::string disassemble(std::span<uint8_t const> program, uint16_t origin)
+{
+    std::string listing;
+    listing.reserve(program.size() / 2 * 32);
+
+    for (size_t offset = 0; offset < program.size(); offset += 2) {
+        char line[64];
+        char mnemonic[MAX_MNEMONIC];
+        size_t address = origin + offset;
+        int length;
+
+        if (offset + 1 < program.size()) {
+            uint16_t data = program[offset] << 8 | program[offset + 1];
+            mnemonic[format(mnemonic, data)] = '\0';
+            length = snprintf(line, sizeof(line), "%-20s; %03zx: %04x\n", mnemonic, address, data);
+        }
+        else {
+            snprintf(mnemonic, sizeof(mnemonic), "db 0x%02x", program[offset]);
+            length = snprintf(line, sizeof(line), "%-20s; %03zx: %02x\n", mnemonic, address,
+                              program[offset]);
+        }
+
+        listing.append(line, length);
+    }
+
+    return listing;
+}
+
+} // namespace chipate
@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace chipate {
+
+// Single instruction in the syntax assemble() accepts, words that do not decode come out as db
+std::string disassemble(uint16_t data);
+
+// Listing of a program loaded at origin that assemble() turns back into the same bytes, with the
+// address and raw word of every line in a comment
+std::string disassemble(std::span<uint8_t const> program, uint16_t origin = 0x200);
+
+} // namespace chipate
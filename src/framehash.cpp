@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "framehash.h"
+
+#include "log.h"
+#include "rom.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace chipate {
+
+namespace {
+
+char const TAG[] = "C8FH";
+size_t const TAG_SIZE = sizeof(TAG) - 1;
+
+} // namespace
+
+bool writeFrameHashes(std::string const& path, std::span<uint64_t const> hashes)
+{
+    std::vector<uint8_t> data(TAG, TAG + TAG_SIZE);
+    data.reserve(TAG_SIZE + hashes.size() * 8);
+    for (uint64_t hash: hashes)
+        for (int byte = 0; byte < 8; ++byte)
+            data.push_back(hash >> (8 * byte));
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        loge("Failed to create %s", path.c_str());
+        return false;
+    }
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    if (!written)
+        loge("Failed to write %s", path.c_str());
+    return written;
+}
+
+std::optional<std::vector<uint64_t>> readFrameHashes(std::string const& path)
+{
+    auto data = readRom(path);
+    if (data.size() < TAG_SIZE || std::memcmp(data.data(), TAG, TAG_SIZE) ||
+        (data.size() - TAG_SIZE) % 8) {
+        loge("Not a frame hash file: %s", path.c_str());
+        return std::nullopt;
+    }
+
+    std::vector<uint64_t> hashes((data.size() - TAG_SIZE) / 8);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        for (int byte = 7; byte >= 0; --byte)
+            hashes[i] = hashes[i] << 8 | data[TAG_SIZE + i * 8 + byte];
+    return hashes;
+}
+
+std::optional<size_t> firstDivergence(std::span<uint64_t const> a, std::span<uint64_t const> b)
+{
+    auto [left, right] = std::mismatch(a.begin(), a.end(), b.begin(), b.end());
+    if (left == a.end() && right == b.end())
+        return std::nullopt;
+    return left - a.begin();
+}
+
+} // namespace chipate
@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace chipate {
+
+// One Chip8::stateHash() per frame of a run. Files hold a "C8FH" tag followed by the hashes, 8
+// bytes each, little endian.
+bool writeFrameHashes(std::string const& path, std::span<uint64_t const> hashes);
+// nullopt when the file is missing or not a frame hash file
+std::optional<std::vector<uint64_t>> readFrameHashes(std::string const& path);
+
+// First frame the runs disagree on, nullopt when they match. When one run is a prefix of the
+// other, they diverge on the first frame the shorter one lacks.
+std::optional<size_t> firstDivergence(std::span<uint64_t const> a, std::span<uint64_t const> b);
+
+} // namespace chipate
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace chipate {
+
+uint64_t const FNV_OFFSET = 0xcbf29ce484222325;
+
+// FNV-1a, stable across runs and platforms so it can key caches that outlive the process
+constexpr uint64_t fnv1a(std::span<uint8_t const> data, uint64_t hash = FNV_OFFSET)
+{
+    for (uint8_t byte: data) {
+        hash ^= byte;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+constexpr uint64_t fnv1a(std::string_view text, uint64_t hash = FNV_OFFSET)
+{
+    for (char c: text) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+// SplitMix64 finalizer, spreads every input bit over the whole word
+constexpr uint64_t mix64(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+    return value ^ (value >> 31);
+}
+
+} // namespace chipate
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace chipate {
+
+// Bounded ring of variable sized entries of at least two bytes. Pushing past the capacity drops
+// the oldest entries, popping returns the newest one. Besides the bytes themselves an entry costs
+// two for its length.
+class Journal {
+public:
+    explicit Journal(size_t capacity = 0)
+    {
+        reserve(capacity);
+    }
+
+    // Sets the capacity in bytes and drops all entries
+    void reserve(size_t capacity)
+    {
+        buffer.assign(capacity, 0);
+        lengths.assign(capacity / 2, 0);
+        clear();
+    }
+
+    void clear()
+    {
+        start = 0;
+        used = 0;
+        first = 0;
+        count = 0;
+    }
+
+    size_t capacity() const
+    {
+        return buffer.size();
+    }
+    size_t size() const
+    {
+        return count;
+    }
+    size_t bytes() const
+    {
+        return used;
+    }
+    bool empty() const
+    {
+        return !count;
+    }
+
+    // False if the entry can never fit, which leaves the journal empty as nothing before it can be
+    // undone past it either
+    bool push(std::span<uint8_t const> entry)
+    {
+        if (entry.size() < 2 || entry.size() > buffer.size() || entry.size() > UINT16_MAX) {
+            clear();
+            return false;
+        }
+
+        while (used + entry.size() > buffer.size() || count == lengths.size())
+            dropOldest();
+
+        size_t at = (start + used) % buffer.size();
+        size_t head = std::min(entry.size(), buffer.size() - at);
+        std::copy_n(entry.begin(), head, buffer.begin() + at);
+        std::copy(entry.begin() + head, entry.end(), buffer.begin());
+
+        lengths[(first + count) % lengths.size()] = static_cast<uint16_t>(entry.size());
+        count++;
+        used += entry.size();
+        return true;
+    }
+
+    // Moves the newest entry into entry, false when there is none
+    bool pop(std::vector<uint8_t>& entry)
+    {
+        if (!count)
+            return false;
+
+        size_t length = lengths[(first + count - 1) % lengths.size()];
+        size_t at = (start + used - length) % buffer.size();
+        size_t head = std::min(length, buffer.size() - at);
+        entry.assign(buffer.begin() + at, buffer.begin() + at + head);
+        entry.insert(entry.end(), buffer.begin(), buffer.begin() + (length - head));
+
+        count--;
+        used -= length;
+        return true;
+    }
+
+private:
+    std::vector<uint8_t> buffer;
+    std::vector<uint16_t> lengths; // Of the entries, in the same order
+    size_t start = 0;              // Of the oldest entry in buffer
+    size_t used = 0;
+    size_t first = 0; // Oldest entry in lengths
+    size_t count = 0;
+
+    void dropOldest()
+    {
+        start = (start + lengths[first]) % buffer.size();
+        used -= lengths[first];
+        first = (first + 1) % lengths.size();
+        count--;
+    }
+};
+
+} // namespace chipate
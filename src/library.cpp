@@ -0,0 +1,344 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "library.h"
+
+#include "hash.h"
+#include "log.h"
+#include "rom.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <system_error>
+
+namespace chipate {
+
+namespace {
+
+char const TAG[] = "C8LI";
+size_t const TAG_SIZE = sizeof(TAG) - 1;
+int const LIBRARY_INDEX_VERSION = 1;
+
+std::filesystem::path normalDirectory(std::filesystem::path const& directory)
+{
+    std::error_code error;
+    auto path = std::filesystem::absolute(directory, error).lexically_normal();
+    if (!path.has_filename())
+        path = path.parent_path();
+    return path;
+}
+
+// Little endian fields of the index file
+void put(std::vector<uint8_t>& data, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        data.push_back(value >> (8 * i));
+}
+
+void putString(std::vector<uint8_t>& data, std::string const& text)
+{
+    put(data, text.size(), 2);
+    data.insert(data.end(), text.begin(), text.end());
+}
+
+struct Reader {
+    std::vector<uint8_t> const& data;
+    size_t at = TAG_SIZE;
+    bool failed = false;
+
+    uint64_t get(int bytes)
+    {
+        if (data.size() - at < static_cast<size_t>(bytes)) {
+            failed = true;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value |= static_cast<uint64_t>(data[at++]) << (8 * i);
+        return value;
+    }
+
+    std::string getString()
+    {
+        size_t length = get(2);
+        if (failed || data.size() - at < length) {
+            failed = true;
+            return {};
+        }
+        std::string text(data.begin() + at, data.begin() + at + length);
+        at += length;
+        return text;
+    }
+};
+
+} // namespace
+
+RomScanner::RomScanner(std::filesystem::path index)
+    : indexPath(std::move(index))
+{
+    try {
+        worker = std::jthread([this](std::stop_token stop) { run(stop); });
+    }
+    catch (std::system_error const& error) {
+        logw("Scanning ROMs without a thread: %s", error.what());
+        load();
+    }
+}
+
+RomScanner::~RomScanner()
+{
+    worker.request_stop();
+}
+
+std::vector<std::filesystem::path> RomScanner::directories() const
+{
+    std::lock_guard lock(mutex);
+    return roots;
+}
+
+void RomScanner::scan(std::filesystem::path const& directory)
+{
+    auto root = normalDirectory(directory);
+    {
+        std::lock_guard lock(mutex);
+        if (std::find(roots.begin(), roots.end(), root) == roots.end())
+            roots.push_back(root);
+        if (worker.joinable()) {
+            queue.push_back(root);
+            wake.notify_all();
+            return;
+        }
+    }
+
+    if (scanDirectory(root, {}))
+        save();
+}
+
+void RomScanner::rescan()
+{
+    {
+        std::lock_guard lock(mutex);
+        if (worker.joinable()) {
+            rescanning = true;
+            wake.notify_all();
+            return;
+        }
+    }
+
+    for (auto const& root: directories())
+        scan(root);
+}
+
+bool RomScanner::busy() const
+{
+    std::lock_guard lock(mutex);
+    return working || rescanning || !queue.empty();
+}
+
+void RomScanner::wait()
+{
+    std::unique_lock lock(mutex);
+    wake.wait(lock, [&] { return !working && !rescanning && queue.empty(); });
+}
+
+void RomScanner::poll(std::vector<ScannedRom>& roms)
+{
+    std::lock_guard lock(mutex);
+    std::move(found.begin(), found.end(), std::back_inserter(roms));
+    found.clear();
+}
+
+void RomScanner::run(std::stop_token stop)
+{
+    load();
+
+    std::unique_lock lock(mutex);
+    while (wake.wait(lock, stop, [&] { return rescanning || !queue.empty(); })) {
+        if (rescanning) {
+            for (auto const& root: roots)
+                if (std::find(queue.begin(), queue.end(), root) == queue.end())
+                    queue.push_back(root);
+            rescanning = false;
+            if (queue.empty()) {
+                wake.notify_all();
+                continue;
+            }
+        }
+
+        auto root = queue.front();
+        queue.pop_front();
+        working = true;
+        lock.unlock();
+
+        bool complete = scanDirectory(root, stop);
+        if (complete)
+            save();
+
+        lock.lock();
+        working = false;
+        wake.notify_all();
+        if (!complete)
+            return;
+    }
+}
+
+bool RomScanner::scanDirectory(std::filesystem::path const& root, std::stop_token stop)
+{
+    std::error_code error;
+    std::filesystem::recursive_directory_iterator it(
+        root, std::filesystem::directory_options::skip_permission_denied, error);
+    if (error) {
+        logw("Failed to scan %s: %s", root.string().c_str(), error.message().c_str());
+        return true;
+    }
+
+    size_t hits = hitCount;
+    size_t misses = missCount;
+    std::unordered_set<std::string> seen;
+    for (; it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        if (stop.stop_requested())
+            return false;
+
+        std::error_code fileError;
+        auto extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        if (extension != ".ch8" || !it->is_regular_file(fileError))
+            continue;
+        uint64_t size = it->file_size(fileError);
+        int64_t modified = it->last_write_time(fileError).time_since_epoch().count();
+        // Too large to load, and not worth reading in to find out
+        if (fileError || !size || size > MAX_ROM_SIZE)
+            continue;
+
+        auto path = it->path().string();
+        seen.insert(path);
+        uint64_t hash;
+        auto record = records.find(path);
+        if (record != records.end() && record->second.size == size &&
+            record->second.modified == modified) {
+            hash = record->second.hash;
+            hitCount++;
+        }
+        else {
+            auto rom = readRom(path);
+            if (rom.empty())
+                continue;
+            hash = fnv1a(rom);
+            records[path] = {size, modified, hash};
+            missCount++;
+        }
+
+        if (reported.insert(hash).second) {
+            std::lock_guard lock(mutex);
+            found.push_back({it->path().stem().string(), path, hash, size});
+        }
+    }
+
+    // Files that went away since the last scan, unless the walk broke off before seeing them all
+    if (!error) {
+        auto prefix = (root / "").string();
+        std::erase_if(records, [&](auto const& record) {
+            return record.first.starts_with(prefix) && !seen.contains(record.first);
+        });
+    }
+    else {
+        logw("Scan of %s stopped early: %s", root.string().c_str(), error.message().c_str());
+    }
+
+    logi("Scanned %s: %zu files known, %zu hashed", root.string().c_str(), hitCount - hits,
+         missCount - misses);
+    return true;
+}
+
+void RomScanner::load()
+{
+    std::error_code error;
+    if (indexPath.empty() || !std::filesystem::exists(indexPath, error))
+        return;
+
+    auto data = readRom(indexPath.string());
+    if (data.size() < TAG_SIZE || std::memcmp(data.data(), TAG, TAG_SIZE)) {
+        logw("Not a ROM library index: %s", indexPath.string().c_str());
+        return;
+    }
+
+    Reader reader{data};
+    std::vector<std::filesystem::path> directories;
+    for (size_t count = reader.get(4); count && !reader.failed; --count)
+        directories.push_back(reader.getString());
+
+    std::unordered_map<std::string, Record> files;
+    for (size_t count = reader.get(4); count && !reader.failed; --count) {
+        auto path = reader.getString();
+        Record record;
+        record.size = reader.get(8);
+        record.modified = static_cast<int64_t>(reader.get(8));
+        record.hash = reader.get(8);
+        files[path] = record;
+    }
+
+    if (reader.failed) {
+        logw("ROM library index %s is cut short, scanning from scratch",
+             indexPath.string().c_str());
+        return;
+    }
+    records = std::move(files);
+    // Directories queued while the index was read are kept
+    std::lock_guard lock(mutex);
+    for (auto& directory: directories)
+        if (std::find(roots.begin(), roots.end(), directory) == roots.end())
+            roots.push_back(std::move(directory));
+}
+
+void RomScanner::save()
+{
+    if (indexPath.empty())
+        return;
+
+    std::vector<uint8_t> data(TAG, TAG + TAG_SIZE);
+    {
+        std::lock_guard lock(mutex);
+        put(data, roots.size(), 4);
+        for (auto const& root: roots)
+            putString(data, root.string());
+    }
+    put(data, records.size(), 4);
+    for (auto const& [path, record]: records) {
+        putString(data, path);
+        put(data, record.size, 8);
+        put(data, record.modified, 8);
+        put(data, record.hash, 8);
+    }
+
+    // Written aside and moved over the old one, so a crash leaves either of them whole
+    std::error_code error;
+    std::filesystem::create_directories(indexPath.parent_path(), error);
+    auto temporary = indexPath;
+    temporary += ".tmp";
+    FILE* file = fopen(temporary.string().c_str(), "wb");
+    bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (file)
+        written = fclose(file) == 0 && written;
+    if (written)
+        std::filesystem::rename(temporary, indexPath, error);
+    if (!written || error)
+        logw("Failed to write the ROM library index %s", indexPath.string().c_str());
+}
+
+std::filesystem::path libraryIndexPath()
+{
+    auto name = "library-v" + std::to_string(LIBRARY_INDEX_VERSION) + ".bin";
+    if (char const* path = getenv("CHIPATE_LIBRARY_INDEX"))
+        return path;
+    if (char const* cache = getenv("XDG_CACHE_HOME"))
+        return std::filesystem::path(cache) / "chipate" / name;
+    if (char const* home = getenv("HOME"))
+        return std::filesystem::path(home) / ".cache" / "chipate" / name;
+    return {};
+}
+
+} // namespace chipate
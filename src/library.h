@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace chipate {
+
+// A distinct ROM found by RomScanner, copies of it elsewhere are left out
+struct ScannedRom {
+    std::string name; // File name without the extension
+    std::string path; // Of the first copy found
+    uint64_t hash;    // fnv1a() of the content
+    uint64_t size;
+};
+
+// Finds the .ch8 files in directories on a thread of its own, leaving out those too large to
+// load. The directories, and the hash, size and time of every file, are kept in an index file, so
+// that a rescan only reads the files that changed since. The index is read on that thread as
+// well. Without threads, scan() and rescan() do the work themselves.
+class RomScanner {
+public:
+    explicit RomScanner(std::filesystem::path index = {});
+    ~RomScanner();
+    RomScanner(RomScanner const&) = delete;
+    RomScanner& operator=(RomScanner const&) = delete;
+
+    // Directories scanned so far and in earlier runs, the latter once the index is read
+    std::vector<std::filesystem::path> directories() const;
+
+    // Queues a directory for scanning, it is remembered in the index from then on
+    void scan(std::filesystem::path const& directory);
+    // Queues every directory of the index, once it is read
+    void rescan();
+    // Whether any directory is queued or being scanned
+    bool busy() const;
+    // Until nothing is busy
+    void wait();
+
+    // Moves the ROMs found since the last call to the end of roms
+    void poll(std::vector<ScannedRom>& roms);
+
+    // Files the index knew, and files that had to be read and hashed
+    size_t hits() const
+    {
+        return hitCount;
+    }
+    size_t misses() const
+    {
+        return missCount;
+    }
+
+private:
+    struct Record {
+        uint64_t size;
+        int64_t modified;
+        uint64_t hash;
+    };
+
+    std::filesystem::path indexPath;
+
+    mutable std::mutex mutex;
+    std::condition_variable_any wake;
+    std::vector<std::filesystem::path> roots;
+    std::deque<std::filesystem::path> queue;
+    bool rescanning = false;
+    bool working = false;
+    std::vector<ScannedRom> found; // Not polled yet
+
+    // Only used by the scanning thread
+    std::unordered_map<std::string, Record> records; // By path
+    std::unordered_set<uint64_t> reported;
+
+    std::atomic<size_t> hitCount = 0;
+    std::atomic<size_t> missCount = 0;
+
+    std::jthread worker; // Last, so it stops before anything it uses goes
+
+    void run(std::stop_token stop);
+    bool scanDirectory(std::filesystem::path const& root, std::stop_token stop);
+    void load();
+    void save();
+};
+
+// On disk as $CHIPATE_LIBRARY_INDEX, or else under $XDG_CACHE_HOME or ~/.cache
+std::filesystem::path libraryIndexPath();
+
+} // namespace chipate
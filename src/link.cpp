@@ -0,0 +1,375 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "link.h"
+
+#include "hash.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <unordered_map>
+
+namespace chipate {
+
+namespace {
+
+char const MAGIC[4] = {'C', '8', 'O', 'B'};
+
+class Writer {
+public:
+    std::vector<uint8_t> data;
+
+    void u16(uint16_t value)
+    {
+        data.push_back(value & 0xFF);
+        data.push_back(value >> 8);
+    }
+
+    void u32(uint32_t value)
+    {
+        u16(value & 0xFFFF);
+        u16(value >> 16);
+    }
+
+    void u64(uint64_t value)
+    {
+        u32(value & 0xFFFFFFFF);
+        u32(value >> 32);
+    }
+
+    void bytes(std::span<uint8_t const> value)
+    {
+        u16(value.size());
+        data.insert(data.end(), value.begin(), value.end());
+    }
+
+    void string(std::string_view value)
+    {
+        bytes({reinterpret_cast<uint8_t const*>(value.data()), value.size()});
+    }
+};
+
+// Reads past the end set failed and return zeroes
+class Reader {
+public:
+    explicit Reader(std::span<uint8_t const> data)
+        : rest(data)
+    {}
+
+    bool failed = false;
+
+    uint16_t u16()
+    {
+        auto low = take(1), high = take(1);
+        return low.empty() || high.empty() ? 0 : low[0] | (high[0] << 8);
+    }
+
+    uint32_t u32()
+    {
+        uint32_t low = u16();
+        return low | (uint32_t(u16()) << 16);
+    }
+
+    uint64_t u64()
+    {
+        uint64_t low = u32();
+        return low | (uint64_t(u32()) << 32);
+    }
+
+    std::span<uint8_t const> bytes()
+    {
+        return take(u16());
+    }
+
+    std::string string()
+    {
+        auto value = bytes();
+        return {value.begin(), value.end()};
+    }
+
+    bool done() const
+    {
+        return rest.empty();
+    }
+
+private:
+    std::span<uint8_t const> rest;
+
+    std::span<uint8_t const> take(size_t size)
+    {
+        if (size > rest.size()) {
+            failed = true;
+            rest = {};
+            return {};
+        }
+        auto value = rest.first(size);
+        rest = rest.subspan(size);
+        return value;
+    }
+};
+
+std::vector<uint8_t> readFile(std::filesystem::path const& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return {};
+
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    for (size_t read; (read = fread(buffer, 1, sizeof(buffer), file)) > 0;)
+        data.insert(data.end(), buffer, buffer + read);
+    fclose(file);
+    return data;
+}
+
+bool writeFile(std::filesystem::path const& path, std::span<uint8_t const> data)
+{
+    // Written aside and renamed, concurrent builds never read half a file
+    auto temporary = path;
+    temporary += ".tmp";
+
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+
+    std::error_code error;
+    if (ok)
+        std::filesystem::rename(temporary, path, error);
+    else
+        std::filesystem::remove(temporary, error);
+    return ok && !error;
+}
+
+// Identical sources share one cached module under different names
+void setName(ObjectModule& module, std::string name)
+{
+    module.map.files = {name};
+    module.name = std::move(name);
+}
+
+} // namespace
+
+LinkResult link(std::span<ObjectModule const> modules, uint16_t origin)
+{
+    LinkResult result;
+
+    std::unordered_map<std::string_view, std::pair<uint16_t, ObjectModule const*>> symbols;
+
+    uint32_t address = origin;
+    for (auto const& module: modules) {
+        result.bases.push_back(address);
+        for (auto const& [name, offset]: module.exports) {
+            auto [it, inserted] = symbols.try_emplace(name, address + offset, &module);
+            if (!inserted)
+                result.errors.push_back("'" + name + "' exported by " + module.name + " and " +
+                                        it->second.second->name);
+        }
+        address += module.code.size();
+    }
+
+    if (address > 0x1000)
+        result.errors.push_back("program ends at " + std::to_string(address) +
+                                ", past the end of memory");
+
+    if (!result.errors.empty())
+        return result;
+
+    result.bytecode.reserve(address - origin);
+    for (size_t m = 0; m < modules.size(); ++m) {
+        auto const& module = modules[m];
+        size_t base = result.bytecode.size();
+        result.bytecode.insert(result.bytecode.end(), module.code.begin(), module.code.end());
+
+        for (auto const& relocation: module.relocations) {
+            if (relocation.offset + 1u >= module.code.size()) {
+                result.errors.push_back(module.name + ": relocation past the end of the code");
+                continue;
+            }
+
+            uint8_t* word = &result.bytecode[base + relocation.offset];
+            uint16_t target = ((word[0] & 0x0F) << 8) | word[1];
+
+            if (relocation.symbol.empty())
+                target += result.bases[m];
+            else if (auto it = symbols.find(relocation.symbol); it != symbols.end())
+                target += it->second.first;
+            else {
+                result.errors.push_back(module.name + ": undefined symbol '" + relocation.symbol +
+                                        "'");
+                continue;
+            }
+
+            word[0] = (word[0] & 0xF0) | ((target >> 8) & 0x0F);
+            word[1] = target & 0xFF;
+        }
+    }
+
+    if (!result.errors.empty()) {
+        result.bytecode.clear();
+        return result;
+    }
+
+    for (size_t m = 0; m < modules.size(); ++m) {
+        auto const& map = modules[m].map;
+        uint32_t files = result.map.files.size();
+        uint32_t labels = result.map.labels.size();
+
+        result.map.files.insert(result.map.files.end(), map.files.begin(), map.files.end());
+        for (auto const& label: map.labels)
+            result.map.labels.push_back({label.name,
+                                         static_cast<uint16_t>(label.address + result.bases[m])});
+        for (auto entry: map.entries) {
+            entry.address += result.bases[m];
+            entry.file += files;
+            if (entry.label != SourceMap::NO_LABEL)
+                entry.label += labels;
+            result.map.entries.push_back(entry);
+        }
+    }
+
+    return result;
+}
+
+std::vector<uint8_t> serialize(ObjectModule const& module)
+{
+    Writer out;
+    out.data.assign(std::begin(MAGIC), std::end(MAGIC));
+    out.u32(ASM_VERSION);
+    out.u64(module.hash);
+    out.bytes(module.code);
+
+    out.u16(module.exports.size());
+    for (auto const& [name, offset]: module.exports) {
+        out.string(name);
+        out.u16(offset);
+    }
+
+    out.u16(module.imports.size());
+    for (auto const& name: module.imports)
+        out.string(name);
+
+    out.u16(module.relocations.size());
+    for (auto const& relocation: module.relocations) {
+        out.u16(relocation.offset);
+        out.string(relocation.symbol);
+    }
+
+    // Files are named by the cache user
+    out.u16(module.map.labels.size());
+    for (auto const& label: module.map.labels) {
+        out.string(label.name);
+        out.u16(label.address);
+    }
+
+    out.u32(module.map.entries.size());
+    for (auto const& entry: module.map.entries) {
+        out.u16(entry.address);
+        out.u16(entry.size);
+        out.u32(entry.line);
+        out.u32(entry.label);
+    }
+
+    return std::move(out.data);
+}
+
+std::optional<ObjectModule> deserialize(std::span<uint8_t const> data)
+{
+    if (data.size() < sizeof(MAGIC) ||
+        !std::equal(std::begin(MAGIC), std::end(MAGIC), data.begin()))
+        return std::nullopt;
+
+    Reader in(data.subspan(sizeof(MAGIC)));
+    if (in.u32() != ASM_VERSION)
+        return std::nullopt;
+
+    ObjectModule module;
+    module.hash = in.u64();
+    auto code = in.bytes();
+    module.code.assign(code.begin(), code.end());
+
+    for (size_t i = in.u16(); i > 0 && !in.failed; --i) {
+        auto name = in.string();
+        module.exports.emplace_back(std::move(name), in.u16());
+    }
+
+    for (size_t i = in.u16(); i > 0 && !in.failed; --i)
+        module.imports.push_back(in.string());
+
+    for (size_t i = in.u16(); i > 0 && !in.failed; --i) {
+        auto offset = in.u16();
+        module.relocations.push_back({offset, in.string()});
+    }
+
+    module.map.files.emplace_back();
+    for (size_t i = in.u16(); i > 0 && !in.failed; --i) {
+        auto name = in.string();
+        module.map.labels.push_back({std::move(name), in.u16()});
+    }
+
+    for (size_t i = in.u32(); i > 0 && !in.failed; --i) {
+        SourceMap::Entry entry{};
+        entry.address = in.u16();
+        entry.size = in.u16();
+        entry.line = in.u32();
+        entry.label = in.u32();
+        module.map.entries.push_back(entry);
+    }
+
+    if (in.failed || !in.done())
+        return std::nullopt;
+    return module;
+}
+
+ObjectCache::ObjectCache(std::filesystem::path directory)
+    : directory(std::move(directory))
+{
+    if (!this->directory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(this->directory, error);
+        if (error)
+            logw("Object cache %s unusable: %s", this->directory.c_str(), error.message().c_str());
+    }
+}
+
+std::filesystem::path ObjectCache::path(uint64_t hash) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".o", hash);
+    return directory / name;
+}
+
+ObjectResult ObjectCache::get(std::string_view source, std::string name)
+{
+    uint64_t hash = fnv1a(source);
+
+    if (auto it = modules.find(hash); it != modules.end()) {
+        hitCount++;
+        ObjectResult result{it->second, {}};
+        setName(result.module, std::move(name));
+        return result;
+    }
+
+    if (!directory.empty()) {
+        auto module = deserialize(readFile(path(hash)));
+        if (module && module->hash == hash) {
+            hitCount++;
+            setName(*module, std::move(name));
+            return {modules.emplace(hash, std::move(*module)).first->second, {}};
+        }
+    }
+
+    missCount++;
+    auto result = assembleObject(source, std::move(name));
+    if (!result.ok())
+        return result;
+
+    modules.emplace(hash, result.module);
+    if (!directory.empty() && !writeFile(path(hash), serialize(result.module)))
+        logw("Failed to write object %s", path(hash).c_str());
+    return result;
+}
+
+} // namespace chipate
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "asm.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace chipate {
+
+struct LinkResult {
+    std::vector<uint8_t> bytecode; // Empty when there are errors
+    std::vector<std::string> errors;
+    std::vector<uint16_t> bases; // Load address of every module
+    SourceMap map;               // Of all modules at their load addresses
+
+    bool ok() const
+    {
+        return errors.empty();
+    }
+};
+
+// Lays the modules out one after another from origin, the first one is entered, and patches
+// their relocations. Every export must be unique and every import exported by some module.
+LinkResult link(std::span<ObjectModule const> modules, uint16_t origin = 0x200);
+
+// Binary form of a module for the cache directory, tagged with ASM_VERSION
+std::vector<uint8_t> serialize(ObjectModule const& module);
+std::optional<ObjectModule> deserialize(std::span<uint8_t const> data);
+
+// Objects by the hash of their source, kept in memory and optionally in a directory across runs,
+// so only sources that changed are assembled again
+class ObjectCache {
+public:
+    explicit ObjectCache(std::filesystem::path directory = {});
+
+    // The cached module for an identical source, assembled and stored otherwise. Modules with
+    // errors are not stored.
+    ObjectResult get(std::string_view source, std::string name = {});
+
+    size_t hits() const
+    {
+        return hitCount;
+    }
+    size_t misses() const
+    {
+        return missCount;
+    }
+
+private:
+    std::filesystem::path directory;
+    std::unordered_map<uint64_t, ObjectModule> modules;
+    size_t hitCount = 0;
+    size_t missCount = 0;
+
+    std::filesystem::path path(uint64_t hash) const;
+};
+
+} // namespace chipate
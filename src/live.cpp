@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "live.h"
+
+#include "asm_ct.h"
+#include "rom.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace chipate {
+
+namespace {
+
+std::vector<std::string_view> splitLines(std::string_view text)
+{
+    std::vector<std::string_view> lines;
+    while (true) {
+        size_t end = text.find('\n');
+        lines.push_back(text.substr(0, end));
+        if (end == text.npos)
+            return lines;
+        text.remove_prefix(end + 1);
+    }
+}
+
+bool isConstant(std::string_view line)
+{
+    detail::Tokenizer tokens(line);
+    tokens.next();
+    return tokens.next() == "equ";
+}
+
+// Labels, constants and org change symbols or move code, a line with them needs a full assembly
+bool definesSymbols(std::string_view line)
+{
+    detail::Tokenizer tokens(line);
+    auto first = tokens.next();
+    return tokens.consume(':') || first == "org" || isConstant(line);
+}
+
+std::vector<LivePatch> diff(std::vector<uint8_t> const& before, std::vector<uint8_t> const& after,
+                            uint16_t origin)
+{
+    // Memory past a shorter program goes back to what loading it would leave there
+    auto at = [](std::vector<uint8_t> const& bytes, size_t i) -> uint8_t {
+        return i < bytes.size() ? bytes[i] : 0;
+    };
+
+    std::vector<LivePatch> patches;
+    size_t size = std::max(before.size(), after.size());
+    for (size_t i = 0; i < size;) {
+        if (at(before, i) == at(after, i)) {
+            ++i;
+            continue;
+        }
+        LivePatch patch{static_cast<uint16_t>(origin + i), {}};
+        for (; i < size && at(before, i) != at(after, i); ++i)
+            patch.bytes.push_back(at(after, i));
+        patches.push_back(std::move(patch));
+    }
+    return patches;
+}
+
+} // namespace
+
+LiveSource::LiveSource(std::filesystem::path path, uint16_t origin)
+    : file(std::move(path))
+    , origin(origin)
+{}
+
+bool LiveSource::changed() const
+{
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(file, error);
+    return !error && time != written;
+}
+
+std::optional<LiveUpdate> LiveSource::reload()
+{
+    std::error_code error;
+    written = std::filesystem::last_write_time(file, error);
+
+    auto text = readRom(file.string());
+    return update({reinterpret_cast<char const*>(text.data()), text.size()});
+}
+
+std::optional<LiveUpdate> LiveSource::update(std::string_view text)
+{
+    std::string newSource(text);
+    auto newLines = splitLines(newSource);
+
+    LiveUpdate update;
+    auto bytecode = program;
+    if (!loaded || !assembleLines(newLines, bytecode, update.linesAssembled)) {
+        SourceMap map;
+        auto result = assembleSource(newSource, origin, &map);
+        if (!result.ok()) {
+            lastErrors = std::move(result.errors);
+            return std::nullopt;
+        }
+        bytecode = std::move(result.bytecode);
+        map.files = {file.filename().string()};
+        sourceMap = std::move(map);
+        update.linesAssembled = newLines.size();
+        update.relaid = true;
+    }
+
+    update.patches = loaded ? diff(program, bytecode, origin)
+                            : std::vector<LivePatch>{{origin, bytecode}};
+    lastErrors.clear();
+    loaded = true;
+    program = std::move(bytecode);
+    source = std::move(newSource);
+    lines = splitLines(source);
+    return update;
+}
+
+// Assembles the changed lines at the addresses they had, against the symbols as they were. Fails
+// when lines were added or removed, a line defines symbols or it changes size.
+bool LiveSource::assembleLines(std::vector<std::string_view> const& newLines,
+                               std::vector<uint8_t>& bytecode, size_t& count) const
+{
+    if (newLines.size() != lines.size())
+        return false;
+
+    std::unordered_map<size_t, SourceMap::Entry const*> entries; // By line
+    for (auto const& entry: sourceMap.entries)
+        entries[entry.line] = &entry;
+
+    std::string symbols;
+    bool haveSymbols = false;
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (newLines[i] == lines[i])
+            continue;
+        if (definesSymbols(lines[i]) || definesSymbols(newLines[i]))
+            return false;
+
+        if (!haveSymbols) {
+            for (auto const& label: sourceMap.labels)
+                symbols += label.name + " equ " + std::to_string(label.address) + "\n";
+            for (auto line: lines)
+                if (isConstant(line))
+                    symbols += std::string(line) + "\n";
+            haveSymbols = true;
+        }
+
+        auto entry = entries.find(i + 1);
+        uint16_t address = entry != entries.end() ? entry->second->address : origin;
+        size_t size = entry != entries.end() ? entry->second->size : 0;
+
+        auto result = assembleSource(symbols + std::string(newLines[i]), address);
+        if (!result.ok() || result.bytecode.size() != size)
+            return false;
+        std::copy(result.bytecode.begin(), result.bytecode.end(),
+                  bytecode.begin() + (address - origin));
+        count++;
+    }
+    return true;
+}
+
+} // namespace chipate
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "asm.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chipate {
+
+// Bytes that changed since the previous program, for Chip8::patch
+struct LivePatch {
+    uint16_t address;
+    std::vector<uint8_t> bytes;
+};
+
+struct LiveUpdate {
+    std::vector<LivePatch> patches;
+    size_t linesAssembled = 0;
+    bool relaid = false; // The layout changed, so the whole source was assembled
+};
+
+// Live coding: keeps the program of an assembly source up to date as it is edited. Lines that
+// changed without moving anything are assembled on their own against the previous symbols, any
+// other change assembles the whole source. Either way only the bytes that differ are patched.
+class LiveSource {
+public:
+    explicit LiveSource(std::filesystem::path path = {}, uint16_t origin = 0x200);
+
+    // Whether the file was written since it was last read
+    bool changed() const;
+    // Reads the file and updates to it, see update()
+    std::optional<LiveUpdate> reload();
+
+    // Changes from the current program to source, nullopt with errors() when it does not
+    // assemble, in which case the current program stays. The first one patches all of it.
+    std::optional<LiveUpdate> update(std::string_view source);
+
+    std::vector<uint8_t> const& bytecode() const
+    {
+        return program;
+    }
+    SourceMap const& map() const
+    {
+        return sourceMap;
+    }
+    std::vector<AsmError> const& errors() const
+    {
+        return lastErrors;
+    }
+    std::filesystem::path const& path() const
+    {
+        return file;
+    }
+
+private:
+    std::filesystem::path file;
+    std::optional<std::filesystem::file_time_type> written;
+    uint16_t origin;
+
+    std::string source;
+    std::vector<std::string_view> lines; // Into source
+    std::vector<uint8_t> program;
+    SourceMap sourceMap;
+    std::vector<AsmError> lastErrors;
+    bool loaded = false;
+
+    bool assembleLines(std::vector<std::string_view> const& newLines,
+                       std::vector<uint8_t>& bytecode, size_t& count) const;
+};
+
+} // namespace chipate
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: WTFPL
 
 #pragma once
+#include <atomic>
 #include <chrono>
 #include <cstdarg>
 #include <cstring>
@@ -32,8 +33,20 @@ inline std::string timestamp()
     return oss.str();
 }
 
+// Messages below it are dropped before anything is formatted, raylib would drop them anyway
+inline std::atomic<int> logLevel = LOG_INFO;
+
+inline void setLogLevel(int level)
+{
+    logLevel = level;
+    SetTraceLogLevel(level);
+}
+
 inline void logMessage(int level, char const* file, int line, char const* fmt, ...)
 {
+    if (level < logLevel.load(std::memory_order_relaxed))
+        return;
+
     char    msgBuf[2048];
     va_list args;
     va_start(args, fmt);
@@ -1,56 +1,65 @@
 // SPDX-License-Identifier: WTFPL
 
+#include "asm_ct.h"
+#include "catalog.h"
 #include "chip8.h"
+#include "detect.h"
+#include "hash.h"
+#include "library.h"
+#include "live.h"
 #include "log.h"
+#include "pack.h"
+#include "profile.h"
+#include "rom.h"
+#include "search.h"
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <raylib.h>
+#include <span>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #define RAYGUI_IMPLEMENTATION
 #include <raygui/raygui.h>
 #include <raygui/styles/dark/style_dark.h>
-#include <nlohmann/json.hpp>
-#include <cmrc/cmrc.hpp>
-
-CMRC_DECLARE(chip8archive);
 
 int const WINDOW_WIDTH = 800;
 int const WINDOW_HEIGHT = 600;
 
-std::vector<uint8_t> loadRom(std::string const& path)
-{
-    std::vector<uint8_t> romData;
-
-    FILE* file = fopen(path.c_str(), "rb");
-    if (!file) {
-        loge("Failed to open ROM file: %s", path.c_str());
-        return {};
-    }
-
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    romData.resize(fileSize);
-    fread(romData.data(), 1, fileSize, file);
-    fclose(file);
-
-    return romData;
-}
-
-struct RomInfo {
-    std::string name;
-    std::string path;
-    std::string title;
-    std::string authors;
-    std::string release;
-    std::string event;
-    std::string platform;
-    std::string desc;
-};
-
-std::vector<RomInfo> ROMS;
+// ROMs added to the list and the search index per frame while the library loads
+size_t const LIST_BATCH = 2048;
+
+// Shown until a ROM is loaded, assembled during compilation
+constexpr auto DEMO_ROM = chipate::assemble_ct<R"(
+        ld v0 0         ; digit
+        ld v1 2         ; x
+        ld v2 4         ; y
+    next:
+        ld f v0
+        drw v1 v2 5
+        add v0 1
+        add v1 8
+        se v0 8
+        jp same_row
+        ld v1 2
+        add v2 8
+    same_row:
+        se v0 16
+        jp next
+    halt:
+        jp halt
+)">();
 
 int keyMap[16] = {
     KEY_X,     // 0
@@ -71,11 +80,113 @@ int keyMap[16] = {
     KEY_V      // F
 };
 
-void loadRom(chipate::Chip8& chip8, RomInfo const& rom)
+// A ROM the list offers, pointing into the embedded archive, a pack or a ROM found by scanning
+struct LibraryRom {
+    char const* title = "";
+    char const* authors = "";
+    char const* release = "";
+    char const* event = "";
+    char const* platform = "";
+    char const* desc = "";
+    std::span<uint8_t const> rom;
+    char const* path = nullptr; // Instead of rom, for files that are read when loaded
+    chipate::OctoOptions options;
+};
+
+LibraryRom catalogRom(size_t index)
+{
+    auto const& entry = chipate::CATALOG[index];
+    return {.title = chipate::catalogString(entry.title),
+            .authors = chipate::catalogString(entry.authors),
+            .release = chipate::catalogString(entry.release),
+            .event = chipate::catalogString(entry.event),
+            .platform = chipate::catalogString(entry.platform),
+            .desc = chipate::catalogString(entry.desc),
+            .rom = chipate::catalogRom(entry),
+            .options = entry.options};
+}
+
+LibraryRom packRom(chipate::RomPack const& pack, size_t index)
+{
+    auto const& entry = pack[index];
+    return {.title = pack.string(entry.title),
+            .authors = pack.string(entry.authors),
+            .release = pack.string(entry.release),
+            .event = pack.string(entry.event),
+            .platform = pack.string(entry.platform),
+            .desc = pack.string(entry.desc),
+            .rom = pack.rom(entry),
+            .options = pack.options(entry)};
+}
+
+LibraryRom scannedRom(chipate::ScannedRom const& rom)
+{
+    return {.title = rom.name.c_str(), .path = rom.path.c_str()};
+}
+
+// Starts the ROM with the quirks its metadata lists, returns those and its tick rate
+chipate::RomProfile loadRom(chipate::Chip8& chip8, LibraryRom const& rom)
+{
+    std::vector<uint8_t> file;
+    auto bytes = rom.rom;
+    if (rom.path) {
+        file = chipate::readRom(rom.path);
+        bytes = file;
+    }
+
+    auto profile = chipate::romProfile(rom.platform, rom.options);
+    // ROMs without metadata get the quirks that run them best, like dropped ones
+    if (!*rom.platform)
+        profile.quirks = chipate::quirkCache().get(bytes).quirks;
+    chip8.init(bytes, profile.quirks, std::random_device{}());
+    logi("Running %s at %d instructions per frame", rom.title, profile.tickRate);
+    return profile;
+}
+
+// Source map next to a dropped ROM, as chipate-asm --map writes it
+std::optional<chipate::SourceMap> loadSourceMap(std::filesystem::path rom)
+{
+    auto path = rom.replace_extension(".map");
+    if (!std::filesystem::exists(path))
+        return std::nullopt;
+    auto text = chipate::readRom(path.string());
+    auto map = chipate::parseSourceMap({reinterpret_cast<char const*>(text.data()), text.size()});
+    if (!map)
+        logw("Invalid source map: %s", path.c_str());
+    return map;
+}
+
+void drawProfileColumn(char const* title, std::vector<chipate::ProfileEntry> const& entries,
+                       uint64_t total, int x, int y, int width, int height)
+{
+    int const ROW = 14;
+    DrawText(title, x, y, 10, YELLOW);
+    for (size_t i = 0; i < entries.size() && (i + 2) * ROW <= height; ++i) {
+        int row = y + (i + 1) * ROW;
+        DrawText(entries[i].name.c_str(), x, row, 10, RAYWHITE);
+        DrawText(TextFormat("%5.1f%%", 100.0 * entries[i].count / total), x + width - 50, row, 10,
+                 RAYWHITE);
+    }
+}
+
+// Hottest routines and source lines, or addresses without a source map, over the display
+void drawProfile(chipate::Profile const& profile, int x, int y, int width, int height)
 {
-    auto fs = cmrc::chip8archive::get_filesystem();
-    auto file = fs.open(rom.path);
-    chip8.init(std::vector<uint8_t>(file.begin(), file.end()), chipate::Quirks{});
+    DrawRectangle(x, y, width, height, Fade(BLACK, 0.75f));
+    if (!profile.total) {
+        DrawText("Nothing executed yet", x + 10, y + 10, 10, RAYWHITE);
+        return;
+    }
+
+    if (profile.routines.empty()) {
+        drawProfileColumn("Hottest addresses", profile.lines, profile.total, x + 10, y + 10,
+                          width / 2 - 20, height - 20);
+        return;
+    }
+    drawProfileColumn("Hottest routines", profile.routines, profile.total, x + 10, y + 10,
+                      width / 2 - 20, height - 20);
+    drawProfileColumn("Hottest lines", profile.lines, profile.total, x + width / 2 + 10, y + 10,
+                      width / 2 - 20, height - 20);
 }
 
 void drawDisplay(chipate::Chip8& chip8, size_t x, size_t y, size_t width, size_t height)
@@ -103,93 +214,90 @@ void drawDisplay(chipate::Chip8& chip8, size_t x, size_t y, size_t width, size_t
     }
 }
 
+// What the list needs of a ROM of the archive or pack, worked out while the window is up
+struct ListedRom {
+    char const* title;
+    uint64_t hash;
+};
+
 int main()
 {
+    auto started = std::chrono::steady_clock::now();
+    auto sinceStart = [&] {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started)
+            .count();
+    };
     logi("Initializing...");
 
-    logi("Loading resources...");
-    logi("Loading Chip-8 archive...");
-    auto fs = cmrc::chip8archive::get_filesystem();
-    auto file = fs.open("programs.json");
-    std::vector<const char*> romNameSelectorData;
-
-
-    nlohmann::json programsJson;
-    try {
-        programsJson = nlohmann::json::parse(file);
-        for (auto& [program, info] : programsJson.items()) {
-
-            if (info["platform"] != "chip8" && info["platform"] != "schip") {
-                logi("Skipping non-Chip-8 program: %s", program.c_str());
-                continue;
-            }
-            std::string name = program;
-            std::string title = info["title"];
-            std::string desc = info["desc"];
-            std::string release = info["release"];
-            std::string event = info.contains("event") ? info["event"] : "";
-            std::string platform = info["platform"];
-            std::string authors;
-            for (auto& author : info["authors"]) {
-                if (!authors.empty())
-                    authors += ", ";
-                authors += author.get<std::string>();
+    // A pack from chipate-pack replaces the embedded archive. It is mapped, not read, so only the
+    // list of its titles grows with it.
+    chipate::RomPack pack;
+    if (char const* path = std::getenv("CHIPATE_PACK"); path && pack.open(path) && pack.size()) {
+        logi("ROM pack %s: %zu ROMs", path, pack.size());
+    }
+    else {
+        pack.close();
+        logi("Chip-8 archive: %zu programs", chipate::CATALOG.size());
+    }
+    size_t libraryCount = pack.isOpen() ? pack.size() : chipate::CATALOG.size();
+
+    // ROMs found in directories follow the others, the deque keeps the titles pointing into it
+    // in place
+    std::deque<chipate::ScannedRom> scanned;
+    auto libraryRom = [&](size_t index) {
+        if (index >= libraryCount)
+            return scannedRom(scanned[index - libraryCount]);
+        return pack.isOpen() ? packRom(pack, index) : catalogRom(index);
+    };
+
+    // Every title by list index, which is also its id in the search index
+    std::vector<char const*> titles;
+    chipate::TrigramIndex search;
+    std::unordered_set<uint64_t> knownRoms; // So that scanned copies of them are left out
+
+    // The archive or pack is gone through on a thread of its own, and the list takes what it
+    // found a batch per frame, so the window opens at once whatever the size of the library
+    std::mutex listedMutex;
+    std::vector<ListedRom> listed; // Only grows
+    auto listLibrary = [&](std::stop_token stop) {
+        std::vector<ListedRom> batch;
+        for (size_t i = 0; i < libraryCount && !stop.stop_requested(); ++i) {
+            auto rom = pack.isOpen() ? packRom(pack, i) : catalogRom(i);
+            batch.push_back({rom.title, pack.isOpen() ? pack[i].hash : chipate::fnv1a(rom.rom)});
+            if (batch.size() == LIST_BATCH || i + 1 == libraryCount) {
+                std::lock_guard lock(listedMutex);
+                listed.insert(listed.end(), batch.begin(), batch.end());
+                batch.clear();
             }
-            logi("Found program: %s %s (%s)", name.c_str(), title.c_str(), desc.c_str());
-
-            ROMS.push_back({
-                .name = name,
-                .path = "roms/" + name + ".ch8",
-                .title = title,
-                .authors = authors,
-                .release = release,
-                .event = event,
-                .platform = platform,
-                .desc = desc
-            });
-
         }
+    };
+    std::jthread lister;
+    try {
+        lister = std::jthread(listLibrary);
     }
-    catch (nlohmann::json::parse_error& e) {
-        loge("Failed to parse programs.json: %s", e.what());
-        return -1;
+    catch (std::system_error const& error) {
+        logw("Listing ROMs without a thread: %s", error.what());
+        listLibrary({});
     }
 
-    for (const auto& rom : ROMS) {
-        romNameSelectorData.push_back(rom.title.c_str());
-    }
+    // Directories dropped in earlier runs are scanned again once the library is listed, only
+    // files that changed are read. Until then scanned ROMs wait in the scanner.
+    chipate::RomScanner scanner(chipate::libraryIndexPath());
+    std::vector<chipate::ScannedRom> newRoms;
+    std::vector<ListedRom> newListed;
+    bool libraryListed = false;
+    bool firstFrame = true;
 
     InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "chipate");
     SetTargetFPS(60);
-    int tickRate = 10;
+    int tickRate = chipate::DEFAULT_TICK_RATE;
 
     chipate::Chip8 chip8;
-
-    chipate::Quirks chip_8 = {.shiftVxOnly = false,
-                              .loadStoreIAdd = false,
-                              .jumpWithVx = false,
-                              .logicNoVF = false,
-                              .spriteWrap = false,
-                              .legacySchipScroll = false};
-
-    chipate::Quirks schip_1_0 = {.shiftVxOnly = true,
-                                 .loadStoreIAdd = true,
-                                 .jumpWithVx = true,
-                                 .logicNoVF = true,
-                                 .spriteWrap = true,
-                                 .legacySchipScroll = true};
-
-    chipate::Quirks schip_modern = {.shiftVxOnly = true,
-                                    .loadStoreIAdd = true,
-                                    .jumpWithVx = true,
-                                    .logicNoVF = true,
-                                    .spriteWrap = true,
-                                    .legacySchipScroll = false};
+    chip8.init(DEMO_ROM, {}, std::random_device{}());
 
     // Quirks preset selector
     int quirkPreset = 1; // 0 = CHIP-8, 1 = SCHIP 1.0, 2 = SCHIP Modern
-    chipate::Quirks* currentQuirks = &schip_1_0;
-    bool romLoaded = false;
+    chipate::Quirks const* currentQuirks = &chipate::SCHIP_1_0_QUIRKS;
 
     bool quirkSelectorEditMode = false;
     int quirkSelectorActive = 0;
@@ -200,27 +308,101 @@ int main()
     int romsScrollIndex = 0;
     int romsActive = 2;
     int romsFocus = -1;
+    char query[64] = "";
+    bool searchEditMode = false;
+    std::string shownQuery;
+    bool listChanged = true;
+    std::vector<uint32_t> matches; // List indices of what is shown, best first
+    std::vector<char const*> shownTitles;
+
+    // Profiler panel
+    bool profiling = false;
+    std::optional<chipate::SourceMap> sourceMap;
+    chipate::Profile profile;
+    size_t frames = 0;
+
+    // Dropped assembly source, patched into the running machine as it is saved
+    std::optional<chipate::LiveSource> live;
 
     GuiLoadStyleDark();
     while (!WindowShouldClose()) {
-        if (romLoaded) {
-            for (int i = 0; i < tickRate; ++i) {
-                chip8.tick();
+        chip8.frame(tickRate);
+
+        if (!libraryListed) {
+            newListed.clear();
+            {
+                std::lock_guard lock(listedMutex);
+                auto end = listed.begin() + std::min(listed.size(), titles.size() + LIST_BATCH);
+                newListed.assign(listed.begin() + titles.size(), end);
+            }
+            for (auto const& rom: newListed) {
+                titles.push_back(rom.title);
+                search.add(rom.title);
+                knownRoms.insert(rom.hash);
+            }
+            listChanged = listChanged || !newListed.empty();
+            if (titles.size() == libraryCount) {
+                libraryListed = true;
+                logi("Listed %zu ROMs %.1f ms after start", libraryCount, sinceStart());
+                scanner.rescan();
             }
+        }
 
-            chip8.tock();
+        newRoms.clear();
+        if (libraryListed)
+            scanner.poll(newRoms);
+        for (auto& rom: newRoms) {
+            if (!knownRoms.insert(rom.hash).second)
+                continue;
+            scanned.push_back(std::move(rom));
+            titles.push_back(scanned.back().name.c_str());
+            search.add(scanned.back().name);
+            listChanged = true;
         }
 
         if (IsFileDropped()) {
             int count = 0;
             auto droppedFiles = LoadDroppedFiles();
-            if (droppedFiles.count > 0 && IsFileExtension(droppedFiles.paths[0], ".ch8")) {
-                chip8.init(loadRom(droppedFiles.paths[0]), *currentQuirks);
-                romLoaded = true;
+            if (droppedFiles.count > 0 && DirectoryExists(droppedFiles.paths[0])) {
+                logi("Scanning %s for ROMs", droppedFiles.paths[0]);
+                scanner.scan(droppedFiles.paths[0]);
+            }
+            else if (droppedFiles.count > 0 && IsFileExtension(droppedFiles.paths[0], ".ch8")) {
+                auto rom = chipate::readRom(droppedFiles.paths[0]);
+                // Nobody knows which quirks a loose ROM wants, so it gets the ones that run best
+                quirkSelectorActive = chipate::quirkCache().get(rom).preset;
+                currentQuirks = &chipate::QUIRK_PRESETS[quirkSelectorActive].quirks;
+                logi("Running %s with %s quirks", droppedFiles.paths[0],
+                     chipate::QUIRK_PRESETS[quirkSelectorActive].name);
+                chip8.init(rom, *currentQuirks, std::random_device{}());
+                sourceMap = loadSourceMap(droppedFiles.paths[0]);
+                live.reset();
+            }
+            else if (droppedFiles.count > 0 && IsFileExtension(droppedFiles.paths[0], ".asm")) {
+                live.emplace(droppedFiles.paths[0]);
+                if (live->reload()) {
+                    chip8.init(live->bytecode(), *currentQuirks, std::random_device{}());
+                    sourceMap = live->map();
+                }
+                for (auto const& error: live->errors())
+                    logw("%s:%zu: %s", live->path().c_str(), error.line, error.message.c_str());
             }
             UnloadDroppedFiles(droppedFiles);
         }
 
+        // Saves show up within a quarter of a second
+        if (live && frames % 15 == 0 && live->changed()) {
+            if (auto update = live->reload()) {
+                for (auto const& patch: update->patches)
+                    chip8.patch(patch.address, patch.bytes);
+                sourceMap = live->map();
+                logi("Live: %zu lines assembled, %zu ranges patched%s", update->linesAssembled,
+                     update->patches.size(), update->relaid ? ", layout changed" : "");
+            }
+            for (auto const& error: live->errors())
+                logw("%s:%zu: %s", live->path().c_str(), error.line, error.message.c_str());
+        }
+
         BeginDrawing();
 
         ClearBackground(GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR)));
@@ -237,35 +419,65 @@ int main()
         if (GuiSpinner({15, 90, 150, 20}, nullptr, &tickRate, 1, 100000, spinnerEditMode))
             spinnerEditMode = !spinnerEditMode;
 
+        bool wasProfiling = profiling;
+        GuiToggle({15, 130, 150, 20}, "PROFILE", &profiling);
+        if (profiling != wasProfiling)
+            chip8.setPcProfiling(profiling);
+
         GuiSetStyle(LISTVIEW, LIST_ITEMS_SPACING, 3);
         GuiSetStyle(LISTVIEW, LIST_ITEMS_HEIGHT, 17);
         GuiSetStyle(LISTVIEW, TEXT_ALIGNMENT, TEXT_ALIGN_LEFT);
-        GuiListViewEx({175, 10, 320, 110}, romNameSelectorData.data(), romNameSelectorData.size(), &romsScrollIndex,
+        if (GuiTextBox({175, 10, 320, 20}, query, sizeof(query), searchEditMode))
+            searchEditMode = !searchEditMode;
+        // Only searched again when something changed, not every frame
+        if (listChanged || shownQuery != query) {
+            if (shownQuery != query) {
+                romsActive = 0;
+                romsScrollIndex = 0;
+            }
+            shownQuery = query;
+            search.search(shownQuery, matches);
+            shownTitles.resize(matches.size());
+            for (size_t i = 0; i < matches.size(); ++i)
+                shownTitles[i] = titles[matches[i]];
+            listChanged = false;
+        }
+        GuiListViewEx({175, 35, 320, 85}, shownTitles.data(), shownTitles.size(), &romsScrollIndex,
                       &romsActive, &romsFocus);
 
-        romsActive = std::clamp(romsActive, 0, static_cast<int>(ROMS.size()) - 1);
-        const auto& selectedRom = ROMS[romsActive];
+        LibraryRom selectedRom;
+        if (!matches.empty()) {
+            romsActive = std::clamp(romsActive, 0, static_cast<int>(matches.size()) - 1);
+            selectedRom = libraryRom(matches[romsActive]);
+        }
 
         if (GuiButton({175, 130, 320, 20}, "LOAD")) {
-            if (romsActive >= 0 && romsActive < ROMS.size()) {
-                const auto& rom = ROMS[romsActive];
-                loadRom(chip8,rom);
-                romLoaded = true;
+            if (!matches.empty()) {
+                auto profile = loadRom(chip8, selectedRom);
+                tickRate = profile.tickRate;
+                for (size_t preset = 0; preset < chipate::QUIRK_PRESETS.size(); ++preset) {
+                    if (chipate::QUIRK_PRESETS[preset].quirks == profile.quirks) {
+                        quirkSelectorActive = static_cast<int>(preset);
+                        currentQuirks = &chipate::QUIRK_PRESETS[preset].quirks;
+                    }
+                }
+                sourceMap.reset();
+                live.reset();
             }
         }
 
 
         GuiLabel( {500, 10, 80, 20}, "Author: ");
-        GuiLabel( {580, 10, 200, 20}, selectedRom.authors.c_str());
+        GuiLabel( {580, 10, 200, 20}, selectedRom.authors);
 
         GuiLabel( {500, 35, 80, 20}, "Release: ");
-        GuiLabel( {580, 35, 200, 20}, selectedRom.release.c_str());
+        GuiLabel( {580, 35, 200, 20}, selectedRom.release);
 
         GuiLabel( {500, 60, 80, 20}, "Event: ");
-        GuiLabel( {580, 60, 200, 20}, selectedRom.event.c_str());
+        GuiLabel( {580, 60, 200, 20}, selectedRom.event);
 
         GuiLabel( {500, 85, 80, 20}, "Platform: ");
-        GuiLabel( {580, 85, 200, 20}, selectedRom.platform.c_str());
+        GuiLabel( {580, 85, 200, 20}, selectedRom.platform);
 
         auto prevWrapMode = GuiGetStyle(DEFAULT, TEXT_WRAP_MODE);
         auto prevAlignment = GuiGetStyle(DEFAULT, TEXT_ALIGNMENT);
@@ -273,7 +485,7 @@ int main()
         GuiSetStyle(DEFAULT, TEXT_WRAP_MODE, TEXT_WRAP_WORD);
         GuiSetStyle(DEFAULT, TEXT_ALIGNMENT_VERTICAL, TEXT_ALIGN_TOP);
         GuiSetStyle(DEFAULT, TEXT_LINE_SPACING, 17);
-        GuiLabel({500, 110, 280, 70}, selectedRom.desc.c_str());
+        GuiLabel({500, 110, 280, 70}, selectedRom.desc);
 
         GuiSetStyle(DEFAULT, TEXT_WRAP_MODE, prevWrapMode);
         GuiSetStyle(DEFAULT, TEXT_ALIGNMENT, prevAlignment);
@@ -288,6 +500,13 @@ int main()
         DrawRectangle(displayX, displayY, displayWidth, displayHeight, LIGHTGRAY);
         drawDisplay(chip8, displayX, displayY, displayWidth, displayHeight);
 
+        // Twice a second is enough to read, and keeps the aggregation off most frames
+        if (profiling && frames % 30 == 0)
+            profile = chipate::buildProfile(chip8.pcCounts(), sourceMap ? &*sourceMap : nullptr);
+        if (profiling)
+            drawProfile(profile, displayX, displayY, displayWidth, displayHeight);
+        frames++;
+
         int prevPreset = quirkSelectorActive;
         if (GuiDropdownBox({15, 35, 150, 20}, "CHIP-8;SCHIP 1.0;SCHIP Modern",
                            &quirkSelectorActive, quirkSelectorEditMode))
@@ -295,21 +514,25 @@ int main()
         if (prevPreset != quirkSelectorActive) {
             switch (quirkSelectorActive) {
             case 0:
-                currentQuirks = &chip_8;
+                currentQuirks = &chipate::CHIP8_QUIRKS;
                 break;
             case 1:
-                currentQuirks = &schip_1_0;
+                currentQuirks = &chipate::SCHIP_1_0_QUIRKS;
                 break;
             case 2:
-                currentQuirks = &schip_modern;
+                currentQuirks = &chipate::SCHIP_MODERN_QUIRKS;
                 break;
             }
-            if (romLoaded)
-                chip8.setQuirks(*currentQuirks);
+            chip8.setQuirks(*currentQuirks);
         }
 
         GuiUnlock();
         EndDrawing();
+
+        if (firstFrame) {
+            logi("First frame %.1f ms after start", sinceStart());
+            firstFrame = false;
+        }
     }
 
     CloseWindow();
@@ -61,47 +61,59 @@ enum Opcode : uint16_t
 struct OpcodeMatch {
     Opcode opcode;
     uint16_t mask;
+    char const* format; // Assembler syntax, operands in braces: {x} {y} {n} {kk} {nnn}
 };
 
-static std::array<OpcodeMatch, 40> opcodeMatches{
-    OpcodeMatch{CLS,  0xFFFF},
-    {RET,  0xFFFF},
-    {JP,   0xF000},
-    {CALL, 0xF000},
-    {SE,   0xF000},
-    {SNE,  0xF000},
-    {SER,  0xF000},
-    {LD,   0xF000},
-    {ADD,  0xF000},
-    {LDR,  0xF00F},
-    {OR,   0xF00F},
-    {AND,  0xF00F},
-    {XOR,  0xF00F},
-    {ADDC, 0xF00F},
-    {SUB,  0xF00F},
-    {SHR,  0xF00F},
-    {SUBN, 0xF00F},
-    {SHL,  0xF00F},
-    {SNER, 0xF000},
-    {LDI,  0xF000},
-    {JPO,  0xF000},
-    {RND,  0xF000},
-    {DRW,  0xF000},
-    {SKP,  0xF0FF},
-    {SKNP, 0xF0FF},
-    {LDRD, 0xF00F},
-    {LDK,  0xF00F},
-    {LDDR, 0xF0FF},
-    {LDSR, 0xF0FF},
-    {ADDI, 0xF0FF},
-    {LDS,  0xF0FF},
-    {LBCD, 0xF0FF},
-    {LDMR, 0xF0FF},
-    {LDRM, 0xF0FF},
-    {HIRS, 0xFFFF},
-    {LORS, 0xFFFF},
-    {SCRD, 0xFFF0},
-    {SCRL, 0xFFFF},
-    {SCRR, 0xFFFF}
+// Decode table shared by the interpreter, the disassembler and the tools, first match wins
+inline constexpr std::array<OpcodeMatch, 39> opcodeMatches{
+    OpcodeMatch{CLS,  0xFFFF, "cls"},
+    {RET,  0xFFFF, "ret"},
+    {JP,   0xF000, "jp {nnn}"},
+    {CALL, 0xF000, "call {nnn}"},
+    {SE,   0xF000, "se v{x} {kk}"},
+    {SNE,  0xF000, "sne v{x} {kk}"},
+    {SER,  0xF000, "se v{x} v{y}"},
+    {LD,   0xF000, "ld v{x} {kk}"},
+    {ADD,  0xF000, "add v{x} {kk}"},
+    {LDR,  0xF00F, "ld v{x} v{y}"},
+    {OR,   0xF00F, "or v{x} v{y}"},
+    {AND,  0xF00F, "and v{x} v{y}"},
+    {XOR,  0xF00F, "xor v{x} v{y}"},
+    {ADDC, 0xF00F, "add v{x} v{y}"},
+    {SUB,  0xF00F, "sub v{x} v{y}"},
+    {SHR,  0xF00F, "shr v{x} v{y}"},
+    {SUBN, 0xF00F, "subn v{x} v{y}"},
+    {SHL,  0xF00F, "shl v{x} v{y}"},
+    {SNER, 0xF000, "sne v{x} v{y}"},
+    {LDI,  0xF000, "ld i {nnn}"},
+    {JPO,  0xF000, "jp v0 {nnn}"},
+    {RND,  0xF000, "rnd v{x} {kk}"},
+    {DRW,  0xF000, "drw v{x} v{y} {n}"},
+    {SKP,  0xF0FF, "skp v{x}"},
+    {SKNP, 0xF0FF, "sknp v{x}"},
+    {LDRD, 0xF00F, "ld v{x} dt"},
+    {LDK,  0xF00F, "ld v{x} k"},
+    {LDDR, 0xF0FF, "ld dt v{x}"},
+    {LDSR, 0xF0FF, "ld st v{x}"},
+    {ADDI, 0xF0FF, "add i v{x}"},
+    {LDS,  0xF0FF, "ld f v{x}"},
+    {LBCD, 0xF0FF, "ld b v{x}"},
+    {LDMR, 0xF0FF, "ld [i] v{x}"},
+    {LDRM, 0xF0FF, "ld v{x} [i]"},
+    {HIRS, 0xFFFF, "high"},
+    {LORS, 0xFFFF, "low"},
+    {SCRD, 0xFFF0, "scd {n}"},
+    {SCRL, 0xFFFF, "scl"},
+    {SCRR, 0xFFFF, "scr"}
 };
+
+// Table entry for an instruction word, nullptr if it does not decode
+constexpr OpcodeMatch const* decode(uint16_t data)
+{
+    for (auto const& match: opcodeMatches)
+        if ((data & match.mask) == match.opcode)
+            return &match;
+    return nullptr;
+}
+
 } // namespace chipate
@@ -0,0 +1,600 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "optimize.h"
+
+#include "asm_ct.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace chipate {
+
+namespace {
+
+// Register sets: V0 to VF are bits 0 to 15, I is bit 16
+uint32_t const I_REG = 1u << 16;
+uint32_t const ALL_REGS = 0x1FFFF;
+
+uint32_t reg(unsigned r)
+{
+    return 1u << r;
+}
+
+// V0 to Vx, as Fx55 and Fx65 transfer them
+uint32_t regsTo(unsigned x)
+{
+    return (2u << x) - 1;
+}
+
+struct Effect {
+    uint32_t reads;
+    uint32_t writes;   // Overwritten whatever they held before
+    uint32_t clobbers; // May change, a superset of writes
+};
+
+// Conservative about quirks: a register is only written where every variant of the
+// instruction writes it, and clobbered where any variant may change it
+Effect effect(uint16_t w, Quirks const& quirks)
+{
+    unsigned x = (w >> 8) & 0xF;
+    unsigned y = (w >> 4) & 0xF;
+    uint32_t vx = reg(x);
+    uint32_t vy = reg(y);
+    uint32_t vf = reg(0xF);
+    Effect const UNKNOWN{ALL_REGS, 0, ALL_REGS};
+
+    switch (w >> 12) {
+    case 0x0:
+        if (w == 0x00E0 || w == 0x00EE || w == 0x00FB || w == 0x00FC || w == 0x00FD ||
+            w == 0x00FE || w == 0x00FF || (w & 0xFFF0) == 0x00C0)
+            return {0, 0, 0};
+        return UNKNOWN;
+    case 0x1:
+    case 0x2:
+        return {0, 0, 0};
+    case 0x3:
+    case 0x4:
+        return {vx, 0, 0};
+    case 0x5:
+    case 0x9:
+        return {vx | vy, 0, 0};
+    case 0x6:
+        return {0, vx, vx};
+    case 0x7:
+        return {vx, 0, vx};
+    case 0x8:
+        switch (w & 0xF) {
+        case 0x0:
+            return {vy, x == y ? 0 : vx, vx};
+        case 0x1:
+        case 0x2:
+        case 0x3:
+            // Whether VF is reset depends on the quirk, the interpreter may reset it anyway
+            return {vx | vy, quirks.logicNoVF || x == 0xF || y == 0xF ? 0 : vf, vx | vf};
+        case 0x4:
+        case 0x5:
+        case 0x6:
+        case 0x7:
+        case 0xE:
+            return {vx | vy, x == 0xF || y == 0xF ? 0 : vf, vx | vf};
+        }
+        return UNKNOWN;
+    case 0xA:
+        return {0, I_REG, I_REG};
+    case 0xB:
+        return {reg(0) | vx, 0, 0};
+    case 0xC:
+        return {0, vx, vx};
+    case 0xD:
+        return {vx | vy | I_REG, x == 0xF || y == 0xF ? 0 : vf, vf};
+    case 0xE:
+        if ((w & 0xFF) == 0x9E || (w & 0xFF) == 0xA1)
+            return {vx, 0, 0};
+        return UNKNOWN;
+    case 0xF:
+        switch (w & 0xFF) {
+        case 0x07:
+        case 0x0A:
+            return {0, vx, vx};
+        case 0x15:
+        case 0x18:
+            return {vx, 0, 0};
+        case 0x1E:
+            return {vx | I_REG, 0, I_REG};
+        case 0x29:
+            // Vx above 0xF is masked, so it may change as well
+            return {vx, I_REG, vx | I_REG};
+        case 0x30:
+            return {vx, I_REG, I_REG};
+        case 0x33:
+            return {vx | I_REG, 0, 0};
+        case 0x55:
+            return {regsTo(x) | I_REG, 0, I_REG};
+        case 0x65:
+            return {I_REG, regsTo(x), regsTo(x) | I_REG};
+        }
+        return UNKNOWN;
+    }
+    return UNKNOWN;
+}
+
+enum class Flow
+{
+    Next,
+    Skip,
+    Jump, // Also ret, jp v0 and exit: the next instruction is only reached through a label
+    Call,
+};
+
+Flow flow(uint16_t w)
+{
+    switch (w >> 12) {
+    case 0x0:
+        return w == 0x00EE || w == 0x00FD ? Flow::Jump : Flow::Next;
+    case 0x1:
+    case 0xB:
+        return Flow::Jump;
+    case 0x2:
+        return Flow::Call;
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x9:
+        return Flow::Skip;
+    case 0xE:
+        return (w & 0xFF) == 0x9E || (w & 0xFF) == 0xA1 ? Flow::Skip : Flow::Next;
+    }
+    return Flow::Next;
+}
+
+char const* invertedSkip(uint16_t w)
+{
+    switch (w >> 12) {
+    case 0x3:
+    case 0x5:
+        return "sne";
+    case 0x4:
+    case 0x9:
+        return "se";
+    case 0xE:
+        return (w & 0xFF) == 0x9E ? "sknp" : "skp";
+    }
+    return nullptr;
+}
+
+struct Line {
+    std::string_view label; // Without the colon
+    std::string_view mnemonic;
+    std::vector<std::string_view> operands;
+};
+
+Line parse(std::string_view text)
+{
+    detail::Tokenizer tokens(text);
+    Line line;
+    line.mnemonic = tokens.next();
+    if (!line.mnemonic.empty() && tokens.consume(':')) {
+        line.label = line.mnemonic;
+        line.mnemonic = tokens.next();
+    }
+    for (auto operand = tokens.next(); !operand.empty(); operand = tokens.next())
+        line.operands.push_back(operand);
+    return line;
+}
+
+std::string_view trim(std::string_view text)
+{
+    while (!text.empty() && detail::is_space(text.front()))
+        text.remove_prefix(1);
+    while (!text.empty() && detail::is_space(text.back()))
+        text.remove_suffix(1);
+    return text;
+}
+
+struct Item {
+    uint16_t address;
+    uint16_t size;
+    uint16_t word;
+    size_t line;
+    uint32_t label; // Into the map labels
+    bool data;
+    bool target;     // A label, jump or call may land here
+    bool relocated; // nnn refers to a label of the module
+};
+
+struct State {
+    std::array<std::optional<uint8_t>, 16> v;
+    std::optional<uint16_t> i;
+    std::string_view iBase; // ld i operand without its constant offset, object modules only
+    unsigned iOffset = 0;
+
+    void reset()
+    {
+        v = {};
+        i.reset();
+    }
+};
+
+struct Edit {
+    size_t item;
+    std::string text; // Replacement instruction, empty to remove it
+    uint32_t cycles;
+    uint32_t bytes;
+};
+
+struct Program {
+    std::vector<Item> items;
+    SourceMap map;
+    uint16_t base;   // Address of the first byte, the report is by address
+    bool relocatable; // Built as an object module, so every address in it comes from a label
+};
+
+// Assembles source to find what each line encodes to, nullopt with errors when it does not
+// assemble, or without errors when it can not be optimized safely
+std::optional<Program> analyze(std::string_view source, uint16_t origin,
+                               std::vector<std::string_view> const& lines,
+                               std::vector<AsmError>* errors)
+{
+    Program program;
+    std::vector<uint8_t> code;
+    std::unordered_map<uint16_t, bool> relocations; // By offset, true for imports
+
+    auto object = assembleObject(source);
+    bool absolute = !object.ok();
+    if (object.ok()) {
+        for (auto const& relocation: object.module.relocations)
+            relocations[relocation.offset] = !relocation.symbol.empty();
+        // Numeric addresses pin the layout, they would move with the code around them
+        for (size_t offset = 0; offset + 1 < object.module.code.size(); offset += 2) {
+            auto top = object.module.code[offset] >> 4;
+            if ((top == 0x1 || top == 0x2 || top == 0xA) && !relocations.count(offset))
+                absolute = true;
+        }
+    }
+
+    if (absolute) {
+        auto result = assembleSource(source, origin, &program.map);
+        if (!result.ok()) {
+            if (!object.ok() && errors)
+                *errors = std::move(result.errors);
+            return std::nullopt;
+        }
+        code = std::move(result.bytecode);
+        program.base = origin;
+        program.relocatable = false;
+        relocations.clear();
+    }
+    else {
+        code = std::move(object.module.code);
+        program.map = std::move(object.module.map);
+        program.base = 0;
+        program.relocatable = true;
+    }
+
+    std::unordered_set<uint16_t> targets;
+    for (auto const& label: program.map.labels)
+        targets.insert(label.address);
+
+    for (auto const& entry: program.map.entries) {
+        size_t offset = entry.address - program.base;
+        bool data = parse(lines[entry.line - 1]).mnemonic == "db";
+        uint16_t word = data ? 0 : code[offset] << 8 | code[offset + 1];
+
+        // Computed jumps may land anywhere
+        if (!data && (word >> 12) == 0xB)
+            return std::nullopt;
+        if (!data && !program.relocatable && ((word >> 12) == 0x1 || (word >> 12) == 0x2))
+            targets.insert(word & 0x0FFF);
+
+        // Imports are not known until link time
+        auto relocation = relocations.find(offset);
+        bool relocated = relocation != relocations.end() && !relocation->second;
+        program.items.push_back(
+            {entry.address, entry.size, word, entry.line, entry.label, data, false, relocated});
+    }
+
+    for (auto& item: program.items)
+        item.target = targets.count(item.address);
+    return program;
+}
+
+std::vector<Edit> findEdits(Program const& program, std::vector<std::string_view> const& lines,
+                            Quirks const& quirks)
+{
+    auto const& items = program.items;
+    bool resize = program.relocatable;
+
+    std::vector<Edit> edits;
+    std::vector<bool> pinned(items.size()); // Part of an edit already
+
+    auto next = [&](size_t k) -> Item const* {
+        if (k + 1 >= items.size() || items[k + 1].address != items[k].address + 2 ||
+            items[k].data || items[k + 1].data)
+            return nullptr;
+        return &items[k + 1];
+    };
+
+    State state;
+    bool skipped = false; // The previous instruction is a skip, so this one is conditional
+
+    for (size_t k = 0; k < items.size(); ++k) {
+        auto const& item = items[k];
+        bool contiguous = k > 0 && items[k - 1].address + items[k - 1].size == item.address;
+        bool conditional = skipped && contiguous;
+        skipped = false;
+
+        if (item.target || !contiguous)
+            state.reset();
+        if (item.data) {
+            state.reset();
+            continue;
+        }
+
+        uint16_t w = item.word;
+        unsigned x = (w >> 8) & 0xF;
+        unsigned y = (w >> 4) & 0xF;
+        uint8_t kk = w & 0xFF;
+        auto after = next(k);
+        bool removable = resize && !conditional && !pinned[k];
+
+        auto overwrites = [&](Item const* item, uint32_t regs) {
+            if (!item)
+                return false;
+            auto e = effect(item->word, quirks);
+            return (e.writes & regs) == regs && !(e.reads & regs);
+        };
+
+        bool dead = false; // Removed as a store nothing reads, what it would store is unknown
+        auto remove = [&](size_t index) {
+            edits.push_back({index, "", vipCycles(items[index].word), 2});
+            pinned[index] = true;
+        };
+
+        if (removable && (w & 0xF00F) == 0x8000 && x == y)
+            remove(k);
+        else if (removable && (w >> 12) == 0x6 && state.v[x] == kk)
+            remove(k);
+        else if (removable && (w & 0xF00F) == 0x8000 && state.v[x] && state.v[x] == state.v[y])
+            remove(k);
+        else if (removable && ((w >> 12) == 0x6 || (w & 0xF00F) == 0x8000) &&
+                 overwrites(after, reg(x))) {
+            remove(k);
+            dead = true;
+        }
+        else if (removable && (w >> 12) == 0xA && overwrites(after, I_REG)) {
+            remove(k);
+            dead = true;
+        }
+        else if (!pinned[k] && (w & 0xF0FF) == 0xF01E && state.i && state.v[x] &&
+                 (program.relocatable ? !state.iBase.empty() : *state.i + *state.v[x] <= 0xFFF)) {
+            std::string text;
+            if (program.relocatable) {
+                unsigned offset = state.iOffset + *state.v[x];
+                text = "ld i " + std::string(state.iBase);
+                if (offset)
+                    text += "+" + std::to_string(offset);
+            }
+            else {
+                char address[16];
+                snprintf(address, sizeof(address), "ld i 0x%03x", *state.i + *state.v[x]);
+                text = address;
+            }
+            edits.push_back({k, text, vipCycles(w) - vipCycles(0xA000), 0});
+            pinned[k] = true;
+        }
+        else if (removable && flow(w) == Flow::Skip && after && !pinned[k + 1] &&
+                 (after->word >> 12) == 0x1 && after->relocated && !after->target &&
+                 next(k + 1) && !next(k + 1)->target &&
+                 (after->word & 0x0FFF) == next(k + 1)->address + 2) {
+            // Skip over a jump over one instruction: the inverted skip over that instruction
+            auto line = parse(lines[item.line - 1]);
+            std::string text = invertedSkip(w);
+            for (auto operand: line.operands)
+                text += " " + std::string(operand);
+            edits.push_back({k, text, vipCycles(after->word), 2});
+            edits.push_back({k + 1, "", 0, 0});
+            pinned[k] = pinned[k + 1] = pinned[k + 2] = true;
+        }
+
+        // Track what the instruction leaves in the registers
+        auto e = effect(w, quirks);
+        State before = state;
+        for (unsigned r = 0; r < 16; ++r)
+            if (e.clobbers & reg(r))
+                state.v[r].reset();
+        if (e.clobbers & I_REG)
+            state.i.reset();
+
+        if (!conditional && !dead) {
+            switch (w >> 12) {
+            case 0x6:
+                state.v[x] = kk;
+                break;
+            case 0x7:
+                if (before.v[x])
+                    state.v[x] = static_cast<uint8_t>(*before.v[x] + kk);
+                break;
+            case 0x8:
+                if ((w & 0xF) == 0)
+                    state.v[x] = before.v[y];
+                break;
+            case 0xA:
+                state.i = w & 0x0FFF;
+                state.iBase = {};
+                state.iOffset = 0;
+                if (program.relocatable) {
+                    if (!item.relocated) {
+                        state.i.reset();
+                        break;
+                    }
+                    // Keep the operand text, so that a later add can be folded into it
+                    auto operand = parse(lines[item.line - 1]).operands.at(1);
+                    auto plus = operand.rfind('+');
+                    auto offset = plus == operand.npos ? std::optional<unsigned>(0)
+                                                       : detail::number(operand.substr(plus + 1));
+                    if (!offset)
+                        state.i.reset();
+                    state.iBase = operand.substr(0, plus);
+                    state.iOffset = offset.value_or(0);
+                }
+                break;
+            case 0xF:
+                if ((w & 0xFF) == 0x1E && before.i && before.v[x]) {
+                    state.i = *before.i + *before.v[x];
+                    state.iBase = before.iBase;
+                    state.iOffset = before.iOffset + *before.v[x];
+                }
+                // Whether I moves past the registers depends on the quirk
+                else if (((w & 0xFF) == 0x55 || (w & 0xFF) == 0x65) && before.i &&
+                         quirks.loadStoreIAdd) {
+                    state.i = *before.i + x + 1;
+                    state.iBase = before.iBase;
+                    state.iOffset = before.iOffset + x + 1;
+                }
+                break;
+            }
+        }
+
+        auto f = flow(w);
+        if (f == Flow::Jump || f == Flow::Call)
+            state.reset();
+        skipped = f == Flow::Skip;
+    }
+
+    return edits;
+}
+
+} // namespace
+
+uint32_t vipCycles(uint16_t w)
+{
+    switch (w >> 12) {
+    case 0x0:
+        return w == 0x00EE ? 23 : 24;
+    case 0x1:
+    case 0x2:
+    case 0xB:
+        return 23;
+    case 0x3:
+    case 0x4:
+    case 0xA:
+        return 12;
+    case 0x5:
+    case 0x9:
+    case 0xE:
+        return 16;
+    case 0x6:
+        return 6;
+    case 0x7:
+        return 10;
+    case 0x8:
+        return 44;
+    case 0xC:
+        return 36;
+    case 0xD:
+        return 5000;
+    case 0xF:
+        switch (w & 0xFF) {
+        case 0x07:
+        case 0x0A:
+        case 0x15:
+        case 0x18:
+            return 10;
+        case 0x1E:
+            return 19;
+        case 0x29:
+            return 20;
+        case 0x33:
+            return 204;
+        case 0x55:
+        case 0x65:
+            return 133;
+        }
+        return 24;
+    }
+    return 24;
+}
+
+OptimizeResult optimizeSource(std::string_view source, Quirks const& quirks, uint16_t origin)
+{
+    OptimizeResult result;
+    result.source = source;
+
+    size_t const MAX_PASSES = 8;
+    for (size_t pass = 0; pass < MAX_PASSES; ++pass) {
+        std::vector<std::string_view> lines;
+        for (std::string_view rest = result.source;;) {
+            size_t end = rest.find('\n');
+            lines.push_back(rest.substr(0, end));
+            if (end == rest.npos)
+                break;
+            rest.remove_prefix(end + 1);
+        }
+
+        auto program = analyze(result.source, origin, lines, pass ? nullptr : &result.errors);
+        if (!program)
+            break;
+
+        auto edits = findEdits(*program, lines, quirks);
+        if (edits.empty())
+            break;
+
+        std::vector<std::string> rewritten(lines.begin(), lines.end());
+        for (auto const& edit: edits) {
+            auto const& item = program->items[edit.item];
+            auto line = parse(lines[item.line - 1]);
+            std::string text;
+            if (!line.label.empty())
+                text = std::string(line.label) + ": ";
+            text += edit.text.empty() ? "; optimized out: " : edit.text + " ; optimized: ";
+            text += trim(lines[item.line - 1]);
+            rewritten[item.line - 1] = std::move(text);
+
+            if (!edit.cycles && !edit.bytes)
+                continue;
+
+            auto const& labels = program->map.labels;
+            std::string routine =
+                item.label == SourceMap::NO_LABEL ? "(start)" : labels[item.label].name;
+            auto it = std::find_if(result.routines.begin(), result.routines.end(),
+                                   [&](auto const& r) { return r.label == routine; });
+            if (it == result.routines.end()) {
+                uint16_t address = item.address + (program->relocatable ? origin : 0);
+                it = result.routines.insert(result.routines.end(), {routine, address, 0, 0, 0});
+            }
+            it->cycles += edit.cycles;
+            it->bytes += edit.bytes;
+            it->rewrites++;
+            result.cycles += edit.cycles;
+            result.bytes += edit.bytes;
+        }
+
+        std::string joined;
+        for (size_t i = 0; i < rewritten.size(); ++i) {
+            if (i)
+                joined += '\n';
+            joined += rewritten[i];
+        }
+        result.source = std::move(joined);
+    }
+
+    // Every rewrite must assemble, anything else is a bug to not pass on
+    if (result.cycles || result.bytes) {
+        auto check = assembleObject(result.source);
+        if (!check.ok() && !assembleSource(result.source, origin).ok()) {
+            result.source = source;
+            result.routines.clear();
+            result.cycles = result.bytes = 0;
+        }
+    }
+
+    std::sort(result.routines.begin(), result.routines.end(),
+              [](auto const& a, auto const& b) { return a.address < b.address; });
+    return result;
+}
+
+} // namespace chipate
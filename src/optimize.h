@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "asm.h"
+#include "chip8.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chipate {
+
+// Estimated COSMAC VIP interpreter cost of an instruction in machine cycles (8 clocks at
+// 1.76 MHz). Averages of published measurements, DRW and the memory transfers vary with
+// their operands.
+uint32_t vipCycles(uint16_t instruction);
+
+struct OptimizedRoutine {
+    std::string label; // "(start)" before the first label
+    uint16_t address;  // Of the first rewritten instruction, as assembled before the pass
+    uint32_t cycles;   // Saved on one run through every rewritten instruction
+    uint32_t bytes;
+    uint32_t rewrites;
+};
+
+struct OptimizeResult {
+    std::string source;                     // Same lines as the input, rewrites leave a comment
+    std::vector<OptimizedRoutine> routines; // Ones with rewrites, by address
+    std::vector<AsmError> errors;           // Of the input, which is returned as it is then
+    uint32_t cycles = 0;
+    uint32_t bytes = 0;
+};
+
+// Peephole pass that rewrites idioms into cheaper equivalents under quirks: loads of values a
+// register already holds or that are overwritten before use, add i of known values into ld i,
+// and skips over a jump into the inverted skip. Instructions are only removed when every address
+// in the program comes from a label, otherwise the layout is kept. Modules that import symbols
+// are analyzed as object modules, origin is used for ones that only assemble as a whole program.
+OptimizeResult optimizeSource(std::string_view source, Quirks const& quirks,
+                              uint16_t origin = 0x200);
+
+} // namespace chipate
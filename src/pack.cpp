@@ -0,0 +1,329 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "pack.h"
+
+#include "hash.h"
+#include "log.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace chipate {
+
+static_assert(std::endian::native == std::endian::little, "Packs are mapped as they are");
+
+namespace {
+
+char const MAGIC[4] = {'C', '8', 'P', 'K'};
+
+size_t align8(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+// Maps a whole file read only, an empty span on failure
+std::span<uint8_t const> mapFile(std::filesystem::path const& path)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return {};
+    LARGE_INTEGER size{};
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return {};
+    // The view keeps the mapping alive
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view)
+        return {};
+    return {static_cast<uint8_t const*>(view), static_cast<size_t>(size.QuadPart)};
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return {};
+    struct stat info{};
+    void* view = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size > 0)
+        view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (view == MAP_FAILED)
+        return {};
+    return {static_cast<uint8_t const*>(view), static_cast<size_t>(info.st_size)};
+#endif
+}
+
+void unmapFile(std::span<uint8_t const> data)
+{
+#if defined(_WIN32)
+    UnmapViewOfFile(data.data());
+#else
+    munmap(const_cast<uint8_t*>(data.data()), data.size());
+#endif
+}
+
+// Whether [offset, offset + size) lies within the file and offset is aligned to alignment
+bool inFile(std::span<uint8_t const> data, uint64_t offset, uint64_t size, size_t alignment = 1)
+{
+    return offset <= data.size() && size <= data.size() - offset && offset % alignment == 0;
+}
+
+void setFlag(PackEntry& entry, uint8_t bit, std::optional<bool> value)
+{
+    if (!value)
+        return;
+    entry.flagsSet |= bit;
+    if (*value)
+        entry.flags |= bit;
+}
+
+std::optional<bool> flag(PackEntry const& entry, uint8_t bit)
+{
+    if (!(entry.flagsSet & bit))
+        return std::nullopt;
+    return (entry.flags & bit) != 0;
+}
+
+} // namespace
+
+bool writePack(std::filesystem::path const& path, std::vector<PackRom> roms)
+{
+    std::sort(roms.begin(), roms.end(),
+              [](PackRom const& a, PackRom const& b) { return a.name < b.name; });
+    auto duplicate = std::adjacent_find(roms.begin(), roms.end(), [](auto const& a, auto const& b) {
+        return a.name == b.name;
+    });
+    if (duplicate != roms.end()) {
+        loge("Pack: %s is in there twice", duplicate->name.c_str());
+        return false;
+    }
+    auto large = std::find_if(roms.begin(), roms.end(),
+                              [](PackRom const& rom) { return rom.rom.size() > MAX_ROM_SIZE; });
+    if (large != roms.end()) {
+        loge("Pack: %s does not fit in memory", large->name.c_str());
+        return false;
+    }
+
+    std::string strings;
+    auto addString = [&](std::string const& text) {
+        auto offset = static_cast<uint32_t>(strings.size());
+        strings += text;
+        strings += '\0';
+        return offset;
+    };
+
+    std::vector<PackEntry> entries(roms.size());
+    std::vector<PackHash> hashes(roms.size());
+    std::vector<uint8_t> blob;
+    std::unordered_map<uint64_t, std::vector<size_t>> stored; // Entries by hash of their ROM
+    for (size_t i = 0; i < roms.size(); ++i) {
+        auto const& rom = roms[i];
+        auto& entry = entries[i];
+        entry.hash = fnv1a(rom.rom);
+        entry.name = addString(rom.name);
+        entry.title = addString(rom.title.empty() ? rom.name : rom.title);
+        entry.authors = addString(rom.authors);
+        entry.release = addString(rom.release);
+        entry.event = addString(rom.event);
+        entry.platform = addString(rom.platform);
+        entry.desc = addString(rom.desc);
+        entry.romSize = static_cast<uint32_t>(rom.rom.size());
+        entry.tickrate = rom.options.tickrate.value_or(0);
+        setFlag(entry, PACK_SHIFT_QUIRKS, rom.options.shiftQuirks);
+        setFlag(entry, PACK_LOAD_STORE_QUIRKS, rom.options.loadStoreQuirks);
+        setFlag(entry, PACK_JUMP_QUIRKS, rom.options.jumpQuirks);
+        setFlag(entry, PACK_LOGIC_QUIRKS, rom.options.logicQuirks);
+        setFlag(entry, PACK_CLIP_QUIRKS, rom.options.clipQuirks);
+
+        // The same game under two names is stored once
+        auto& same = stored[entry.hash];
+        auto copy = std::find_if(same.begin(), same.end(),
+                                 [&](size_t other) { return roms[other].rom == rom.rom; });
+        if (copy != same.end()) {
+            entry.romOffset = entries[*copy].romOffset;
+        }
+        else {
+            entry.romOffset = blob.size();
+            blob.insert(blob.end(), rom.rom.begin(), rom.rom.end());
+            same.push_back(i);
+        }
+
+        hashes[i] = {entry.hash, static_cast<uint32_t>(i), 0};
+    }
+    std::sort(hashes.begin(), hashes.end(), [](PackHash const& a, PackHash const& b) {
+        return std::pair(a.hash, a.entry) < std::pair(b.hash, b.entry);
+    });
+
+    PackHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = PACK_VERSION;
+    header.count = static_cast<uint32_t>(entries.size());
+    header.entries = sizeof(header);
+    header.hashes = header.entries + entries.size() * sizeof(PackEntry);
+    header.strings = header.hashes + hashes.size() * sizeof(PackHash);
+    header.stringsSize = strings.size();
+    header.roms = align8(header.strings + strings.size());
+    header.romsSize = blob.size();
+
+    FILE* file = fopen(path.string().c_str(), "wb");
+    if (!file) {
+        loge("Failed to create %s", path.string().c_str());
+        return false;
+    }
+    char const padding[8] = {};
+    bool written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(entries.data(), sizeof(PackEntry), entries.size(), file) == entries.size() &&
+        fwrite(hashes.data(), sizeof(PackHash), hashes.size(), file) == hashes.size() &&
+        fwrite(strings.data(), 1, strings.size(), file) == strings.size() &&
+        fwrite(padding, 1, header.roms - header.strings - strings.size(), file) ==
+            header.roms - header.strings - strings.size() &&
+        fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+    written = fclose(file) == 0 && written;
+    if (!written)
+        loge("Failed to write %s", path.string().c_str());
+    return written;
+}
+
+RomPack::~RomPack()
+{
+    close();
+}
+
+RomPack::RomPack(RomPack&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+RomPack& RomPack::operator=(RomPack&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        data = std::exchange(other.data, {});
+        entries = std::exchange(other.entries, {});
+        hashes = std::exchange(other.hashes, {});
+        strings = std::exchange(other.strings, {});
+        roms = std::exchange(other.roms, {});
+    }
+    return *this;
+}
+
+bool RomPack::open(std::filesystem::path const& path)
+{
+    close();
+    auto mapped = mapFile(path);
+    if (mapped.empty()) {
+        logw("Failed to map %s", path.string().c_str());
+        return false;
+    }
+
+    PackHeader header;
+    bool valid = mapped.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, mapped.data(), sizeof(header));
+        // The strings end with a NUL, so no string can run past them
+        valid = !std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) &&
+                header.version == PACK_VERSION &&
+                inFile(mapped, header.entries, uint64_t(header.count) * sizeof(PackEntry), 8) &&
+                inFile(mapped, header.hashes, uint64_t(header.count) * sizeof(PackHash), 8) &&
+                inFile(mapped, header.strings, header.stringsSize) && header.stringsSize &&
+                !mapped[header.strings + header.stringsSize - 1] &&
+                inFile(mapped, header.roms, header.romsSize);
+    }
+    if (!valid) {
+        logw("Not a ROM pack: %s", path.string().c_str());
+        unmapFile(mapped);
+        return false;
+    }
+
+    data = mapped;
+    entries = {reinterpret_cast<PackEntry const*>(data.data() + header.entries), header.count};
+    hashes = {reinterpret_cast<PackHash const*>(data.data() + header.hashes), header.count};
+    strings = {reinterpret_cast<char const*>(data.data() + header.strings), header.stringsSize};
+    roms = data.subspan(header.roms, header.romsSize);
+    return true;
+}
+
+void RomPack::close()
+{
+    if (!data.empty())
+        unmapFile(data);
+    data = {};
+    entries = {};
+    hashes = {};
+    strings = {};
+    roms = {};
+}
+
+char const* RomPack::string(uint32_t offset) const
+{
+    return offset < strings.size() ? strings.data() + offset : "";
+}
+
+std::span<uint8_t const> RomPack::rom(PackEntry const& entry) const
+{
+    if (entry.romSize > MAX_ROM_SIZE || entry.romOffset > roms.size() ||
+        entry.romSize > roms.size() - entry.romOffset)
+        return {};
+    return roms.subspan(entry.romOffset, entry.romSize);
+}
+
+OctoOptions RomPack::options(PackEntry const& entry) const
+{
+    OctoOptions options;
+    if (entry.tickrate > 0)
+        options.tickrate = entry.tickrate;
+    options.shiftQuirks = flag(entry, PACK_SHIFT_QUIRKS);
+    options.loadStoreQuirks = flag(entry, PACK_LOAD_STORE_QUIRKS);
+    options.jumpQuirks = flag(entry, PACK_JUMP_QUIRKS);
+    options.logicQuirks = flag(entry, PACK_LOGIC_QUIRKS);
+    options.clipQuirks = flag(entry, PACK_CLIP_QUIRKS);
+    return options;
+}
+
+std::optional<size_t> RomPack::find(std::string_view name) const
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), name,
+                               [&](PackEntry const& entry, std::string_view key) {
+                                   return string(entry.name) < key;
+                               });
+    if (it == entries.end() || string(it->name) != name)
+        return std::nullopt;
+    return it - entries.begin();
+}
+
+std::optional<size_t> RomPack::find(std::span<uint8_t const> rom) const
+{
+    uint64_t hash = fnv1a(rom);
+    auto it = std::lower_bound(hashes.begin(), hashes.end(), hash,
+                               [](PackHash const& entry, uint64_t key) { return entry.hash < key; });
+    for (; it != hashes.end() && it->hash == hash; ++it) {
+        if (it->entry >= entries.size())
+            continue;
+        auto stored = this->rom(entries[it->entry]);
+        if (std::equal(stored.begin(), stored.end(), rom.begin(), rom.end()))
+            return it->entry;
+    }
+    return std::nullopt;
+}
+
+} // namespace chipate
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "rom.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chipate {
+
+// A ROM library in one file, mapped rather than read so that opening it costs the same however
+// many ROMs it holds. All of it is little endian and 8 byte aligned:
+//   PackHeader
+//   PackEntry[count]   sorted by name
+//   PackHash[count]    sorted by hash, for looking ROMs up by content
+//   strings            NUL terminated, entries refer to them by offset
+//   ROMs               one after another
+struct PackHeader {
+    char magic[4]; // "C8PK"
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t entries;
+    uint64_t hashes;
+    uint64_t strings;
+    uint64_t stringsSize;
+    uint64_t roms;
+    uint64_t romsSize;
+};
+
+struct PackEntry {
+    uint64_t hash; // fnv1a() of the ROM
+    uint32_t name;
+    uint32_t title;
+    uint32_t authors;
+    uint32_t release;
+    uint32_t event;
+    uint32_t platform; // Empty when nobody said, the quirks are up to detectQuirks() then
+    uint32_t desc;
+    uint32_t romSize;
+    uint64_t romOffset; // Into the ROMs
+    int32_t tickrate;   // 0 when not given
+    uint8_t flagsSet;   // PACK_* bits of the Octo flags that are given
+    uint8_t flags;      // Their values
+    uint8_t reserved[2];
+};
+
+struct PackHash {
+    uint64_t hash;
+    uint32_t entry;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PackHeader) == 64 && sizeof(PackEntry) == 56 && sizeof(PackHash) == 16);
+
+uint32_t const PACK_VERSION = 1;
+
+// Bits of PackEntry::flagsSet and flags
+uint8_t const PACK_SHIFT_QUIRKS = 1 << 0;
+uint8_t const PACK_LOAD_STORE_QUIRKS = 1 << 1;
+uint8_t const PACK_JUMP_QUIRKS = 1 << 2;
+uint8_t const PACK_LOGIC_QUIRKS = 1 << 3;
+uint8_t const PACK_CLIP_QUIRKS = 1 << 4;
+
+// A ROM to be written into a pack, only the name and the ROM itself are required
+struct PackRom {
+    std::string name;
+    std::string title;
+    std::string authors;
+    std::string release;
+    std::string event;
+    std::string platform;
+    std::string desc;
+    OctoOptions options;
+    std::vector<uint8_t> rom;
+};
+
+// Writes a pack of roms, which must have distinct names. Identical ROMs are stored once.
+bool writePack(std::filesystem::path const& path, std::vector<PackRom> roms);
+
+// A pack mapped into memory. Its strings and ROMs are views into the mapping, valid while the
+// pack stays open.
+class RomPack {
+public:
+    RomPack() = default;
+    ~RomPack();
+    RomPack(RomPack&& other) noexcept;
+    RomPack& operator=(RomPack&& other) noexcept;
+
+    // Maps the file, false when it is missing or not a pack, leaving this one closed. Only the
+    // header is checked here, entries are checked as they are used.
+    bool open(std::filesystem::path const& path);
+    void close();
+
+    bool isOpen() const
+    {
+        return !data.empty();
+    }
+    size_t size() const
+    {
+        return entries.size();
+    }
+    PackEntry const& operator[](size_t index) const
+    {
+        return entries[index];
+    }
+
+    // Empty when the offset is out of range
+    char const* string(uint32_t offset) const;
+    // Empty when the ROM is out of range or larger than MAX_ROM_SIZE
+    std::span<uint8_t const> rom(PackEntry const& entry) const;
+    OctoOptions options(PackEntry const& entry) const;
+
+    std::optional<size_t> find(std::string_view name) const;
+    std::optional<size_t> find(std::span<uint8_t const> rom) const;
+
+private:
+    std::span<uint8_t const> data;
+    std::span<PackEntry const> entries;
+    std::span<PackHash const> hashes;
+    std::span<char const> strings;
+    std::span<uint8_t const> roms;
+};
+
+} // namespace chipate
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "profile.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <map>
+
+namespace chipate {
+
+namespace {
+
+std::string hex(uint16_t address)
+{
+    char text[8];
+    snprintf(text, sizeof(text), "0x%03x", address);
+    return text;
+}
+
+void sortByCount(std::vector<ProfileEntry>& entries)
+{
+    std::sort(entries.begin(), entries.end(), [](auto const& a, auto const& b) {
+        return a.count != b.count ? a.count > b.count : a.address < b.address;
+    });
+}
+
+void formatEntries(std::string& out, char const* title, std::vector<ProfileEntry> const& entries,
+                   uint64_t total, size_t top)
+{
+    char line[128];
+    snprintf(line, sizeof(line), "%-32s %6s %14s %7s\n", title, "addr", "count", "share");
+    out += line;
+    for (size_t i = 0; i < std::min(top, entries.size()); ++i) {
+        auto const& entry = entries[i];
+        snprintf(line, sizeof(line), "%-32.32s %6s %14llu %6.2f%%\n", entry.name.c_str(),
+                 hex(entry.address).c_str(), static_cast<unsigned long long>(entry.count),
+                 total ? 100.0 * entry.count / total : 0.0);
+        out += line;
+    }
+}
+
+template <typename T>
+bool parseNumber(std::string_view text, T& value)
+{
+    int base = 10;
+    if (text.starts_with("0x")) {
+        text.remove_prefix(2);
+        base = 16;
+    }
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    return !text.empty() && error == std::errc{} && end == text.data() + text.size();
+}
+
+// Splits off the next space separated field
+std::string_view field(std::string_view& text)
+{
+    size_t begin = text.find_first_not_of(' ');
+    if (begin == text.npos) {
+        text = {};
+        return {};
+    }
+    size_t end = text.find(' ', begin);
+    auto value = text.substr(begin, end - begin);
+    text = end == text.npos ? std::string_view{} : text.substr(end);
+    return value;
+}
+
+} // namespace
+
+Profile buildProfile(std::span<uint64_t const> counts, SourceMap const* map)
+{
+    Profile profile;
+
+    std::map<size_t, uint64_t> lines;    // By entry index
+    std::map<uint64_t, uint64_t> labels; // By label index, files without a label after them
+
+    for (size_t address = 0; address < counts.size(); ++address) {
+        uint64_t count = counts[address];
+        if (!count)
+            continue;
+        profile.total += count;
+
+        if (!map) {
+            profile.lines.push_back({hex(address), static_cast<uint16_t>(address), count});
+            continue;
+        }
+
+        auto entry = map->find(address);
+        if (!entry) {
+            profile.unmapped += count;
+            continue;
+        }
+        lines[entry - map->entries.data()] += count;
+        labels[entry->label != SourceMap::NO_LABEL ? entry->label
+                                                   : map->labels.size() + entry->file] += count;
+    }
+
+    for (auto [index, count]: lines) {
+        auto const& entry = map->entries[index];
+        auto const& file = map->files[entry.file];
+        auto name = (file.empty() ? "line " : file + ":") + std::to_string(entry.line);
+        profile.lines.push_back({std::move(name), entry.address, count});
+    }
+
+    for (auto [index, count]: labels) {
+        if (index < map->labels.size()) {
+            auto const& label = map->labels[index];
+            profile.routines.push_back({label.name, label.address, count});
+            continue;
+        }
+        // Code before the first label of a file, starting where the file starts
+        uint32_t file = index - map->labels.size();
+        auto first = std::find_if(map->entries.begin(), map->entries.end(),
+                                  [file](auto const& e) { return e.file == file; });
+        auto const& name = map->files[file];
+        profile.routines.push_back({"(" + (name.empty() ? "start" : name) + ")", first->address,
+                                    count});
+    }
+
+    sortByCount(profile.lines);
+    sortByCount(profile.routines);
+    return profile;
+}
+
+std::string formatProfile(Profile const& profile, size_t top)
+{
+    std::string out;
+    if (!profile.routines.empty()) {
+        formatEntries(out, "routine", profile.routines, profile.total, top);
+        out += '\n';
+    }
+    formatEntries(out, profile.routines.empty() ? "address" : "line", profile.lines,
+                  profile.total, top);
+
+    if (profile.unmapped) {
+        char line[128];
+        snprintf(line, sizeof(line), "%llu instructions outside the source map\n",
+                 static_cast<unsigned long long>(profile.unmapped));
+        out += line;
+    }
+    return out;
+}
+
+std::string formatSourceMap(SourceMap const& map)
+{
+    std::string out = "; chipate source map: address size file line label\n";
+    char line[96];
+
+    for (auto const& file: map.files)
+        out += "file " + file + "\n";
+    for (auto const& label: map.labels)
+        out += "label " + label.name + " " + hex(label.address) + "\n";
+
+    for (auto const& entry: map.entries) {
+        snprintf(line, sizeof(line), "%s %u %u %u ", hex(entry.address).c_str(), entry.size,
+                 entry.file, entry.line);
+        out += line;
+        out += entry.label == SourceMap::NO_LABEL ? "-" : std::to_string(entry.label);
+        out += '\n';
+    }
+    return out;
+}
+
+std::optional<SourceMap> parseSourceMap(std::string_view text)
+{
+    SourceMap map;
+
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        auto line = text.substr(0, end);
+        text = end == text.npos ? std::string_view{} : text.substr(end + 1);
+
+        if (line.empty() || line[0] == ';')
+            continue;
+
+        if (line.starts_with("file ")) {
+            map.files.emplace_back(line.substr(5));
+            continue;
+        }
+
+        auto kind = field(line);
+        if (kind == "label") {
+            SourceMap::Label label{std::string(field(line)), 0};
+            if (label.name.empty() || !parseNumber(field(line), label.address))
+                return std::nullopt;
+            map.labels.push_back(std::move(label));
+            continue;
+        }
+
+        SourceMap::Entry entry{};
+        if (!parseNumber(kind, entry.address) || !parseNumber(field(line), entry.size) ||
+            !parseNumber(field(line), entry.file) || !parseNumber(field(line), entry.line))
+            return std::nullopt;
+        auto label = field(line);
+        if (label == "-")
+            entry.label = SourceMap::NO_LABEL;
+        else if (!parseNumber(label, entry.label) || entry.label >= map.labels.size())
+            return std::nullopt;
+        if (entry.file >= map.files.size())
+            return std::nullopt;
+        map.entries.push_back(entry);
+    }
+
+    std::sort(map.entries.begin(), map.entries.end(),
+              [](auto const& a, auto const& b) { return a.address < b.address; });
+    return map;
+}
+
+} // namespace chipate
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "asm.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chipate {
+
+struct ProfileEntry {
+    std::string name; // Label, "file:line", or the address without a source map
+    uint16_t address; // Of the label or the first instruction of the line
+    uint64_t count;
+};
+
+// Execution counts by address, from Chip8::pcCounts(), aggregated onto source lines and the
+// labels enclosing them
+struct Profile {
+    uint64_t total = 0;
+    uint64_t unmapped = 0;              // Executed at addresses the map does not cover
+    std::vector<ProfileEntry> routines; // By label, hottest first
+    std::vector<ProfileEntry> lines;    // Hottest first, by address without a map
+};
+
+Profile buildProfile(std::span<uint64_t const> counts, SourceMap const* map = nullptr);
+
+// Table of the top routines and lines with their share of all instructions executed
+std::string formatProfile(Profile const& profile, size_t top = 20);
+
+// Text form of a map, as chipate-asm --map writes it
+std::string formatSourceMap(SourceMap const& map);
+std::optional<SourceMap> parseSourceMap(std::string_view text);
+
+} // namespace chipate
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "rom.h"
+
+#include "log.h"
+
+#include <cstdio>
+
+namespace chipate {
+
+std::vector<uint8_t> readRom(std::string const& path)
+{
+    std::vector<uint8_t> romData;
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        loge("Failed to open ROM file: %s", path.c_str());
+        return {};
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    romData.resize(fileSize);
+    if (fread(romData.data(), 1, fileSize, file) != static_cast<size_t>(fileSize)) {
+        loge("Failed to read ROM file: %s", path.c_str());
+        romData.clear();
+    }
+    fclose(file);
+
+    return romData;
+}
+
+RomProfile romProfile(std::string_view platform, OctoOptions const& options)
+{
+    RomProfile profile;
+    if (platform == "schip")
+        profile.quirks = SCHIP_1_0_QUIRKS;
+    else if (platform != "chip8")
+        profile.quirks = SCHIP_MODERN_QUIRKS;
+
+    if (options.tickrate && *options.tickrate > 0)
+        profile.tickRate = *options.tickrate;
+    if (options.shiftQuirks)
+        profile.quirks.shiftVxOnly = *options.shiftQuirks;
+    if (options.loadStoreQuirks)
+        profile.quirks.loadStoreIAdd = !*options.loadStoreQuirks;
+    if (options.jumpQuirks)
+        profile.quirks.jumpWithVx = *options.jumpQuirks;
+    if (options.logicQuirks)
+        profile.quirks.logicNoVF = !*options.logicQuirks;
+    if (options.clipQuirks)
+        profile.quirks.spriteWrap = !*options.clipQuirks;
+
+    return profile;
+}
+
+} // namespace chipate
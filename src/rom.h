@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "chip8.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chipate {
+
+int const DEFAULT_TICK_RATE = 10; // Instructions per frame when a ROM does not say
+
+// The options chip8archive lists per program in programs.json, in Octo's terms. The quirk flags
+// name the behaviour of the original interpreters they turn off.
+struct OctoOptions {
+    std::optional<int> tickrate;
+    std::optional<bool> shiftQuirks;     // Shifts only use Vx
+    std::optional<bool> loadStoreQuirks; // Fx55/Fx65 leave I alone
+    std::optional<bool> jumpQuirks;      // Bnnn jumps with Vx
+    std::optional<bool> logicQuirks;     // 8xy1-8xy3 reset VF
+    std::optional<bool> clipQuirks;      // Sprites clip at the screen edges
+};
+
+// How a ROM wants to run
+struct RomProfile {
+    Quirks quirks;
+    int tickRate = DEFAULT_TICK_RATE;
+};
+
+// The preset of the platform with the options that are given applied over it
+RomProfile romProfile(std::string_view platform, OctoOptions const& options);
+
+// Reads a whole ROM file, returns an empty vector on failure
+std::vector<uint8_t> readRom(std::string const& path);
+
+} // namespace chipate
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "scheduler.h"
+
+#include <algorithm>
+
+using namespace chipate;
+
+Scheduler::Scheduler(size_t threads, size_t sliceCycles)
+    : sliceCycles(std::max<size_t>(sliceCycles, 1))
+{
+    // The thread calling frame() drains the ready queue too
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back([this](std::stop_token stop) { worker(stop); });
+}
+
+Scheduler::~Scheduler()
+{
+    for (auto& w: workers)
+        w.request_stop();
+    wake.notify_all();
+    workers.clear();
+
+    for (auto& slot: slots)
+        slot->task.handle.destroy();
+}
+
+size_t Scheduler::add(Chip8& machine, size_t cyclesPerFrame)
+{
+    auto slot = std::make_unique<Slot>(Slot{.machine = &machine,
+                                            .cyclesPerFrame = cyclesPerFrame,
+                                            .used = 0,
+                                            .task = {},
+                                            .queue = Queue::NextFrame,
+                                            .parked = {}});
+    slot->task = machineLoop(*slot);
+    slot->parked = slot->task.handle;
+
+    std::lock_guard lock(mutex);
+    nextFrame.push_back(slot.get());
+    slots.push_back(std::move(slot));
+    return slots.size() - 1;
+}
+
+void Scheduler::setKey(size_t id, int key, bool pressed)
+{
+    auto& slot = *slots[id];
+    slot.machine->setKey(key, pressed);
+
+    std::lock_guard lock(mutex);
+    if (slot.queue == Queue::Key && !slot.machine->waitingForKey()) {
+        slot.queue = Queue::NextFrame;
+        nextFrame.push_back(&slot);
+    }
+}
+
+size_t Scheduler::waitingForKey() const
+{
+    std::lock_guard lock(mutex);
+    return std::count_if(slots.begin(), slots.end(),
+                         [](auto const& slot) { return slot->queue == Queue::Key; });
+}
+
+void Scheduler::frame()
+{
+    {
+        std::lock_guard lock(mutex);
+        for (auto& slot: slots)
+            slot->used = 0;
+        for (auto* slot: nextFrame) {
+            slot->queue = Queue::Ready;
+            ready.push_back(slot->parked);
+        }
+        nextFrame.clear();
+    }
+    wake.notify_all();
+
+    drain();
+
+    {
+        std::unique_lock lock(mutex);
+        idle.wait(lock, [this] { return ready.empty() && running == 0; });
+    }
+
+    for (auto& slot: slots)
+        slot->machine->tock();
+}
+
+Scheduler::Task Scheduler::machineLoop(Slot& slot)
+{
+    for (;;) {
+        auto result = slot.machine->run(std::min(sliceCycles, slot.cyclesPerFrame - slot.used));
+        slot.used += result.cycles;
+
+        if (result.reason == StopReason::KeyWait)
+            co_await Park{*this, slot, Queue::Key};
+        else if (result.reason == StopReason::VBlank || slot.used >= slot.cyclesPerFrame ||
+                 !result.cycles)
+            co_await Park{*this, slot, Queue::NextFrame};
+        else
+            co_await Park{*this, slot, Queue::Ready};
+    }
+}
+
+void Scheduler::park(Slot& slot, std::coroutine_handle<> handle, Queue queue)
+{
+    std::lock_guard lock(mutex);
+
+    slot.parked = handle;
+    slot.queue = queue;
+
+    switch (queue) {
+    case Queue::Ready:
+        ready.push_back(handle);
+        wake.notify_one();
+        break;
+    case Queue::NextFrame:
+        nextFrame.push_back(&slot);
+        break;
+    case Queue::Key:
+        // Stays parked in its slot until setKey() releases it
+        break;
+    }
+}
+
+void Scheduler::drain()
+{
+    std::unique_lock lock(mutex);
+
+    while (!ready.empty()) {
+        auto handle = ready.front();
+        ready.pop_front();
+        running++;
+
+        lock.unlock();
+        handle.resume();
+        lock.lock();
+
+        if (--running == 0 && ready.empty())
+            idle.notify_all();
+    }
+}
+
+void Scheduler::worker(std::stop_token stop)
+{
+    std::unique_lock lock(mutex);
+
+    while (wake.wait(lock, stop, [this] { return !ready.empty(); })) {
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include "chip8.h"
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chipate {
+
+// Cooperative scheduler multiplexing many machines onto a few threads.
+//
+// Every machine runs as a coroutine that executes slices of its frame budget and suspends
+// when it has to wait: on Fx0A until a key arrives, after DRW until the next frame, or
+// when the slice is spent. Only ready machines are resumed, so idle machines cost nothing.
+class Scheduler {
+public:
+    explicit Scheduler(size_t threads = 1, size_t sliceCycles = 64);
+    ~Scheduler();
+
+    Scheduler(Scheduler const&) = delete;
+    Scheduler& operator=(Scheduler const&) = delete;
+
+    // The machine is not owned and must outlive the scheduler. Returns the machine id.
+    // Machines are only touched from inside frame(), add() and setKey() go in between frames.
+    size_t add(Chip8& machine, size_t cyclesPerFrame);
+
+    // Forward a key event, waking the machine up on the next frame if it was waiting for it
+    void setKey(size_t id, int key, bool pressed);
+
+    // Run every ready machine until it waits or spends its frame budget, then tock all of them
+    void frame();
+
+    size_t size() const
+    {
+        return slots.size();
+    }
+    size_t waitingForKey() const;
+
+private:
+    struct Task {
+        struct promise_type {
+            Task get_return_object()
+            {
+                return {std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+            std::suspend_always final_suspend() noexcept
+            {
+                return {};
+            }
+            void return_void()
+            {}
+            void unhandled_exception()
+            {
+                std::terminate();
+            }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    enum class Queue
+    {
+        Ready,     // Resume during the current frame
+        NextFrame, // Resume after the next tock()
+        Key        // Resume once setKey() released the key wait
+    };
+
+    struct Slot {
+        Chip8* machine;
+        size_t cyclesPerFrame;
+        size_t used;
+        Task task;
+        Queue queue;
+        std::coroutine_handle<> parked;
+    };
+
+    struct Park {
+        Scheduler& scheduler;
+        Slot& slot;
+        Queue queue;
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            scheduler.park(slot, handle, queue);
+        }
+        void await_resume() const noexcept
+        {}
+    };
+
+    Task machineLoop(Slot& slot);
+    void park(Slot& slot, std::coroutine_handle<> handle, Queue queue);
+    void drain();
+    void worker(std::stop_token stop);
+
+    size_t sliceCycles;
+    std::vector<std::unique_ptr<Slot>> slots;
+
+    mutable std::mutex mutex;
+    std::condition_variable_any wake;
+    std::condition_variable idle;
+    std::deque<std::coroutine_handle<>> ready;
+    std::vector<Slot*> nextFrame;
+    size_t running = 0;
+
+    std::vector<std::jthread> workers;
+};
+
+} // namespace chipate
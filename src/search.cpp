@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "search.h"
+
+#include <algorithm>
+#include <cctype>
+#include <utility>
+
+namespace chipate {
+
+namespace {
+
+// Lower case letters and digits, anything else becomes a single space
+std::string normalize(std::string_view text)
+{
+    std::string normal;
+    normal.reserve(text.size());
+    for (unsigned char c: text) {
+        if (std::isalnum(c))
+            normal += static_cast<char>(std::tolower(c));
+        else if (!normal.empty() && normal.back() != ' ')
+            normal += ' ';
+    }
+    if (!normal.empty() && normal.back() == ' ')
+        normal.pop_back();
+    return normal;
+}
+
+// Distinct trigrams of the text padded with a space on either side, so word starts and ends
+// count as well
+std::vector<uint32_t> trigrams(std::string const& normal)
+{
+    std::string padded = ' ' + normal + ' ';
+    std::vector<uint32_t> result;
+    for (size_t i = 0; i + 3 <= padded.size(); ++i)
+        result.push_back(static_cast<uint8_t>(padded[i]) << 16 |
+                         static_cast<uint8_t>(padded[i + 1]) << 8 |
+                         static_cast<uint8_t>(padded[i + 2]));
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+} // namespace
+
+uint32_t TrigramIndex::add(std::string_view text)
+{
+    auto id = static_cast<uint32_t>(texts.size());
+    texts.push_back(normalize(text));
+    scores.push_back(0);
+    for (uint32_t trigram: trigrams(texts.back()))
+        postings[trigram].push_back(id);
+    return id;
+}
+
+void TrigramIndex::clear()
+{
+    texts.clear();
+    postings.clear();
+    scores.clear();
+}
+
+void TrigramIndex::search(std::string_view query, std::vector<uint32_t>& ids) const
+{
+    ids.clear();
+    auto normal = normalize(query);
+    if (normal.empty()) {
+        for (uint32_t id = 0; id < texts.size(); ++id)
+            ids.push_back(id);
+        return;
+    }
+    if (normal.size() < 3) {
+        for (uint32_t id = 0; id < texts.size(); ++id)
+            if (texts[id].find(normal) != std::string::npos)
+                ids.push_back(id);
+        return;
+    }
+
+    // Counts the query trigrams of every title that has any, ids collects those titles
+    auto wanted = trigrams(normal);
+    for (uint32_t trigram: wanted) {
+        auto posting = postings.find(trigram);
+        if (posting == postings.end())
+            continue;
+        for (uint32_t id: posting->second)
+            if (scores[id]++ == 0)
+                ids.push_back(id);
+    }
+
+    size_t threshold = (wanted.size() + 2) / 3;
+    std::vector<std::pair<uint16_t, uint32_t>> matches;
+    for (uint32_t id: ids) {
+        if (scores[id] >= threshold)
+            matches.emplace_back(scores[id], id);
+        scores[id] = 0;
+    }
+    std::sort(matches.begin(), matches.end(), [](auto const& a, auto const& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    ids.clear();
+    for (auto const& match: matches)
+        ids.push_back(match.second);
+}
+
+} // namespace chipate
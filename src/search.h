@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: WTFPL
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace chipate {
+
+// Fuzzy search over titles by the sequences of three letters they share with the query. Case,
+// punctuation and spacing are ignored, and a title matches when it has at least a third of the
+// query's trigrams, so typos and words in another order still find it.
+class TrigramIndex {
+public:
+    // Ids are handed out in order from 0
+    uint32_t add(std::string_view text);
+    void clear();
+    size_t size() const
+    {
+        return texts.size();
+    }
+
+    // Ids matching query, best first and otherwise in order. Every id for an empty query, and for
+    // queries too short for a trigram the titles containing them.
+    void search(std::string_view query, std::vector<uint32_t>& ids) const;
+
+private:
+    std::vector<std::string> texts; // Normalized
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings; // Ids by trigram, ascending
+    mutable std::vector<uint16_t> scores;                         // By id, kept zeroed
+};
+
+} // namespace chipate
@@ -0,0 +1,49 @@
+; Exercise ROM for the ahead-of-time translator tests, assembled into aot.ch8
+; Runs forever drawing digits while mixing translated, interpreted and self-modified code
+
+        ld v0 0x00          ; 200
+        ld v1 0x00          ; 202
+        ld v2 0x07          ; 204
+        call 0x240          ; 206 loop: compute
+        ld f v2             ; 208
+        drw v0 v1 0x5       ; 20a
+        add v0 0x05         ; 20c
+        se v0 0x3c          ; 20e
+        jp 0x206            ; 210
+        ld v0 0x00          ; 212
+        add v1 0x06         ; 214
+        sne v1 0x1e         ; 216
+        ld v1 0x00          ; 218 patched by the subroutine
+        skp v3              ; 21a
+        jp v0 0x21e         ; 21c lands on code the translator never saw
+        ld v4 0x99          ; 21e
+        ld dt v2            ; 220
+        ld v5 dt            ; 222
+        jp 0x206            ; 224
+        db 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00
+        db 00 00 00 00 00 00 00 00 00 00
+        ld v3 v2            ; 240 compute
+        add v2 0x03         ; 242
+        ld v6 0x0f          ; 244
+        and v2 v6           ; 246
+        or v3 v6            ; 248
+        xor v3 v2           ; 24a
+        add v3 v2           ; 24c
+        sub v3 v6           ; 24e
+        subn v3 v2          ; 250
+        shr v3              ; 252
+        shl v3              ; 254
+        se v3 v2            ; 256
+        ld v7 0x01          ; 258
+        sne v3 v2           ; 25a
+        ld v8 0x02          ; 25c
+        ld i 0x300          ; 25e
+        ld b v3             ; 260
+        add i v3            ; 262
+        ld i 0x310          ; 264
+        ld [i] vf           ; 266
+        ld i 0x310          ; 268
+        ld vf [i]           ; 26a
+        ld i 0x219          ; 26c
+        ld [i] v0           ; 26e rewrites the immediate of 218
+        ret                 ; 270
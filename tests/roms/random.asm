@@ -0,0 +1,11 @@
+; ROM for the chipate-run test that runs must repeat, assembled into random.ch8
+; Draws random digits at random places forever
+
+        cls
+loop:
+        rnd v0 0x3F
+        rnd v1 0x1F
+        rnd v2 0x0F
+        ld f v2
+        drw v0 v1 5
+        jp loop
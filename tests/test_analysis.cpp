@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "analysis.h"
+#include "asm.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+std::vector<uint8_t> sample()
+{
+    return assembleCached(R"(
+        ld v0 0x00          ; 200
+        call 0x20c          ; 202
+        ld i 0x214          ; 204
+        drw v0 v1 0x4       ; 206
+        add v0 0x01         ; 208
+        jp 0x202            ; 20a
+        add v1 0x01         ; 20c
+        sne v1 0x10         ; 20e
+        ld v1 0x00          ; 210
+        ret                 ; 212
+        db f0 90 90 f0      ; 214
+        db 12 34            ; 218
+    )");
+}
+
+} // namespace
+
+TEST_CASE("Analysis: basic blocks", "[analysis]")
+{
+    auto analysis = analyze(sample());
+
+    REQUIRE(analysis.blocks.size() == 6);
+
+    auto const& call = analysis.blocks.at(0x202);
+    REQUIRE(call.exit == Exit::Call);
+    REQUIRE(call.successors == std::vector<uint16_t>{0x20c, 0x204});
+
+    auto const& loop = analysis.blocks.at(0x204);
+    REQUIRE(loop.end == 0x20c);
+    REQUIRE(loop.exit == Exit::Jump);
+    REQUIRE(loop.successors == std::vector<uint16_t>{0x202});
+
+    auto const& skip = analysis.blocks.at(0x20c);
+    REQUIRE(skip.exit == Exit::Skip);
+    REQUIRE(skip.successors == std::vector<uint16_t>{0x210, 0x212});
+
+    REQUIRE(analysis.blocks.at(0x210).exit == Exit::Fallthrough);
+    REQUIRE(analysis.blocks.at(0x212).exit == Exit::Return);
+
+    REQUIRE(analysis.blockAt(0x208) == &loop);
+    REQUIRE(analysis.blockAt(0x214) == nullptr);
+}
+
+TEST_CASE("Analysis: code, sprites and unknown bytes", "[analysis]")
+{
+    auto analysis = analyze(sample());
+
+    REQUIRE(analysis.byteClass(0x200) == ByteClass::Code);
+    REQUIRE(analysis.byteClass(0x213) == ByteClass::Code);
+    for (uint16_t a = 0x214; a < 0x218; ++a)
+        REQUIRE(analysis.byteClass(a) == ByteClass::Sprite);
+    REQUIRE(analysis.byteClass(0x218) == ByteClass::Unknown);
+    REQUIRE(analysis.byteClass(0x100) == ByteClass::Unknown);
+}
+
+TEST_CASE("Analysis: subroutines and loops", "[analysis]")
+{
+    auto analysis = analyze(sample());
+
+    REQUIRE(analysis.subroutines.size() == 2);
+
+    auto main = analysis.subroutine(0x200);
+    REQUIRE(main);
+    REQUIRE(!main->returns);
+    REQUIRE(main->blocks == std::vector<uint16_t>{0x200, 0x202, 0x204});
+
+    auto sub = analysis.subroutine(0x20c);
+    REQUIRE(sub);
+    REQUIRE(sub->returns);
+    REQUIRE(sub->low == 0x20c);
+    REQUIRE(sub->high == 0x214);
+    REQUIRE(sub->blocks == std::vector<uint16_t>{0x20c, 0x210, 0x212});
+
+    REQUIRE(analysis.loops.size() == 1);
+    REQUIRE(analysis.loops[0].header == 0x202);
+    REQUIRE(analysis.loops[0].latch == 0x204);
+}
+
+TEST_CASE("Analysis: jump tables follow the range of V0", "[analysis]")
+{
+    auto table = assembleCached(R"(
+        rnd v0 0x06     ; 200 one of 0, 2, 4, 6
+        jp v0 0x204     ; 202
+        jp 0x20c        ; 204
+        jp 0x20e        ; 206
+        jp 0x210        ; 208
+        jp 0x212        ; 20a
+        cls             ; 20c
+        cls             ; 20e
+        cls             ; 210
+        jp 0x200        ; 212
+    )");
+
+    auto analysis = analyze(table);
+    auto const& indirect = analysis.blocks.at(0x200);
+    REQUIRE(indirect.exit == Exit::Indirect);
+    REQUIRE(indirect.resolved);
+    REQUIRE(indirect.successors == std::vector<uint16_t>{0x204, 0x206, 0x208, 0x20a});
+    REQUIRE(analysis.byteClass(0x210) == ByteClass::Code);
+
+    // V0 unknown at the jump
+    auto unknown = assembleCached("jp v0 0x204\ncls");
+    auto unresolved = analyze(unknown);
+    REQUIRE(unresolved.blocks.at(0x200).exit == Exit::Indirect);
+    REQUIRE(!unresolved.blocks.at(0x200).resolved);
+    REQUIRE(unresolved.byteClass(0x202) == ByteClass::Unknown);
+}
+
+TEST_CASE("Analysis: results are cached per ROM", "[analysis]")
+{
+    auto program = sample();
+    auto first = analyzeCached(program);
+    auto second = analyzeCached(sample());
+    REQUIRE(first == second);
+    REQUIRE(first->hash == analyze(program).hash);
+
+    auto other = program;
+    other[1] = 0x01;
+    REQUIRE(analyzeCached(other) != first);
+}
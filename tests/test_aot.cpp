@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "aot.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+using namespace chipate;
+
+// The program linked into the tests is tests/roms/aot.ch8, see aot.asm next to it
+
+namespace {
+
+std::vector<uint8_t> romOf(AotProgram const& program)
+{
+    return {program.rom.begin(), program.rom.end()};
+}
+
+void requireSameState(Chip8& a, Chip8& b)
+{
+    REQUIRE(AotAccess::PC(a) == AotAccess::PC(b));
+    REQUIRE(AotAccess::I(a) == AotAccess::I(b));
+    REQUIRE(AotAccess::V(a) == AotAccess::V(b));
+    REQUIRE(AotAccess::delayTimer(a) == AotAccess::delayTimer(b));
+    REQUIRE(AotAccess::memory(a) == AotAccess::memory(b));
+    REQUIRE(a.fb() == b.fb());
+}
+
+} // namespace
+
+TEST_CASE("AOT: translated program matches the interpreter", "[aot]")
+{
+    auto const& program = aotProgram();
+    REQUIRE(!program.blocks.empty());
+
+    Chip8 translated;
+    Chip8 interpreted;
+    translated.init(romOf(program));
+    interpreted.init(romOf(program));
+
+    // Odd budgets make blocks straddle the end of a run and take the interpreter path
+    for (size_t call = 0; call < 4000; ++call) {
+        size_t budget = 1 + call % 13;
+
+        if (call % 97 == 0) {
+            translated.setKey(call % 16, call % 194 == 0);
+            interpreted.setKey(call % 16, call % 194 == 0);
+        }
+
+        auto a = runAot(translated, program, budget);
+        auto b = interpreted.run(budget);
+        REQUIRE(a.cycles == b.cycles);
+        REQUIRE(a.reason == b.reason);
+        requireSameState(translated, interpreted);
+
+        if (a.reason == StopReason::VBlank || call % 5 == 0) {
+            translated.tock();
+            interpreted.tock();
+        }
+    }
+}
+
+TEST_CASE("AOT: frames match the interpreter", "[aot]")
+{
+    auto const& program = aotProgram();
+
+    Chip8 translated;
+    Chip8 interpreted;
+    translated.init(romOf(program));
+    interpreted.init(romOf(program));
+
+    for (int frame = 0; frame < 600; ++frame) {
+        REQUIRE(frameAot(translated, program, 20) == interpreted.frame(20));
+        requireSameState(translated, interpreted);
+    }
+}
+
+TEST_CASE("AOT: breakpoints inside a block stop the run", "[aot]")
+{
+    auto const& program = aotProgram();
+
+    Chip8 chip8;
+    chip8.init(romOf(program));
+
+    // 0x244 is in the middle of the subroutine block starting at 0x240
+    chip8.setBreakpoint(0x244);
+
+    auto result = runAot(chip8, program, 100);
+    REQUIRE(result.reason == StopReason::Breakpoint);
+    REQUIRE(AotAccess::PC(chip8) == 0x244);
+}
@@ -1,15 +1,21 @@
 // SPDX-License-Identifier: WTFPL
 
 #include "asm.h"
+#include "asm_ct.h"
 
+#include <algorithm>
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/reporters/catch_reporter_event_listener.hpp>
+#include <catch2/reporters/catch_reporter_registrars.hpp>
+#include <cstdio>
+#include <filesystem>
 #include <vector>
 
 using namespace chipate;
 
 TEST_CASE("Assembly: CLS instruction", "[asm]")
 {
-    auto bytecode = assemble("cls");
+    auto bytecode = assembleCached("cls");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x00);
     REQUIRE(bytecode[1] == 0xE0);
@@ -17,7 +23,7 @@ TEST_CASE("Assembly: CLS instruction", "[asm]")
 
 TEST_CASE("Assembly: RET instruction", "[asm]")
 {
-    auto bytecode = assemble("ret");
+    auto bytecode = assembleCached("ret");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x00);
     REQUIRE(bytecode[1] == 0xEE);
@@ -25,7 +31,7 @@ TEST_CASE("Assembly: RET instruction", "[asm]")
 
 TEST_CASE("Assembly: JP with address", "[asm]")
 {
-    auto bytecode = assemble("jp 0x200");
+    auto bytecode = assembleCached("jp 0x200");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x12);
     REQUIRE(bytecode[1] == 0x00);
@@ -33,7 +39,7 @@ TEST_CASE("Assembly: JP with address", "[asm]")
 
 TEST_CASE("Assembly: JP with V0 offset", "[asm]")
 {
-    auto bytecode = assemble("jp v0 0x300");
+    auto bytecode = assembleCached("jp v0 0x300");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xB3);
     REQUIRE(bytecode[1] == 0x00);
@@ -41,7 +47,7 @@ TEST_CASE("Assembly: JP with V0 offset", "[asm]")
 
 TEST_CASE("Assembly: CALL instruction", "[asm]")
 {
-    auto bytecode = assemble("call 0x400");
+    auto bytecode = assembleCached("call 0x400");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x24);
     REQUIRE(bytecode[1] == 0x00);
@@ -49,7 +55,7 @@ TEST_CASE("Assembly: CALL instruction", "[asm]")
 
 TEST_CASE("Assembly: SE register with byte", "[asm]")
 {
-    auto bytecode = assemble("se v5 0x42");
+    auto bytecode = assembleCached("se v5 0x42");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x35);
     REQUIRE(bytecode[1] == 0x42);
@@ -57,7 +63,7 @@ TEST_CASE("Assembly: SE register with byte", "[asm]")
 
 TEST_CASE("Assembly: SE register with register", "[asm]")
 {
-    auto bytecode = assemble("se v3 v7");
+    auto bytecode = assembleCached("se v3 v7");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x53);
     REQUIRE(bytecode[1] == 0x70);
@@ -65,7 +71,7 @@ TEST_CASE("Assembly: SE register with register", "[asm]")
 
 TEST_CASE("Assembly: SNE register with byte", "[asm]")
 {
-    auto bytecode = assemble("sne va 0xFF");
+    auto bytecode = assembleCached("sne va 0xFF");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x4A);
     REQUIRE(bytecode[1] == 0xFF);
@@ -73,7 +79,7 @@ TEST_CASE("Assembly: SNE register with byte", "[asm]")
 
 TEST_CASE("Assembly: SNE register with register", "[asm]")
 {
-    auto bytecode = assemble("sne v2 v8");
+    auto bytecode = assembleCached("sne v2 v8");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x92);
     REQUIRE(bytecode[1] == 0x80);
@@ -81,7 +87,7 @@ TEST_CASE("Assembly: SNE register with register", "[asm]")
 
 TEST_CASE("Assembly: LD register with byte", "[asm]")
 {
-    auto bytecode = assemble("ld v0 0x05");
+    auto bytecode = assembleCached("ld v0 0x05");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x60);
     REQUIRE(bytecode[1] == 0x05);
@@ -89,7 +95,7 @@ TEST_CASE("Assembly: LD register with byte", "[asm]")
 
 TEST_CASE("Assembly: LD register with register", "[asm]")
 {
-    auto bytecode = assemble("ld v4 v9");
+    auto bytecode = assembleCached("ld v4 v9");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x84);
     REQUIRE(bytecode[1] == 0x90);
@@ -97,7 +103,7 @@ TEST_CASE("Assembly: LD register with register", "[asm]")
 
 TEST_CASE("Assembly: LD I with address", "[asm]")
 {
-    auto bytecode = assemble("ld i 0x208");
+    auto bytecode = assembleCached("ld i 0x208");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xA2);
     REQUIRE(bytecode[1] == 0x08);
@@ -105,7 +111,7 @@ TEST_CASE("Assembly: LD I with address", "[asm]")
 
 TEST_CASE("Assembly: LD register from DT", "[asm]")
 {
-    auto bytecode = assemble("ld v3 dt");
+    auto bytecode = assembleCached("ld v3 dt");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xF3);
     REQUIRE(bytecode[1] == 0x07);
@@ -113,7 +119,7 @@ TEST_CASE("Assembly: LD register from DT", "[asm]")
 
 TEST_CASE("Assembly: LD DT from register", "[asm]")
 {
-    auto bytecode = assemble("ld dt v6");
+    auto bytecode = assembleCached("ld dt v6");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xF6);
     REQUIRE(bytecode[1] == 0x15);
@@ -121,7 +127,7 @@ TEST_CASE("Assembly: LD DT from register", "[asm]")
 
 TEST_CASE("Assembly: LD ST from register", "[asm]")
 {
-    auto bytecode = assemble("ld st v7");
+    auto bytecode = assembleCached("ld st v7");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xF7);
     REQUIRE(bytecode[1] == 0x18);
@@ -129,7 +135,7 @@ TEST_CASE("Assembly: LD ST from register", "[asm]")
 
 TEST_CASE("Assembly: LD register from K", "[asm]")
 {
-    auto bytecode = assemble("ld v2 k");
+    auto bytecode = assembleCached("ld v2 k");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xF2);
     REQUIRE(bytecode[1] == 0x0A);
@@ -137,7 +143,7 @@ TEST_CASE("Assembly: LD register from K", "[asm]")
 
 TEST_CASE("Assembly: LD F from register", "[asm]")
 {
-    auto bytecode = assemble("ld f v8");
+    auto bytecode = assembleCached("ld f v8");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xF8);
     REQUIRE(bytecode[1] == 0x29);
@@ -145,7 +151,7 @@ TEST_CASE("Assembly: LD F from register", "[asm]")
 
 TEST_CASE("Assembly: LD B from register", "[asm]")
 {
-    auto bytecode = assemble("ld b va");
+    auto bytecode = assembleCached("ld b va");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xFA);
     REQUIRE(bytecode[1] == 0x33);
@@ -153,7 +159,7 @@ TEST_CASE("Assembly: LD B from register", "[asm]")
 
 TEST_CASE("Assembly: LD [I] from register", "[asm]")
 {
-    auto bytecode = assemble("ld [i] v5");
+    auto bytecode = assembleCached("ld [i] v5");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xF5);
     REQUIRE(bytecode[1] == 0x55);
@@ -161,7 +167,7 @@ TEST_CASE("Assembly: LD [I] from register", "[asm]")
 
 TEST_CASE("Assembly: LD register from [I]", "[asm]")
 {
-    auto bytecode = assemble("ld v4 [i]");
+    auto bytecode = assembleCached("ld v4 [i]");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xF4);
     REQUIRE(bytecode[1] == 0x65);
@@ -169,7 +175,7 @@ TEST_CASE("Assembly: LD register from [I]", "[asm]")
 
 TEST_CASE("Assembly: ADD register with byte", "[asm]")
 {
-    auto bytecode = assemble("add v1 0x10");
+    auto bytecode = assembleCached("add v1 0x10");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x71);
     REQUIRE(bytecode[1] == 0x10);
@@ -177,7 +183,7 @@ TEST_CASE("Assembly: ADD register with byte", "[asm]")
 
 TEST_CASE("Assembly: ADD register with register", "[asm]")
 {
-    auto bytecode = assemble("add v2 v3");
+    auto bytecode = assembleCached("add v2 v3");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x82);
     REQUIRE(bytecode[1] == 0x34);
@@ -185,7 +191,7 @@ TEST_CASE("Assembly: ADD register with register", "[asm]")
 
 TEST_CASE("Assembly: ADD I with register", "[asm]")
 {
-    auto bytecode = assemble("add i vc");
+    auto bytecode = assembleCached("add i vc");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xFC);
     REQUIRE(bytecode[1] == 0x1E);
@@ -193,7 +199,7 @@ TEST_CASE("Assembly: ADD I with register", "[asm]")
 
 TEST_CASE("Assembly: OR instruction", "[asm]")
 {
-    auto bytecode = assemble("or v5 v6");
+    auto bytecode = assembleCached("or v5 v6");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x85);
     REQUIRE(bytecode[1] == 0x61);
@@ -201,7 +207,7 @@ TEST_CASE("Assembly: OR instruction", "[asm]")
 
 TEST_CASE("Assembly: AND instruction", "[asm]")
 {
-    auto bytecode = assemble("and v7 v8");
+    auto bytecode = assembleCached("and v7 v8");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x87);
     REQUIRE(bytecode[1] == 0x82);
@@ -209,7 +215,7 @@ TEST_CASE("Assembly: AND instruction", "[asm]")
 
 TEST_CASE("Assembly: XOR instruction", "[asm]")
 {
-    auto bytecode = assemble("xor v9 va");
+    auto bytecode = assembleCached("xor v9 va");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x89);
     REQUIRE(bytecode[1] == 0xA3);
@@ -217,7 +223,7 @@ TEST_CASE("Assembly: XOR instruction", "[asm]")
 
 TEST_CASE("Assembly: SUB instruction", "[asm]")
 {
-    auto bytecode = assemble("sub vb vc");
+    auto bytecode = assembleCached("sub vb vc");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x8B);
     REQUIRE(bytecode[1] == 0xC5);
@@ -225,7 +231,7 @@ TEST_CASE("Assembly: SUB instruction", "[asm]")
 
 TEST_CASE("Assembly: SUBN instruction", "[asm]")
 {
-    auto bytecode = assemble("subn vd ve");
+    auto bytecode = assembleCached("subn vd ve");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x8D);
     REQUIRE(bytecode[1] == 0xE7);
@@ -233,7 +239,7 @@ TEST_CASE("Assembly: SUBN instruction", "[asm]")
 
 TEST_CASE("Assembly: SHR with one register", "[asm]")
 {
-    auto bytecode = assemble("shr v3");
+    auto bytecode = assembleCached("shr v3");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x83);
     REQUIRE(bytecode[1] == 0x06);
@@ -241,7 +247,7 @@ TEST_CASE("Assembly: SHR with one register", "[asm]")
 
 TEST_CASE("Assembly: SHR with two registers", "[asm]")
 {
-    auto bytecode = assemble("shr v4 v5");
+    auto bytecode = assembleCached("shr v4 v5");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x84);
     REQUIRE(bytecode[1] == 0x56);
@@ -249,7 +255,7 @@ TEST_CASE("Assembly: SHR with two registers", "[asm]")
 
 TEST_CASE("Assembly: SHL with one register", "[asm]")
 {
-    auto bytecode = assemble("shl v6");
+    auto bytecode = assembleCached("shl v6");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x86);
     REQUIRE(bytecode[1] == 0x0E);
@@ -257,7 +263,7 @@ TEST_CASE("Assembly: SHL with one register", "[asm]")
 
 TEST_CASE("Assembly: SHL with two registers", "[asm]")
 {
-    auto bytecode = assemble("shl v7 v8");
+    auto bytecode = assembleCached("shl v7 v8");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x87);
     REQUIRE(bytecode[1] == 0x8E);
@@ -265,7 +271,7 @@ TEST_CASE("Assembly: SHL with two registers", "[asm]")
 
 TEST_CASE("Assembly: RND instruction", "[asm]")
 {
-    auto bytecode = assemble("rnd va 0xFF");
+    auto bytecode = assembleCached("rnd va 0xFF");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xCA);
     REQUIRE(bytecode[1] == 0xFF);
@@ -273,7 +279,7 @@ TEST_CASE("Assembly: RND instruction", "[asm]")
 
 TEST_CASE("Assembly: DRW instruction", "[asm]")
 {
-    auto bytecode = assemble("drw v0 v1 0x5");
+    auto bytecode = assembleCached("drw v0 v1 0x5");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xD0);
     REQUIRE(bytecode[1] == 0x15);
@@ -281,7 +287,7 @@ TEST_CASE("Assembly: DRW instruction", "[asm]")
 
 TEST_CASE("Assembly: SKP instruction", "[asm]")
 {
-    auto bytecode = assemble("skp vb");
+    auto bytecode = assembleCached("skp vb");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xEB);
     REQUIRE(bytecode[1] == 0x9E);
@@ -289,7 +295,7 @@ TEST_CASE("Assembly: SKP instruction", "[asm]")
 
 TEST_CASE("Assembly: SKNP instruction", "[asm]")
 {
-    auto bytecode = assemble("sknp vc");
+    auto bytecode = assembleCached("sknp vc");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0xEC);
     REQUIRE(bytecode[1] == 0xA1);
@@ -297,7 +303,7 @@ TEST_CASE("Assembly: SKNP instruction", "[asm]")
 
 TEST_CASE("Assembly: Multiple instructions", "[asm]")
 {
-    auto bytecode = assemble("ld v0 0x05\nld v1 0x02\nadd v0 v1");
+    auto bytecode = assembleCached("ld v0 0x05\nld v1 0x02\nadd v0 v1");
     REQUIRE(bytecode.size() == 6);
     // LD V0, 0x05
     REQUIRE(bytecode[0] == 0x60);
@@ -312,7 +318,7 @@ TEST_CASE("Assembly: Multiple instructions", "[asm]")
 
 TEST_CASE("Assembly: Instructions with comments", "[asm]")
 {
-    auto bytecode = assemble("ld v0 0x05 ; Load 5 into V0\nld v1 0x02 ; Load 2 into V1");
+    auto bytecode = assembleCached("ld v0 0x05 ; Load 5 into V0\nld v1 0x02 ; Load 2 into V1");
     REQUIRE(bytecode.size() == 4);
     REQUIRE(bytecode[0] == 0x60);
     REQUIRE(bytecode[1] == 0x05);
@@ -329,7 +335,7 @@ TEST_CASE("Assembly: Complete program example", "[asm]")
         drw v0 v1 0x1
     )";
 
-    auto bytecode = assemble(program);
+    auto bytecode = assembleCached(program);
     REQUIRE(bytecode.size() == 8);
 
     // LD V0, 0x05
@@ -351,7 +357,7 @@ TEST_CASE("Assembly: Complete program example", "[asm]")
 
 TEST_CASE("Assembly: Hexadecimal register references", "[asm]")
 {
-    auto bytecode = assemble("ld vf 0xFF");
+    auto bytecode = assembleCached("ld vf 0xFF");
     REQUIRE(bytecode.size() == 2);
     REQUIRE(bytecode[0] == 0x6F);
     REQUIRE(bytecode[1] == 0xFF);
@@ -361,7 +367,7 @@ TEST_CASE("Assembly: Various number formats", "[asm]")
 {
     SECTION("Decimal")
     {
-        auto bytecode = assemble("ld v0 255");
+        auto bytecode = assembleCached("ld v0 255");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0x60);
         REQUIRE(bytecode[1] == 0xFF);
@@ -369,7 +375,7 @@ TEST_CASE("Assembly: Various number formats", "[asm]")
 
     SECTION("Hexadecimal with 0x prefix")
     {
-        auto bytecode = assemble("ld v0 0xFF");
+        auto bytecode = assembleCached("ld v0 0xFF");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0x60);
         REQUIRE(bytecode[1] == 0xFF);
@@ -377,7 +383,7 @@ TEST_CASE("Assembly: Various number formats", "[asm]")
 
     SECTION("Octal")
     {
-        auto bytecode = assemble("ld v0 0377");
+        auto bytecode = assembleCached("ld v0 0377");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0x60);
         REQUIRE(bytecode[1] == 0xFF);
@@ -388,7 +394,7 @@ TEST_CASE("Assembly: Edge cases for address range", "[asm]")
 {
     SECTION("Minimum address")
     {
-        auto bytecode = assemble("jp 0x000");
+        auto bytecode = assembleCached("jp 0x000");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0x10);
         REQUIRE(bytecode[1] == 0x00);
@@ -396,7 +402,7 @@ TEST_CASE("Assembly: Edge cases for address range", "[asm]")
 
     SECTION("Maximum address")
     {
-        auto bytecode = assemble("jp 0xFFF");
+        auto bytecode = assembleCached("jp 0xFFF");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0x1F);
         REQUIRE(bytecode[1] == 0xFF);
@@ -407,7 +413,7 @@ TEST_CASE("Assembly: Edge cases for byte values", "[asm]")
 {
     SECTION("Minimum byte")
     {
-        auto bytecode = assemble("ld v0 0x00");
+        auto bytecode = assembleCached("ld v0 0x00");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0x60);
         REQUIRE(bytecode[1] == 0x00);
@@ -415,7 +421,7 @@ TEST_CASE("Assembly: Edge cases for byte values", "[asm]")
 
     SECTION("Maximum byte")
     {
-        auto bytecode = assemble("ld v0 0xFF");
+        auto bytecode = assembleCached("ld v0 0xFF");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0x60);
         REQUIRE(bytecode[1] == 0xFF);
@@ -426,7 +432,7 @@ TEST_CASE("Assembly: Edge cases for nibble values", "[asm]")
 {
     SECTION("Minimum nibble")
     {
-        auto bytecode = assemble("drw v0 v1 0x0");
+        auto bytecode = assembleCached("drw v0 v1 0x0");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0xD0);
         REQUIRE(bytecode[1] == 0x10);
@@ -434,9 +440,179 @@ TEST_CASE("Assembly: Edge cases for nibble values", "[asm]")
 
     SECTION("Maximum nibble")
     {
-        auto bytecode = assemble("drw v0 v1 0xF");
+        auto bytecode = assembleCached("drw v0 v1 0xF");
         REQUIRE(bytecode.size() == 2);
         REQUIRE(bytecode[0] == 0xD0);
         REQUIRE(bytecode[1] == 0x1F);
     }
 }
+
+TEST_CASE("Assembly: Malformed operands are rejected", "[asm]")
+{
+    REQUIRE(assembleCached("ld v0 0x1g").empty());
+    REQUIRE(assembleCached("ld v0 256").empty());
+    REQUIRE(assembleCached("ld vz 0x01").empty());
+    REQUIRE(assembleCached("jp 0x1000").empty());
+    REQUIRE(assembleCached("drw v0 v1 0x5 v2").empty());
+    REQUIRE(assembleCached("nop").empty());
+}
+
+TEST_CASE("Assembly: db takes hex bytes", "[asm]")
+{
+    auto bytecode = assembleCached("db 00 e0 0x12\ncls");
+    REQUIRE(bytecode == std::vector<uint8_t>{0x00, 0xE0, 0x12, 0x00, 0xE0});
+    REQUIRE(assembleCached("db 100").empty());
+}
+
+TEST_CASE("Assembly: Labels and forward references", "[asm]")
+{
+    auto bytecode = assembleCached(R"(
+        start:
+            ld i sprite
+            call draw
+        loop: jp loop
+        draw:
+            drw v0 v1 5
+            ret
+        sprite: db f0 90
+    )");
+    REQUIRE(bytecode == std::vector<uint8_t>{0xA2, 0x0A, 0x22, 0x06, 0x12, 0x04, 0xD0, 0x15, 0x00,
+                                             0xEE, 0xF0, 0x90});
+}
+
+TEST_CASE("Assembly: Constants", "[asm]")
+{
+    auto bytecode = assembleCached("speed equ 5\nscreen_w equ 64\nld v0 speed\nse v1 screen_w");
+    REQUIRE(bytecode == std::vector<uint8_t>{0x60, 0x05, 0x31, 0x40});
+}
+
+TEST_CASE("Assembly: org pads up to the address", "[asm]")
+{
+    auto bytecode = assembleCached("jp main\norg 0x210\nmain: cls");
+    REQUIRE(bytecode.size() == 0x12);
+    REQUIRE(bytecode[0] == 0x12);
+    REQUIRE(bytecode[1] == 0x10);
+    REQUIRE(bytecode[2] == 0x00);
+    REQUIRE(bytecode[0x10] == 0x00);
+    REQUIRE(bytecode[0x11] == 0xE0);
+
+    REQUIRE(assembleSource("cls\ncls\norg 0x200").errors.size() == 1);
+}
+
+TEST_CASE("Assembly: Errors carry line numbers", "[asm]")
+{
+    auto result = assembleSource("cls\njp nowhere\nld v0 300\nfoo v1\nv1: cls");
+    REQUIRE(!result.ok());
+    REQUIRE(result.bytecode.empty());
+    REQUIRE(result.errors.size() == 1);
+    REQUIRE(result.errors[0].line == 5);
+
+    result = assembleSource("cls\njp nowhere\nld v0 300\nfoo v1");
+    REQUIRE(result.errors.size() == 3);
+    REQUIRE(result.errors[0].line == 2);
+    REQUIRE(result.errors[0].message == "undefined symbol 'nowhere'");
+    REQUIRE(result.errors[1].line == 3);
+    REQUIRE(result.errors[2].line == 4);
+
+    result = assembleSource("a: cls\na: cls");
+    REQUIRE(result.errors.size() == 1);
+    REQUIRE(result.errors[0].line == 2);
+    REQUIRE(result.errors[0].message == "'a' already defined at line 1");
+}
+
+TEST_CASE("Assembly: Many symbols", "[asm]")
+{
+    std::string source;
+    for (int i = 0; i < 1000; ++i)
+        source += "c" + std::to_string(i) + " equ " + std::to_string(i % 256) + "\n";
+    for (int i = 0; i < 1000; ++i)
+        source += "l" + std::to_string(i) + ": ld v0 c" + std::to_string(999 - i) + "\n";
+    source += "jp l999\n";
+
+    auto result = assembleSource(source);
+    REQUIRE(result.ok());
+    REQUIRE(result.bytecode.size() == 2002);
+    REQUIRE(result.bytecode[1] == (999 % 256));
+    REQUIRE(result.bytecode[2000] == 0x19);
+    REQUIRE(result.bytecode[2001] == 0xCE);
+}
+
+TEST_CASE("Assembly: at compile time", "[asm]")
+{
+    constexpr auto program = assemble_ct<R"(
+        start:
+            ld v0 0x0A
+            call sub
+            jp start
+        n equ 077
+        sub:
+            se v0 n
+            ret
+            db ff 00
+    )">();
+
+    static_assert(program.size() == 12);
+    static_assert(program[2] == 0x22 && program[3] == 0x06);
+    static_assert(program[6] == 0x30 && program[7] == 077);
+
+    auto runtime = assembleCached(R"(
+        start:
+            ld v0 0x0A
+            call sub
+            jp start
+        n equ 077
+        sub:
+            se v0 n
+            ret
+            db ff 00
+    )");
+    REQUIRE(std::equal(program.begin(), program.end(), runtime.begin(), runtime.end()));
+
+    static_assert(assemble_ct<"">().empty());
+}
+
+TEST_CASE("Assembly: cache by source", "[asm]")
+{
+    auto directory = std::filesystem::temp_directory_path() / "chipate_asm_cache_test";
+    std::filesystem::remove_all(directory);
+
+    AsmCache cache(directory);
+    auto program = cache.get("ld v0 1\nret");
+    REQUIRE(program == std::vector<uint8_t>{0x60, 0x01, 0x00, 0xEE});
+    REQUIRE(cache.get("ld v0 1\nret") == program);
+    REQUIRE(cache.hits() == 1);
+    REQUIRE(cache.misses() == 1);
+    REQUIRE(cache.hitRate() == 0.5);
+
+    // Errors are not kept
+    REQUIRE(cache.get("ld v0").empty());
+    REQUIRE(cache.get("ld v0").empty());
+    REQUIRE(cache.misses() == 3);
+
+    // A new process finds the program on disk
+    AsmCache reopened(directory);
+    REQUIRE(reopened.get("ld v0 1\nret") == program);
+    REQUIRE(reopened.hits() == 1);
+    REQUIRE(reopened.misses() == 0);
+
+    std::filesystem::remove_all(directory);
+}
+
+namespace {
+
+// Reports how many of the programs the tests assembled came from the cache
+class AsmCacheListener : public Catch::EventListenerBase {
+public:
+    using EventListenerBase::EventListenerBase;
+
+    void testRunEnded(Catch::TestRunStats const&) override
+    {
+        auto const& cache = assemblyCache();
+        printf("Assembly cache: %zu hits, %zu misses, %.1f%% hit rate\n", cache.hits(),
+               cache.misses(), 100 * cache.hitRate());
+    }
+};
+
+} // namespace
+
+CATCH_REGISTER_LISTENER(AsmCacheListener)
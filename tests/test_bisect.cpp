@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "asm_ct.h"
+#include "bisect.h"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+using namespace chipate;
+
+namespace {
+
+// Counts to 40 in v0, three instructions a round, then shifts. The shift quirk decides whether
+// v2 ends up 8 or 0.
+constexpr auto SHIFT_LATE = assemble_ct<R"(
+        ld v1 0x10
+    loop:
+        add v0 1
+        se v0 40
+        jp loop
+        shr v2 v1
+        rnd v3 0xFF
+    end:
+        jp end
+)">();
+
+bool contains(std::vector<std::string> const& fields, std::string const& field)
+{
+    return std::find(fields.begin(), fields.end(), field) != fields.end();
+}
+
+} // namespace
+
+TEST_CASE("Bisect: finds the instruction where quirks diverge", "[bisect]")
+{
+    BisectOptions options{.frames = 50, .tickRate = 10, .interval = 4};
+    auto divergence = bisect(SHIFT_LATE, {CHIP8_QUIRKS}, {SCHIP_MODERN_QUIRKS}, options);
+    REQUIRE(divergence);
+
+    // 1 load, 39 rounds of 3 and the add and skip of the last one run first
+    REQUIRE(divergence->frame == 12);
+    REQUIRE(divergence->instruction == 1);
+    REQUIRE(divergence->pc == 0x208);
+    REQUIRE(divergence->opcode == 0x8216);
+    REQUIRE(contains(divergence->fields, "V2: 08 / 00"));
+    REQUIRE(divergence->a.PC == divergence->b.PC);
+
+    // Snapshots on every frame find the same point
+    options.interval = 1;
+    auto again = bisect(SHIFT_LATE, {CHIP8_QUIRKS}, {SCHIP_MODERN_QUIRKS}, options);
+    REQUIRE(again);
+    REQUIRE(again->frame == divergence->frame);
+    REQUIRE(again->instruction == divergence->instruction);
+}
+
+TEST_CASE("Bisect: runs that only differ in fusion agree", "[bisect]")
+{
+    EngineConfig fused{CHIP8_QUIRKS};
+    EngineConfig plain{CHIP8_QUIRKS, false};
+    REQUIRE(!bisect(SHIFT_LATE, fused, plain, {.frames = 50}));
+
+    // Before the shift the quirks make no difference
+    REQUIRE(!bisect(SHIFT_LATE, {CHIP8_QUIRKS}, {SCHIP_MODERN_QUIRKS}, {.frames = 12}));
+}
+
+TEST_CASE("Bisect: state differences by field", "[bisect]")
+{
+    MachineState a{};
+    MachineState b{};
+    REQUIRE(stateDifferences(a, b).empty());
+
+    b.V[0xA] = 0x42;
+    b.PC = 0x2F0;
+    b.S[3] = 0x204;
+    for (size_t address = 0x300; address < 0x30A; ++address)
+        b.memory[address] = 1;
+    b.FB[2].set(7);
+
+    auto fields = stateDifferences(a, b);
+    REQUIRE(fields[0] == "VA: 00 / 42");
+    REQUIRE(fields[1] == "PC: 000 / 2f0");
+    REQUIRE(fields[2] == "S[3]: 000 / 204");
+    REQUIRE(fields[3] == "memory[300]: 00 / 01");
+    REQUIRE(contains(fields, "memory: 2 more bytes"));
+    REQUIRE(fields.back() == "frame buffer: 1 pixels");
+}
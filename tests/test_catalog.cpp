@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "catalog.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <set>
+#include <string_view>
+
+using namespace chipate;
+
+TEST_CASE("Catalog: entries refer to their strings and ROMs", "[catalog]")
+{
+    REQUIRE(!CATALOG.empty());
+
+    std::set<std::string_view> names;
+    uint32_t romEnd = 0;
+    for (auto const& entry: CATALOG) {
+        for (auto offset: {entry.name, entry.title, entry.authors, entry.release, entry.event,
+                           entry.platform, entry.desc})
+            REQUIRE(offset < sizeof(CATALOG_STRINGS));
+        REQUIRE(names.insert(catalogString(entry.name)).second);
+
+        std::string_view platform = catalogString(entry.platform);
+        REQUIRE((platform == "chip8" || platform == "schip"));
+
+        // ROMs follow each other in catalog order
+        REQUIRE(entry.romOffset == romEnd);
+        REQUIRE(entry.romSize > 0);
+        romEnd += entry.romSize;
+        REQUIRE(catalogRom(entry).size() == entry.romSize);
+    }
+    REQUIRE(romEnd <= sizeof(CATALOG_ROMS));
+}
@@ -1,10 +1,14 @@
 // SPDX-License-Identifier: WTFPL
 
 #include "asm.h"
+#include "asm_ct.h"
 #include "chip8.h"
+#include "framehash.h"
 
 #include <catch2/catch_test_macros.hpp>
-#include <string>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
 #include <vector>
 
 using namespace chipate;
@@ -13,15 +17,15 @@ TEST_CASE("Chip8: DRW opcode draws sprite to framebuffer", "[chip8][draw]")
 {
     Chip8 cpu;
 
-    std::string program = R"(
+    constexpr auto program = assemble_ct<R"(
         ld v0 0x05
         ld v1 0x02
         ld i 0x208
         drw v0 v1 0x1
         db 0x80
-    )";
+    )">();
 
-    cpu.init(assemble(program));
+    cpu.init(program);
 
     cpu.tick();
     cpu.tick();
@@ -33,3 +37,407 @@ TEST_CASE("Chip8: DRW opcode draws sprite to framebuffer", "[chip8][draw]")
     // V0 == 5, V1 == 2, sprite 0x80 has highest bit set -> sets pixel at (5,2)
     REQUIRE(fb[5].test(2) == true);
 }
+
+TEST_CASE("Chip8: programs too long for memory are cut short", "[chip8]")
+{
+    std::vector<uint8_t> program(200000, 0x12);
+    Chip8 cpu;
+    cpu.init(program);
+    auto const& memory = cpu.state().memory;
+    REQUIRE(memory[0x200] == 0x12);
+    REQUIRE(memory[0xFFF] == 0x12);
+}
+
+TEST_CASE("Chip8: run stops when the budget is exhausted", "[chip8][run]")
+{
+    Chip8 cpu;
+
+    cpu.init(assemble_ct<R"(
+        ld v0 0x01
+        add v0 0x01
+        jp 0x202
+    )">());
+
+    auto result = cpu.run(100);
+
+    REQUIRE(result.cycles == 100);
+    REQUIRE(result.reason == StopReason::Budget);
+}
+
+TEST_CASE("Chip8: run stops on vblank wait after DRW", "[chip8][run]")
+{
+    Chip8 cpu;
+
+    cpu.init(assemble_ct<R"(
+        ld i 0x208
+        drw v0 v1 0x1
+        jp 0x204
+        db 0x80
+    )">());
+
+    auto result = cpu.run(100);
+    REQUIRE(result.cycles == 2);
+    REQUIRE(result.reason == StopReason::VBlank);
+
+    // Still waiting until the next frame
+    result = cpu.run(100);
+    REQUIRE(result.cycles == 0);
+    REQUIRE(result.reason == StopReason::VBlank);
+
+    cpu.tock();
+    result = cpu.run(10);
+    REQUIRE(result.cycles == 10);
+    REQUIRE(result.reason == StopReason::Budget);
+}
+
+TEST_CASE("Chip8: run stops on key wait", "[chip8][run]")
+{
+    Chip8 cpu;
+
+    cpu.init(assemble_ct<R"(
+        ld v0 0x01
+        ld v1 k
+        jp 0x204
+    )">());
+
+    auto result = cpu.run(100);
+    REQUIRE(result.cycles == 2);
+    REQUIRE(result.reason == StopReason::KeyWait);
+
+    cpu.setKey(5, true);
+    result = cpu.run(5);
+    REQUIRE(result.cycles == 5);
+    REQUIRE(result.reason == StopReason::Budget);
+}
+
+TEST_CASE("Chip8: run stops when the sound timer starts", "[chip8][run]")
+{
+    Chip8 cpu;
+
+    cpu.init(assemble_ct<R"(
+        ld v0 0x10
+        ld st v0
+        ld st v0
+        jp 0x206
+    )">());
+
+    auto result = cpu.run(100);
+    REQUIRE(result.cycles == 2);
+    REQUIRE(result.reason == StopReason::Sound);
+
+    // Reloading a running timer is not a new sound
+    result = cpu.run(100);
+    REQUIRE(result.cycles == 100);
+    REQUIRE(result.reason == StopReason::Budget);
+}
+
+TEST_CASE("Chip8: run stops on breakpoints and resumes past them", "[chip8][run]")
+{
+    Chip8 cpu;
+
+    cpu.init(assemble_ct<R"(
+        ld v0 0x01
+        ld v1 0x02
+        jp 0x200
+    )">());
+    cpu.setBreakpoint(0x202);
+
+    auto result = cpu.run(100);
+    REQUIRE(result.cycles == 1);
+    REQUIRE(result.reason == StopReason::Breakpoint);
+
+    result = cpu.run(100);
+    REQUIRE(result.cycles == 3);
+    REQUIRE(result.reason == StopReason::Breakpoint);
+
+    cpu.clearBreakpoints();
+    result = cpu.run(100);
+    REQUIRE(result.cycles == 100);
+    REQUIRE(result.reason == StopReason::Budget);
+}
+
+TEST_CASE("Chip8: run stops on a breakpoint it starts on", "[chip8][run]")
+{
+    Chip8 cpu;
+
+    cpu.init(assemble_ct<R"(
+        ld v0 0x01
+        ld v1 0x02
+        jp 0x200
+    )">());
+    cpu.setBreakpoint(0x200);
+
+    auto result = cpu.run(100);
+    REQUIRE(result.cycles == 0);
+    REQUIRE(result.reason == StopReason::Breakpoint);
+
+    // Resuming runs past it once, until the loop comes back around
+    result = cpu.run(100);
+    REQUIRE(result.cycles == 3);
+    REQUIRE(result.reason == StopReason::Breakpoint);
+
+    // A batch that ends right before a breakpoint leaves the next one starting on it
+    cpu.clearBreakpoints();
+    cpu.setBreakpoint(0x202);
+    REQUIRE(cpu.run(1).reason == StopReason::Budget);
+    result = cpu.run(100);
+    REQUIRE(result.cycles == 0);
+    REQUIRE(result.reason == StopReason::Breakpoint);
+}
+
+TEST_CASE("Chip8: run stops on faults", "[chip8][run]")
+{
+    Chip8 cpu;
+
+    cpu.init(assemble_ct<R"(
+        ld v0 0x01
+        ret
+    )">());
+
+    auto result = cpu.run(100);
+    REQUIRE(result.cycles == 2);
+    REQUIRE(result.reason == StopReason::Fault);
+}
+
+TEST_CASE("Chip8: machine state is one trivially copyable block", "[chip8][state]")
+{
+    STATIC_REQUIRE(std::is_trivially_copyable_v<MachineState>);
+    STATIC_REQUIRE(alignof(MachineState) == 64);
+    STATIC_REQUIRE(sizeof(MachineState) % 64 == 0);
+    STATIC_REQUIRE(offsetof(MachineState, V) == 0);
+    STATIC_REQUIRE(offsetof(MachineState, keys) < 64);
+
+    std::vector<MachineState> states(1000);
+    REQUIRE(reinterpret_cast<uintptr_t>(states.data()) % 64 == 0);
+}
+
+TEST_CASE("Chip8: snapshots restore and fork runs", "[chip8][state]")
+{
+    constexpr auto program = assemble_ct<R"(
+        ld i counter
+    loop:
+        ld v0 [i]
+        add v0 1
+        ld [i] v0
+        ld i counter
+        skp v1
+        jp loop
+        add v2 1
+        jp loop
+    counter:
+        db 00
+    )">();
+
+    Chip8 cpu;
+    cpu.init(program);
+    cpu.run(50);
+    MachineState snapshot = cpu.state();
+
+    cpu.setKey(0, true);
+    cpu.run(50);
+    MachineState pressed = cpu.state();
+    REQUIRE(pressed.V[2] > 0);
+
+    // Back to the snapshot, the same run gives the same state
+    cpu.restore(snapshot);
+    REQUIRE(cpu.state().keys == 0);
+    REQUIRE(cpu.state().memory == snapshot.memory);
+    cpu.setKey(0, true);
+    cpu.run(50);
+    REQUIRE(std::memcmp(&cpu.state(), &pressed, sizeof(MachineState)) == 0);
+
+    // A fork continues on its own
+    Chip8 fork;
+    fork.restore(snapshot);
+    fork.run(50);
+    REQUIRE(fork.state().V[2] == 0);
+    REQUIRE(std::memcmp(&fork.state(), &pressed, sizeof(MachineState)) != 0);
+
+    // RND draws from the state as well
+    constexpr auto random = assemble_ct<"rnd v0 0xFF\nrnd v1 0xFF\nrnd v2 0xFF">();
+    cpu.init(random);
+    cpu.seedRandom(7);
+    snapshot = cpu.state();
+    cpu.run(3);
+    Registers drawn = cpu.state().V;
+    cpu.restore(snapshot);
+    cpu.run(3);
+    REQUIRE(cpu.state().V == drawn);
+}
+
+TEST_CASE("Chip8: stepping back undoes one instruction at a time", "[chip8][journal]")
+{
+    constexpr auto program = assemble_ct<R"(
+        ld v0 200
+        ld v1 100
+        add v0 v1
+        rnd v4 0xFF
+        ld i digits
+        ld b v0
+        ld v3 [i]
+        call sprite
+        cls
+        ld i digits
+        ld [i] v3
+        ld v0 30
+        ld dt v0
+        ld st v1
+    end:
+        jp end
+    sprite:
+        ld v2 5
+        ld f v2
+        drw v2 v1 5
+        ret
+    digits:
+        db 00 00 00 00
+    )">();
+
+    Chip8 cpu;
+    cpu.init(program);
+    cpu.setJournal(4096);
+
+    std::vector<MachineState> states;
+    for (int step = 0; step < 20; ++step) {
+        states.push_back(cpu.state());
+        REQUIRE(cpu.run(1).cycles == 1);
+        if (cpu.state().waitForVBlank)
+            cpu.tock();
+    }
+    REQUIRE(cpu.journalEntries() == states.size());
+
+    while (!states.empty()) {
+        REQUIRE(cpu.stepBack());
+        REQUIRE(std::memcmp(&cpu.state(), &states.back(), sizeof(MachineState)) == 0);
+        states.pop_back();
+    }
+    REQUIRE(!cpu.stepBack());
+
+    // A small journal keeps the newest entries only
+    cpu.setJournal(32);
+    for (int step = 0; step < 20; ++step) {
+        states.push_back(cpu.state());
+        cpu.run(1);
+        if (cpu.state().waitForVBlank)
+            cpu.tock();
+    }
+    size_t kept = cpu.journalEntries();
+    REQUIRE(kept > 0);
+    REQUIRE(kept < states.size());
+    while (cpu.stepBack())
+        ;
+    REQUIRE(std::memcmp(&cpu.state(), &states[states.size() - kept], sizeof(MachineState)) == 0);
+}
+
+TEST_CASE("Chip8: stepping back an out of range digit restores Vx", "[chip8][journal]")
+{
+    constexpr auto program = assemble_ct<R"(
+        ld v5 0x3A
+        ld f v5
+    end:
+        jp end
+    )">();
+
+    Chip8 cpu;
+    cpu.init(program);
+    cpu.setJournal(256);
+    REQUIRE(cpu.run(1).cycles == 1);
+    MachineState before = cpu.state();
+    REQUIRE(cpu.run(1).cycles == 1);
+    REQUIRE(cpu.state().V[5] == 0x0A);
+
+    REQUIRE(cpu.stepBack());
+    REQUIRE(cpu.state().V[5] == 0x3A);
+    REQUIRE(std::memcmp(&cpu.state(), &before, sizeof(MachineState)) == 0);
+}
+
+TEST_CASE("Journal: ring drops the oldest entries", "[journal]")
+{
+    Journal journal(10);
+    std::vector<uint8_t> entry;
+    REQUIRE(!journal.pop(entry));
+
+    REQUIRE(journal.push(std::vector<uint8_t>{1, 2, 3}));
+    REQUIRE(journal.push(std::vector<uint8_t>{4, 5, 6, 7}));
+    REQUIRE(journal.push(std::vector<uint8_t>{8, 9, 10, 11}));
+    REQUIRE(journal.size() == 2);
+    REQUIRE(journal.bytes() == 8);
+
+    // Wraps around the end of the buffer
+    REQUIRE(journal.pop(entry));
+    REQUIRE(entry == std::vector<uint8_t>{8, 9, 10, 11});
+    REQUIRE(journal.pop(entry));
+    REQUIRE(entry == std::vector<uint8_t>{4, 5, 6, 7});
+    REQUIRE(journal.empty());
+
+    REQUIRE(!journal.push(std::vector<uint8_t>(11)));
+    REQUIRE(journal.empty());
+}
+
+TEST_CASE("Chip8: state hash follows every write", "[chip8][hash]")
+{
+    constexpr auto program = assemble_ct<R"(
+        high
+    loop:
+        ld i digits
+        ld b v0
+        ld v2 [i]
+        ld [i] v2
+        drw v0 v1 5
+        scr
+        scl
+        scd 3
+        add v0 7
+        add v1 3
+        se v0 0xFC
+        jp loop
+        cls
+    end:
+        jp end
+    digits:
+        db 00 00 00 00
+    )">();
+
+    Chip8 cpu;
+    cpu.init(program);
+    REQUIRE(cpu.stateHash() == hashState(cpu.state()));
+
+    cpu.setJournal(1 << 16);
+    std::vector<uint64_t> hashes;
+    for (int frame = 0; frame < 200; ++frame) {
+        hashes.push_back(cpu.stateHash());
+        cpu.frame(10);
+        REQUIRE(cpu.stateHash() == hashState(cpu.state()));
+    }
+    REQUIRE(hashes.front() != hashes.back());
+
+    uint8_t const bytes[]{1, 2, 3};
+    cpu.patch(0x300, bytes);
+    REQUIRE(cpu.stateHash() == hashState(cpu.state()));
+
+    while (cpu.stepBack())
+        REQUIRE(cpu.stateHash() == hashState(cpu.state()));
+
+    MachineState state = cpu.state();
+    state.FB[3].flip(5);
+    REQUIRE(hashState(state) != cpu.stateHash());
+    state.FB[3].flip(5);
+    state.S[15] = 1;
+    REQUIRE(hashState(state) != cpu.stateHash());
+}
+
+TEST_CASE("Frame hashes: files and the first divergent frame", "[hash]")
+{
+    std::vector<uint64_t> a{1, 2, 3, 4};
+    std::vector<uint64_t> b{1, 2, 5, 4};
+    REQUIRE(firstDivergence(a, a) == std::nullopt);
+    REQUIRE(firstDivergence(a, b) == 2);
+    REQUIRE(firstDivergence(a, std::span(a).first(3)) == 3);
+
+    auto path = (std::filesystem::temp_directory_path() / "chipate_test.hashes").string();
+    std::vector<uint64_t> hashes{0x0123456789abcdef, 0, ~0ull};
+    REQUIRE(writeFrameHashes(path, hashes));
+    REQUIRE(readFrameHashes(path) == hashes);
+    std::filesystem::remove(path);
+    REQUIRE(!readFrameHashes(path));
+}
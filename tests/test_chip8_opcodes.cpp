@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: WTFPL
 
 #include "asm.h"
+#include "asm_ct.h"
 #include "chip8.h"
 
 #include <catch2/catch_test_macros.hpp>
@@ -62,10 +63,7 @@ public:
     }
     static bool keyState(Chip8 const &c, uint8_t k)
     {
-        auto it = c.K.find(k);
-        if (it == c.K.end())
-            return false;
-        return it->second;
+        return c.keyDown(k);
     }
     static uint16_t nextInstruction(Chip8 const &c)
     {
@@ -111,7 +109,7 @@ static void run_ticks(Chip8 &cpu, size_t n)
 
 static void run_until_opcode(Chip8 &cpu, std::string instruction)
 {
-    auto     bytecode = assemble(instruction);
+    auto     bytecode = assembleCached(instruction);
     uint16_t instr    = bytecode[0] << 8 | bytecode[1];
     while (NEXT_OPCODE != instr && PC < 0x1000)
         cpu.tick();
@@ -140,13 +138,13 @@ TEST_CASE("Cover CLS and DRW", "[chip8][draw][clrs]")
 {
     Chip8 cpu;
 
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x05
         ld v1 0x02
         ld i 0x20A
         drw v0 v1 0x1
         cls
-        db 0x80)"));
+        db 0x80)">());
 
     RUN_TO_OPCODE("cls");
     REQUIRE(FB[5].test(2) == true);
@@ -161,10 +159,10 @@ TEST_CASE("Load/store immediate and add immediate", "[chip8][ldim][addi]")
 {
     Chip8 cpu;
 
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v2 0x10
         add v2 0x05
-    )"));
+    )">());
 
     RUN_TICKS(2);
     REQUIRE(V2 == 0x15);
@@ -174,7 +172,7 @@ TEST_CASE("Register ops OR/AND/XOR", "[chip8][alu]")
 {
     Chip8 cpu;
 
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x0F
         ld v1 0xF0
         ld v2 0x55
@@ -187,7 +185,7 @@ TEST_CASE("Register ops OR/AND/XOR", "[chip8][alu]")
         xor v5 v4
 
         db 11 22 33 44
-    )"));
+    )">());
 
     RUN_TO_OPCODE("db 11 22 33 44");
 
@@ -211,7 +209,7 @@ TEST_CASE("Register ops ADD/SUB/SUB", "[chip8][alu]")
 {
     Chip8 cpu;
 
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x20
         ld v1 0x15
         ld v2 0x10
@@ -233,7 +231,7 @@ TEST_CASE("Register ops ADD/SUB/SUB", "[chip8][alu]")
 
         subn v8 v9
 
-    )"));
+    )">());
 
     SECTION("Addition")
     {
@@ -274,7 +272,7 @@ TEST_CASE("Register ops SHIFTS", "[chip8][alu]")
 {
     Chip8 cpu;
 
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x0F
         ld v1 0xF0
 
@@ -297,7 +295,7 @@ TEST_CASE("Register ops SHIFTS", "[chip8][alu]")
         shr v1  ; check if VS works
 
         ld v7 0x77
-    )"));
+    )">());
 
     RUN_TO_OPCODE("ld v5 0x55");
 
@@ -329,12 +327,12 @@ TEST_CASE("Register ops SHIFTS", "[chip8][alu]")
 TEST_CASE("Call and Return", "[chip8][call][retn]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         call 0x204   ; 0x200
         ld v0 0x42   ; 0x202
         ld v0 0x99   ; 0x204
         ret          ; 0x206
-    )"));
+    )">());
 
     RUN_TO_PC(0x206);
     REQUIRE(SP == 1);
@@ -350,7 +348,7 @@ TEST_CASE("Index and memory ops: LDI, ADDI, LDMR, LDRM, LBCD, LDS", "[chip8][mem
 {
     Chip8 cpu;
 
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x01
         ld v1 0x02
         ld v2 0x03
@@ -371,7 +369,7 @@ TEST_CASE("Index and memory ops: LDI, ADDI, LDMR, LDRM, LBCD, LDS", "[chip8][mem
         ld v4 0x55
         ld i 0x300
         ld v4 [i]
-    )"));
+    )">());
 
     SECTION("Store registers to memory")
     {
@@ -411,7 +409,7 @@ TEST_CASE("Skips and key handling (SE, SNE, SER, SKNP, SKP, LDK)", "[chip8][key]
 {
     Chip8 cpu;
 
-    std::string const program = R"(
+    constexpr auto program = assemble_ct<R"(
         ld v0 0x05
         se v0 0x05
         ld v0 0x01
@@ -423,9 +421,9 @@ TEST_CASE("Skips and key handling (SE, SNE, SER, SKNP, SKP, LDK)", "[chip8][key]
         ld v0 0x07
         ld v3 k
         ld v0 0x09
-    )";
+    )">();
 
-    cpu.init(assemble(program));
+    cpu.init(program);
 
     SECTION("SE skips next instruction when REG == IMM")
     {
@@ -479,13 +477,13 @@ TEST_CASE("Rand and timers (RND, LDRD, LDDR, LDSR)", "[chip8][rand][timers]")
 {
     Chip8 cpu;
 
-    std::string program = R"(
+    constexpr auto program = assemble_ct<R"(
         ld v1 5     ; load 5 to V1
         ld dt v1    ; load V1 to delay timer
         ld st v1    ; load V1 to sound timer
-    )";
+    )">();
 
-    cpu.init(assemble(program));
+    cpu.init(program);
 
     run_ticks(cpu, 3);
 
@@ -497,12 +495,12 @@ TEST_CASE("Rand and timers (RND, LDRD, LDDR, LDSR)", "[chip8][rand][timers]")
 TEST_CASE("JPO (Bnnn) behavior", "[chip8][jmpv]")
 {
     Chip8       cpu;
-    std::string program = R"(
+    constexpr auto program = assemble_ct<R"(
         ld v0 0x10
         jp 0x300
         ld v0 0x20
-    )";
-    cpu.init(assemble(program));
+    )">();
+    cpu.init(program);
     RUN_TO_PC(0x300);
     REQUIRE(V0 == 0x10);
 }
@@ -510,12 +508,12 @@ TEST_CASE("JPO (Bnnn) behavior", "[chip8][jmpv]")
 TEST_CASE("JP (1nnn) - Absolute jump", "[chip8][jump]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x11
         jp 0x208
         ld v0 0x22
         ld v0 0x33
-    )"));
+    )">());
 
     RUN_TICKS(2);
     REQUIRE(PC == 0x208);
@@ -527,11 +525,11 @@ TEST_CASE("SE and SNE corner cases", "[chip8][skip]")
     SECTION("SE with zero")
     {
         Chip8 cpu;
-        cpu.init(assemble(R"(
+        cpu.init(assemble_ct<R"(
             ld v0 0x00
             se v0 0x00
             ld v2 0x01
-        )"));
+        )">());
         EXECUTE_OPCODE("se v0 0x00");
         REQUIRE(V2 == 0x00); // Should be skipped
     }
@@ -539,11 +537,11 @@ TEST_CASE("SE and SNE corner cases", "[chip8][skip]")
     SECTION("SE with 0xFF not equal")
     {
         Chip8 cpu;
-        cpu.init(assemble(R"(
+        cpu.init(assemble_ct<R"(
             ld v1 0xFF
             se v1 0x00
             ld v2 0x01
-        )"));
+        )">());
         EXECUTE_OPCODE("se v1 0x00");
         cpu.tick();
         REQUIRE(V2 == 0x01); // Should execute
@@ -552,12 +550,12 @@ TEST_CASE("SE and SNE corner cases", "[chip8][skip]")
     SECTION("SNE with 0xFF")
     {
         Chip8 cpu;
-        cpu.init(assemble(R"(
+        cpu.init(assemble_ct<R"(
             ld v0 0x00
             sne v0 0xFF
             ld v3 0x03
             ld v4 0x00
-        )"));
+        )">());
         EXECUTE_OPCODE("sne v0 0xFF");
         cpu.tick();
         REQUIRE(V3 == 0x00); // Should be skipped
@@ -566,11 +564,11 @@ TEST_CASE("SE and SNE corner cases", "[chip8][skip]")
     SECTION("SNE equal 0xFF")
     {
         Chip8 cpu;
-        cpu.init(assemble(R"(
+        cpu.init(assemble_ct<R"(
             ld v1 0xFF
             sne v1 0xFF
             ld v3 0x04
-        )"));
+        )">());
         EXECUTE_OPCODE("sne v1 0xFF");
         REQUIRE(V3 == 0x00); // Should be skipped
     }
@@ -579,7 +577,7 @@ TEST_CASE("SE and SNE corner cases", "[chip8][skip]")
 TEST_CASE("SER and SNER - Register comparison skips", "[chip8][skip]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x42
         ld v1 0x42
         ld v2 0x99
@@ -592,7 +590,7 @@ TEST_CASE("SER and SNER - Register comparison skips", "[chip8][skip]")
         sne v0 v1
         ld v4 0x04
         ld v5 0x00
-    )"));
+    )">());
 
     SECTION("SE with equal registers")
     {
@@ -624,12 +622,12 @@ TEST_CASE("SER and SNER - Register comparison skips", "[chip8][skip]")
 TEST_CASE("ADD immediate with overflow", "[chip8][addi]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0xFF
         add v0 0x01
         ld v1 0x80
         add v1 0x80
-    )"));
+    )">());
 
     SECTION("Overflow wraps around")
     {
@@ -647,7 +645,7 @@ TEST_CASE("ADD immediate with overflow", "[chip8][addi]")
 TEST_CASE("ADDC - Add with carry flag", "[chip8][addc]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x50
         ld v1 0x30
         add v0 v1
@@ -663,7 +661,7 @@ TEST_CASE("ADDC - Add with carry flag", "[chip8][addc]")
         ld v6 0x80
         ld v7 0x80
         add v6 v7
-    )"));
+    )">());
 
     SECTION("No overflow - VF should be 0")
     {
@@ -697,14 +695,14 @@ TEST_CASE("ADDC - Add with carry flag", "[chip8][addc]")
 TEST_CASE("LDR - Load register from register", "[chip8][ldrg]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x42
         ld v1 0x99
         ld v2 v0
         ld v3 v1
         ld vf 0x11
         ld v4 vf
-    )"));
+    )">());
 
     RUN_TICKS(6);
     REQUIRE(V2 == 0x42);
@@ -715,7 +713,7 @@ TEST_CASE("LDR - Load register from register", "[chip8][ldrg]")
 TEST_CASE("SKP and SKNP - Key press detection", "[chip8][key]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x05
         ld v1 0x0A
         skp v0
@@ -727,7 +725,7 @@ TEST_CASE("SKP and SKNP - Key press detection", "[chip8][key]")
         sknp v0
         ld v5 0x04
         ld v6 0x05
-    )"));
+    )">());
 
     SECTION("SKP when key not pressed")
     {
@@ -763,13 +761,13 @@ TEST_CASE("SKP and SKNP - Key press detection", "[chip8][key]")
 TEST_CASE("LDRD - Load delay timer to register", "[chip8][timer]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 10
         ld dt v0
         ld v1 dt
         ld v2 dt
         ld v3 dt
-    )"));
+    )">());
 
     RUN_TICKS(3);
     REQUIRE(V1 == 9);
@@ -782,7 +780,7 @@ TEST_CASE("LDRD - Load delay timer to register", "[chip8][timer]")
 TEST_CASE("ADDI - Add to index register", "[chip8][index]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld i 0x300
         ld v0 0x10
         add i v0
@@ -790,7 +788,7 @@ TEST_CASE("ADDI - Add to index register", "[chip8][index]")
         add i v1
         ld v2 0xFF
         add i v2
-    )"));
+    )">());
 
     SECTION("Add small value")
     {
@@ -814,7 +812,7 @@ TEST_CASE("ADDI - Add to index register", "[chip8][index]")
 TEST_CASE("LDS - Load sprite location", "[chip8][sprite]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x00
         ld f v0
         ld v1 0x05
@@ -823,7 +821,7 @@ TEST_CASE("LDS - Load sprite location", "[chip8][sprite]")
         ld f v2
         ld v3 0x0A
         ld f v3
-    )"));
+    )">());
 
     SECTION("Sprite for 0")
     {
@@ -853,7 +851,7 @@ TEST_CASE("LDS - Load sprite location", "[chip8][sprite]")
 TEST_CASE("LBCD - BCD conversion edge cases", "[chip8][bcd]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld i 0x400
         ld v0 0
         ld b v0
@@ -866,7 +864,7 @@ TEST_CASE("LBCD - BCD conversion edge cases", "[chip8][bcd]")
         ld v3 9
         ld i 0x430
         ld b v3
-    )"));
+    )">());
 
     SECTION("BCD of 0")
     {
@@ -904,7 +902,7 @@ TEST_CASE("LBCD - BCD conversion edge cases", "[chip8][bcd]")
 TEST_CASE("Stack operations - multiple calls and returns", "[chip8][stack]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         call 0x20A      ; 0x200
         ld v0 0x01      ; 0x202
         call 0x20E      ; 0x204
@@ -922,7 +920,7 @@ TEST_CASE("Stack operations - multiple calls and returns", "[chip8][stack]")
         ret             ; 0x216
 
         ld v4 0x40      ; 0x218
-    )"));
+    )">());
 
     SECTION("First call")
     {
@@ -963,7 +961,7 @@ TEST_CASE("Stack operations - multiple calls and returns", "[chip8][stack]")
 TEST_CASE("LDMR and LDRM - Memory operations with all registers", "[chip8][memory]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x00
         ld v1 0x11
         ld v2 0x22
@@ -1003,7 +1001,7 @@ TEST_CASE("LDMR and LDRM - Memory operations with all registers", "[chip8][memor
 
         ld i 0x500
         ld vf [i]
-    )"));
+    )">());
 
     SECTION("Store all registers")
     {
@@ -1023,7 +1021,7 @@ TEST_CASE("LDMR and LDRM - Memory operations with all registers", "[chip8][memor
 TEST_CASE("LDMR and LDRM - Partial register save/load", "[chip8][memory]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x10
         ld v1 0x20
         ld v2 0x30
@@ -1039,7 +1037,7 @@ TEST_CASE("LDMR and LDRM - Partial register save/load", "[chip8][memory]")
 
         ld i 0x600
         ld v1 [i]
-    )"));
+    )">());
 
     SECTION("Store only V0-V2")
     {
@@ -1062,7 +1060,7 @@ TEST_CASE("LDMR and LDRM - Partial register save/load", "[chip8][memory]")
 TEST_CASE("DRW - Draw sprite with collision detection", "[chip8][draw]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld i 0x300
         ld v0 0x05
         ld v1 0x05
@@ -1073,7 +1071,7 @@ TEST_CASE("DRW - Draw sprite with collision detection", "[chip8][draw]")
         drw v2 v3 0x1
 
         db 0xFF
-    )"));
+    )">());
 
     // Place sprite data
 
@@ -1099,12 +1097,12 @@ TEST_CASE("DRW - Draw sprite with collision detection", "[chip8][draw]")
 TEST_CASE("DRW - Multi-row sprite", "[chip8][draw]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld i 0x400
         ld v0 0x10
         ld v1 0x10
         drw v0 v1 0x5
-    )"));
+    )">());
 
     Chip8TestAccess::setMemory(cpu, 0x400, 0xF0);
     Chip8TestAccess::setMemory(cpu, 0x401, 0x90);
@@ -1126,12 +1124,12 @@ TEST_CASE("DRW - Multi-row sprite", "[chip8][draw]")
 TEST_CASE("RND - Random number generation", "[chip8][rand]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         rnd v0 0xFF
         rnd v1 0x0F
         rnd v2 0xF0
         rnd v3 0x00
-    )"));
+    )">());
 
     SECTION("Random with full mask")
     {
@@ -1164,7 +1162,7 @@ TEST_CASE("RND - Random number generation", "[chip8][rand]")
 TEST_CASE("Shift operations - edge cases with VF", "[chip8][shift]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x01
         shr v0
 
@@ -1176,7 +1174,7 @@ TEST_CASE("Shift operations - edge cases with VF", "[chip8][shift]")
 
         ld v3 0x00
         shl v3
-    )"));
+    )">());
 
     SECTION("SHR with LSB=1 sets VF")
     {
@@ -1210,7 +1208,7 @@ TEST_CASE("Shift operations - edge cases with VF", "[chip8][shift]")
 TEST_CASE("Overflow and underflow in arithmetic", "[chip8][alu]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld v0 0x00
         ld v1 0x01
         sub v0 v1
@@ -1222,7 +1220,7 @@ TEST_CASE("Overflow and underflow in arithmetic", "[chip8][alu]")
         ld v4 0x01
         ld v5 0x01
         sub v4 v5
-    )"));
+    )">());
 
     SECTION("Underflow in subtraction")
     {
@@ -1249,7 +1247,7 @@ TEST_CASE("Overflow and underflow in arithmetic", "[chip8][alu]")
 TEST_CASE("VF register in various operations", "[chip8][vf]")
 {
     Chip8 cpu;
-    cpu.init(assemble(R"(
+    cpu.init(assemble_ct<R"(
         ld vf 0x42
         ld v0 vf
 
@@ -1261,7 +1259,7 @@ TEST_CASE("VF register in various operations", "[chip8][vf]")
         ld v3 0x01
         add v2 v3
         ld v4 vf
-    )"));
+    )">());
 
     SECTION("VF can be loaded like other registers")
     {
@@ -1282,3 +1280,143 @@ TEST_CASE("VF register in various operations", "[chip8][vf]")
         REQUIRE(V4 == 0x01);
     }
 }
+
+TEST_CASE("Quirk presets and custom quirks", "[chip8][quirks]")
+{
+    constexpr auto program = assemble_ct<R"(
+        ld v0 0x01
+        ld v1 0x80
+        shl v0 v1
+    )">();
+
+    Chip8 cpu;
+
+    SECTION("CHIP-8 preset shifts Vy")
+    {
+        cpu.init(program, CHIP8_QUIRKS);
+        RUN_TICKS(3);
+        REQUIRE(V0 == 0x00);
+        REQUIRE(VF == 0x01);
+    }
+
+    SECTION("SCHIP presets shift Vx only")
+    {
+        cpu.init(program, SCHIP_MODERN_QUIRKS);
+        RUN_TICKS(3);
+        REQUIRE(V0 == 0x02);
+        REQUIRE(VF == 0x00);
+    }
+
+    SECTION("Custom combination uses the runtime flags")
+    {
+        cpu.init(program, Quirks{.shiftVxOnly = true});
+        RUN_TICKS(3);
+        REQUIRE(V0 == 0x02);
+        REQUIRE(VF == 0x00);
+    }
+
+    SECTION("Switching quirks on a running machine")
+    {
+        cpu.init(program, SCHIP_1_0_QUIRKS);
+        RUN_TICKS(2);
+        cpu.setQuirks(Quirks{});
+        RUN_TICKS(1);
+        REQUIRE(V0 == 0x00);
+        REQUIRE(VF == 0x01);
+    }
+}
+
+TEST_CASE("Fused execution matches single instructions", "[chip8][fusion]")
+{
+    constexpr auto program = assemble_ct<R"(
+        ld v0 0x00
+        ld v1 0x05
+        ld dt v1
+        add v0 0x01
+        se v0 0x08
+        jp 0x206
+        ld v2 dt
+        sne v2 0x00
+        jp 0x214
+        jp 0x20c
+        ld i 0x21c
+        drw v0 v1 0x2
+        se v0 0x09
+        jp 0x200
+        db 0xF0 0x90
+    )">();
+
+    Chip8 fused;
+    Chip8 plain;
+    fused.init(program);
+    plain.init(program);
+    plain.setFusion(false);
+
+    for (size_t call = 0; call < 2000; ++call) {
+        size_t budget = 1 + call % 7;
+        auto f = fused.run(budget);
+        auto p = plain.run(budget);
+
+        REQUIRE(f.cycles == p.cycles);
+        REQUIRE(f.reason == p.reason);
+        REQUIRE(Chip8TestAccess::pc(fused) == Chip8TestAccess::pc(plain));
+        REQUIRE(Chip8TestAccess::ireg(fused) == Chip8TestAccess::ireg(plain));
+        REQUIRE(Chip8TestAccess::regs(fused) == Chip8TestAccess::regs(plain));
+        REQUIRE(Chip8TestAccess::fb(fused) == Chip8TestAccess::fb(plain));
+
+        if (call % 3 == 0 || f.reason == StopReason::VBlank) {
+            fused.tock();
+            plain.tock();
+        }
+    }
+}
+
+TEST_CASE("Fusions are invalidated by self-modifying code", "[chip8][fusion]")
+{
+    Chip8 cpu;
+    cpu.init(assemble_ct<R"(
+        ld v3 0x00
+        call 0x214
+        ld i 0x214
+        ld v0 0x64
+        ld v1 0x33
+        ld [i] v1
+        call 0x214
+        ld v5 v4
+        jp 0x210
+        db 0x00 0x00
+        se v3 0x00
+        jp 0x21c
+        ld v4 0x11
+        ret
+        add v4 0x01
+        ret
+    )">());
+
+    cpu.run(100);
+
+    // se v3 0x00 was patched into ld v4 0x33, which must not run as a skip any more
+    REQUIRE(V5 == 0x34);
+}
+
+TEST_CASE("Fusion profiling counts fired fusions", "[chip8][fusion]")
+{
+    Chip8 cpu;
+    cpu.init(assemble_ct<R"(
+        ld v0 0x00
+        add v0 0x01
+        se v0 0x10
+        jp 0x202
+        jp 0x208
+    )">());
+    cpu.setFusionProfiling(true);
+
+    cpu.run(100);
+
+    auto const& stats = cpu.fusionStats();
+    REQUIRE(stats[static_cast<size_t>(Fusion::AddSkipJump)] == 16);
+    REQUIRE(stats[static_cast<size_t>(Fusion::SkipJump)] == 0);
+
+    cpu.resetFusionStats();
+    REQUIRE(cpu.fusionStats()[static_cast<size_t>(Fusion::AddSkipJump)] == 0);
+}
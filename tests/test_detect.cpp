@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "asm_ct.h"
+#include "detect.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+
+using namespace chipate;
+
+namespace {
+
+// Shifts V1 into V0 on CHIP-8, SCHIP halves V0 in place instead and ends up in the crash
+constexpr auto NEEDS_CHIP8 = assemble_ct<R"(
+        ld v0 0x40
+        ld v1 0x80
+        shr v0 v1
+        se v0 0x40
+        jp 0x000
+        ld i 0
+        drw v0 v1 5
+    end:
+        jp end
+)">();
+
+// The other way around
+constexpr auto NEEDS_SCHIP = assemble_ct<R"(
+        ld v0 0x40
+        ld v1 0
+        shr v0 v1
+        se v0 0x20
+        jp 0x000
+        ld i 0
+        drw v0 v1 5
+    end:
+        jp end
+)">();
+
+} // namespace
+
+TEST_CASE("Detect: picks the preset that runs cleanly", "[detect]")
+{
+    auto chip8 = detectQuirks(NEEDS_CHIP8);
+    REQUIRE(chip8.runs.size() == 4);
+    REQUIRE(QUIRK_PRESETS[chip8.preset].quirks == CHIP8_QUIRKS);
+    REQUIRE(!chip8.quirks.shiftVxOnly);
+    REQUIRE(chip8.runs.back().fault);
+
+    auto schip = detectQuirks(NEEDS_SCHIP);
+    REQUIRE(QUIRK_PRESETS[schip.preset].quirks == SCHIP_1_0_QUIRKS);
+    REQUIRE(schip.quirks.shiftVxOnly);
+    REQUIRE(schip.runs[0].fault);
+    REQUIRE(schip.runs[0].penalty > schip.runs.back().penalty);
+
+    // Halting at the end after drawing is fine
+    REQUIRE(schip.runs.back().haltedFrame);
+    REQUIRE(schip.runs.back().badScreens == 0);
+}
+
+TEST_CASE("Detect: results are cached by ROM", "[detect]")
+{
+    auto directory = std::filesystem::temp_directory_path() / "chipate_quirk_cache_test";
+    std::filesystem::remove_all(directory);
+
+    {
+        QuirkCache cache(directory);
+        REQUIRE(cache.get(NEEDS_SCHIP).runs.size() == 4);
+        auto cached = cache.get(NEEDS_SCHIP);
+        REQUIRE(cached.runs.empty());
+        REQUIRE(QUIRK_PRESETS[cached.preset].quirks == SCHIP_1_0_QUIRKS);
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 1);
+    }
+
+    // And on disk for the next process
+    QuirkCache reopened(directory);
+    auto cached = reopened.get(NEEDS_SCHIP);
+    REQUIRE(reopened.hits() == 1);
+    REQUIRE(QUIRK_PRESETS[cached.preset].quirks == SCHIP_1_0_QUIRKS);
+    REQUIRE(cached.quirks.shiftVxOnly);
+    REQUIRE(reopened.get(NEEDS_CHIP8).runs.size() == 4);
+
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "asm.h"
+#include "disasm.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+using namespace chipate;
+
+TEST_CASE("Disassembly: mnemonics", "[disasm]")
+{
+    REQUIRE(disassemble(0x00E0) == "cls");
+    REQUIRE(disassemble(0x1234) == "jp 0x234");
+    REQUIRE(disassemble(0xB300) == "jp v0 0x300");
+    REQUIRE(disassemble(0x6A12) == "ld va 0x12");
+    REQUIRE(disassemble(0x8AB4) == "add va vb");
+    REQUIRE(disassemble(0xD015) == "drw v0 v1 0x5");
+    REQUIRE(disassemble(0xF30A) == "ld v3 k");
+    REQUIRE(disassemble(0xF355) == "ld [i] v3");
+    REQUIRE(disassemble(0x00C4) == "scd 0x4");
+}
+
+TEST_CASE("Disassembly: words that do not decode become db", "[disasm]")
+{
+    REQUIRE(disassemble(0x0123) == "db 0x01 0x23");
+    REQUIRE(disassemble(0xFFFF) == "db 0xff 0xff");
+    // Decodes as SE Vx, Vy but the low nibble would be lost
+    REQUIRE(disassemble(0x5121) == "db 0x51 0x21");
+}
+
+TEST_CASE("Disassembly: every word assembles back to itself", "[disasm]")
+{
+    for (uint32_t data = 0; data <= 0xFFFF; ++data) {
+        auto bytecode = assembleCached(disassemble(static_cast<uint16_t>(data)));
+        REQUIRE(bytecode.size() == 2);
+        REQUIRE((bytecode[0] << 8 | bytecode[1]) == data);
+    }
+}
+
+TEST_CASE("Disassembly: listings assemble back to the program", "[disasm]")
+{
+    std::vector<uint8_t> program{0x60, 0x05, 0xA2, 0x0A, 0xD0, 0x15, 0x12, 0x04, 0x5F, 0xF1, 0x42};
+
+    auto listing = disassemble(program);
+    REQUIRE(listing.starts_with("ld v0 0x05          ; 200: 6005\n"));
+    REQUIRE(assembleCached(listing) == program);
+}
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "chip8.h"
+#include "hash.h"
+#include "library.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+void writeFile(std::filesystem::path const& path, std::vector<uint8_t> const& bytes)
+{
+    std::filesystem::create_directories(path.parent_path());
+    FILE* file = fopen(path.string().c_str(), "wb");
+    REQUIRE(file);
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+}
+
+std::vector<ScannedRom> scanAll(std::filesystem::path const& index,
+                                std::filesystem::path const& directory, size_t& hits,
+                                size_t& misses)
+{
+    RomScanner scanner(index);
+    if (!directory.empty())
+        scanner.scan(directory);
+    else
+        scanner.rescan();
+    scanner.wait();
+
+    std::vector<ScannedRom> roms;
+    scanner.poll(roms);
+    std::sort(roms.begin(), roms.end(),
+              [](auto const& a, auto const& b) { return a.name < b.name; });
+    hits = scanner.hits();
+    misses = scanner.misses();
+    return roms;
+}
+
+} // namespace
+
+TEST_CASE("Library: scans dedupe ROMs and reuse the index", "[library]")
+{
+    auto directory = std::filesystem::temp_directory_path() / "chipate_library_test";
+    auto index = directory / "index.bin";
+    std::filesystem::remove_all(directory);
+
+    std::vector<uint8_t> pong = {0x12, 0x00};
+    writeFile(directory / "roms" / "pong.ch8", pong);
+    writeFile(directory / "roms" / "nested" / "tetris.CH8", {0x00, 0xe0, 0x12, 0x02});
+    writeFile(directory / "roms" / "copies" / "pong2.ch8", pong);
+    writeFile(directory / "roms" / "readme.txt", {'h', 'i'});
+    writeFile(directory / "roms" / "huge.ch8", std::vector<uint8_t>(MAX_ROM_SIZE + 1, 0x12));
+
+    size_t hits = 0;
+    size_t misses = 0;
+    auto roms = scanAll(index, directory / "roms", hits, misses);
+    REQUIRE(roms.size() == 2);
+    REQUIRE((roms[0].name == "pong" || roms[0].name == "pong2"));
+    REQUIRE(roms[0].hash == fnv1a(pong));
+    REQUIRE(roms[1].name == "tetris");
+    REQUIRE(roms[1].size == 4);
+    REQUIRE(hits == 0);
+    REQUIRE(misses == 3);
+
+    // The next run knows the directory and every file in it
+    roms = scanAll(index, {}, hits, misses);
+    REQUIRE(roms.size() == 2);
+    REQUIRE(hits == 3);
+    REQUIRE(misses == 0);
+
+    // Only what changed is read again
+    std::filesystem::remove(directory / "roms" / "copies" / "pong2.ch8");
+    writeFile(directory / "roms" / "nested" / "tetris.CH8", {0x00, 0xe0, 0x12, 0x02, 0x00, 0x00});
+    roms = scanAll(index, {}, hits, misses);
+    REQUIRE(roms.size() == 2);
+    REQUIRE(roms[0].name == "pong");
+    REQUIRE(roms[1].size == 6);
+    REQUIRE(hits == 1);
+    REQUIRE(misses == 1);
+
+    // A directory queued while the index is still being read joins those in it
+    writeFile(directory / "more" / "maze.ch8", {0x12, 0x04});
+    {
+        RomScanner scanner(index);
+        scanner.scan(directory / "more");
+        scanner.rescan();
+        scanner.wait();
+        REQUIRE(scanner.directories().size() == 2);
+        std::vector<ScannedRom> found;
+        scanner.poll(found);
+        REQUIRE(found.size() == 3);
+    }
+
+    std::filesystem::remove_all(directory);
+}
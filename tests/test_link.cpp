@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "asm.h"
+#include "link.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+char const MAIN[] = R"(
+    start:
+        call draw
+        ld i sprite
+        jp start
+    sprite:
+        db f0 90
+)";
+
+char const DRAW[] = R"(
+    draw:
+        ld v0 0x00
+    loop:
+        drw v0 v0 0x2
+        add v0 0x08
+        se v0 0x40
+        jp loop
+        ret
+)";
+
+} // namespace
+
+TEST_CASE("Link: object modules record exports, imports and relocations", "[link]")
+{
+    auto result = assembleObject(MAIN, "main");
+    REQUIRE(result.ok());
+
+    auto const& module = result.module;
+    REQUIRE(module.code == std::vector<uint8_t>{0x20, 0x00, 0xA0, 0x06, 0x10, 0x00, 0xF0, 0x90});
+    REQUIRE(module.exports ==
+            std::vector<std::pair<std::string, uint16_t>>{{"start", 0}, {"sprite", 6}});
+    REQUIRE(module.imports == std::vector<std::string>{"draw"});
+
+    REQUIRE(module.relocations.size() == 3);
+    REQUIRE(module.relocations[0].offset == 0);
+    REQUIRE(module.relocations[0].symbol == "draw");
+    REQUIRE(module.relocations[1].offset == 2);
+    REQUIRE(module.relocations[1].symbol.empty());
+    REQUIRE(module.relocations[2].offset == 4);
+}
+
+TEST_CASE("Link: modules are laid out from 0x200 and relocated", "[link]")
+{
+    std::vector<ObjectModule> modules{assembleObject(MAIN, "main").module,
+                                      assembleObject(DRAW, "draw").module};
+
+    auto linked = link(modules);
+    REQUIRE(linked.ok());
+    REQUIRE(linked.bases == std::vector<uint16_t>{0x200, 0x208});
+
+    // Same as assembling both at once
+    REQUIRE(linked.bytecode == assembleCached(std::string(MAIN) + DRAW));
+}
+
+TEST_CASE("Link: errors", "[link]")
+{
+    auto main = assembleObject(MAIN, "main").module;
+
+    auto undefined = link(std::vector{main});
+    REQUIRE(!undefined.ok());
+    REQUIRE(undefined.errors[0] == "main: undefined symbol 'draw'");
+    REQUIRE(undefined.bytecode.empty());
+
+    auto twice = link(std::vector{main, main});
+    REQUIRE(!twice.ok());
+    REQUIRE(twice.errors[0] == "'start' exported by main and main");
+
+    auto byte = assembleObject("here: ld v0 here");
+    REQUIRE(!byte.ok());
+    REQUIRE(byte.errors[0].message == "'here' can only be used as an address");
+
+    REQUIRE(!assembleObject("org 0x300").ok());
+    REQUIRE(!assembleObject("x: db x").ok());
+
+    // Constants stay absolute, aliases of labels move with them
+    auto constants = assembleObject("n equ 5\nld v0 n\nl: cls\nm equ l\njp m");
+    REQUIRE(constants.ok());
+    REQUIRE(constants.module.relocations.size() == 1);
+    REQUIRE(constants.module.relocations[0].offset == 4);
+}
+
+TEST_CASE("Link: aliases of a label plus a constant are relocated", "[link]")
+{
+    std::vector<ObjectModule> modules{
+        assembleObject("la: jp lb\nlb: jp la", "first").module,
+        assembleObject("start: cls\nfoo equ start+2\njp foo\njp start+2", "second").module};
+
+    auto linked = link(modules);
+    REQUIRE(linked.ok());
+    REQUIRE(linked.bytecode ==
+            std::vector<uint8_t>{0x12, 0x02, 0x12, 0x00, 0x00, 0xE0, 0x12, 0x06, 0x12, 0x06});
+
+    auto twoLabels = assembleObject("one: cls\ntwo: cls\nc equ one+two\njp c");
+    REQUIRE(!twoLabels.ok());
+    REQUIRE(twoLabels.errors[0].message == "'c' adds up more than one label");
+}
+
+TEST_CASE("Link: objects survive serialization", "[link]")
+{
+    auto module = assembleObject(MAIN, "main").module;
+    auto data = serialize(module);
+    auto copy = deserialize(data);
+    REQUIRE(copy);
+    REQUIRE(copy->hash == module.hash);
+    REQUIRE(copy->code == module.code);
+    REQUIRE(copy->exports == module.exports);
+    REQUIRE(copy->imports == module.imports);
+    REQUIRE(copy->relocations.size() == module.relocations.size());
+    REQUIRE(copy->relocations[0].symbol == "draw");
+
+    data.pop_back();
+    REQUIRE(!deserialize(data));
+}
+
+TEST_CASE("Link: unchanged sources come from the object cache", "[link]")
+{
+    auto directory = std::filesystem::temp_directory_path() / "chipate-test-objects";
+    std::filesystem::remove_all(directory);
+
+    {
+        ObjectCache cache(directory);
+        REQUIRE(cache.get(MAIN, "main").ok());
+        REQUIRE(cache.get(DRAW, "draw").ok());
+        REQUIRE(cache.get(MAIN, "main").ok());
+        REQUIRE(cache.misses() == 2);
+        REQUIRE(cache.hits() == 1);
+
+        REQUIRE(!cache.get("jp nowhere 1").ok());
+    }
+
+    // A new process finds the objects on disk
+    ObjectCache cache(directory);
+    auto main = cache.get(MAIN, "main");
+    REQUIRE(cache.hits() == 1);
+    REQUIRE(cache.misses() == 0);
+    REQUIRE(main.module.name == "main");
+    REQUIRE(main.module.code == assembleObject(MAIN).module.code);
+
+    std::filesystem::remove_all(directory);
+}
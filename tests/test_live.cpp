@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "aot.h"
+#include "chip8.h"
+#include "live.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+// Counts up to 30 with step, then counts the pass in v1 and starts over
+std::string counter(char const* step)
+{
+    return std::string(R"(
+        ld v2 5
+    loop:
+        )") + step + R"(
+        se v0 30
+        jp loop
+        add v1 1
+        ld v0 0
+        jp loop
+)";
+}
+
+} // namespace
+
+TEST_CASE("Live: the first update is the whole program", "[live]")
+{
+    LiveSource live;
+    auto update = live.update(counter("add v0 3"));
+    REQUIRE(update);
+    REQUIRE(update->relaid);
+    REQUIRE(update->patches.size() == 1);
+    REQUIRE(update->patches[0].address == 0x200);
+    REQUIRE(update->patches[0].bytes == live.bytecode());
+    REQUIRE(live.bytecode().size() == 14);
+}
+
+TEST_CASE("Live: changed lines assemble on their own", "[live]")
+{
+    LiveSource live;
+    REQUIRE(live.update(counter("add v0 3")));
+
+    auto update = live.update(counter("add v0 10"));
+    REQUIRE(update);
+    REQUIRE(!update->relaid);
+    REQUIRE(update->linesAssembled == 1);
+    REQUIRE(update->patches.size() == 1);
+    REQUIRE(update->patches[0].address == 0x203);
+    REQUIRE(update->patches[0].bytes == std::vector<uint8_t>{10});
+
+    // Nothing changed, nothing to patch
+    update = live.update(counter("add v0 10"));
+    REQUIRE(update);
+    REQUIRE(update->linesAssembled == 0);
+    REQUIRE(update->patches.empty());
+}
+
+TEST_CASE("Live: moved code assembles the whole source", "[live]")
+{
+    LiveSource live;
+    auto source = counter("add v0 3");
+    REQUIRE(live.update(source));
+
+    auto update = live.update("        cls\n" + source);
+    REQUIRE(update);
+    REQUIRE(update->relaid);
+    REQUIRE(live.bytecode().size() == 16);
+    REQUIRE(live.map().labels[0].address == 0x204);
+
+    // Shorter again, the bytes past the end are cleared
+    update = live.update("ld v0 1");
+    REQUIRE(update);
+    REQUIRE(update->patches.back().address + update->patches.back().bytes.size() == 0x210);
+    REQUIRE(update->patches.back().bytes.back() == 0);
+}
+
+TEST_CASE("Live: errors keep the running program", "[live]")
+{
+    LiveSource live;
+    REQUIRE(live.update(counter("add v0 3")));
+    auto program = live.bytecode();
+
+    REQUIRE(!live.update(counter("add v0 v0 v0")));
+    REQUIRE(live.errors().size() == 1);
+    REQUIRE(live.errors()[0].line == 4);
+    REQUIRE(live.bytecode() == program);
+
+    REQUIRE(live.update(counter("add v0 5")));
+    REQUIRE(live.errors().empty());
+}
+
+TEST_CASE("Live: patches apply without a reset and drop fused code", "[live]")
+{
+    LiveSource live;
+    REQUIRE(live.update(counter("add v0 3")));
+
+    Chip8 running;
+    running.init(live.bytecode());
+    running.run(100);
+    auto registers = AotAccess::V(running);
+    REQUIRE(registers[2] == 5);
+
+    // A load where the add was, so the fused add, skip and jump no longer applies
+    auto update = live.update(counter("ld v0 30"));
+    REQUIRE(update);
+    for (auto const& patch: update->patches)
+        running.patch(patch.address, patch.bytes);
+    REQUIRE(AotAccess::V(running) == registers);
+
+    // From the same state, the patched machine has to behave like one loaded with the new code
+    Chip8 fresh;
+    fresh.init(live.bytecode());
+    for (auto* cpu: {&running, &fresh}) {
+        AotAccess::V(*cpu) = {7};
+        AotAccess::PC(*cpu) = 0x202;
+        cpu->run(100);
+    }
+    REQUIRE(AotAccess::V(running) == AotAccess::V(fresh));
+}
+
+TEST_CASE("Live: the source file is read again once written", "[live]")
+{
+    auto path = std::filesystem::temp_directory_path() / "chipate_live_test.asm";
+    auto write = [&](std::string const& text) {
+        FILE* file = fopen(path.string().c_str(), "wb");
+        REQUIRE(file);
+        fwrite(text.data(), 1, text.size(), file);
+        fclose(file);
+    };
+
+    write(counter("add v0 3"));
+    LiveSource live(path);
+    REQUIRE(live.changed());
+    REQUIRE(live.reload());
+    REQUIRE(!live.changed());
+    REQUIRE(live.map().files == std::vector<std::string>{"chipate_live_test.asm"});
+
+    write(counter("add v0 6"));
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) +
+                                               std::chrono::seconds(1));
+    REQUIRE(live.changed());
+    auto update = live.reload();
+    REQUIRE(update);
+    REQUIRE(update->patches.size() == 1);
+
+    std::filesystem::remove(path);
+}
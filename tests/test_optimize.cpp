@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "aot.h"
+#include "asm.h"
+#include "chip8.h"
+#include "link.h"
+#include "optimize.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+// Runs both programs into their final loop, registers have to match. So does I unless code was
+// removed, as that moves the data after it.
+void requireSameResult(std::string_view original, std::string_view optimized,
+                       Quirks const& quirks)
+{
+    auto before = assembleCached(original);
+    auto after = assembleCached(optimized);
+    Chip8 a;
+    Chip8 b;
+    a.init(before, quirks);
+    b.init(after, quirks);
+    a.run(200);
+    b.run(200);
+    REQUIRE(AotAccess::V(a) == AotAccess::V(b));
+    if (before.size() == after.size())
+        REQUIRE(AotAccess::I(a) == AotAccess::I(b));
+}
+
+std::string line(std::string const& source, size_t number)
+{
+    size_t begin = 0;
+    for (size_t i = 1; i < number; ++i)
+        begin = source.find('\n', begin) + 1;
+    return source.substr(begin, source.find('\n', begin) - begin);
+}
+
+char const REDUNDANT[] = R"(
+        ld v0 5
+        ld v2 5
+        add v3 v2
+        ld v2 v0
+        ld v0 5
+        ld v1 v1
+    set:
+        ld v3 v2
+        ld v3 1
+        add v3 v2
+    end:
+        jp end
+)";
+
+} // namespace
+
+TEST_CASE("Optimize: VIP cycle costs", "[optimize]")
+{
+    REQUIRE(vipCycles(0x6012) == 6);
+    REQUIRE(vipCycles(0x8120) == 44);
+    REQUIRE(vipCycles(0xA200) == 12);
+    REQUIRE(vipCycles(0xF21E) == 19);
+    REQUIRE(vipCycles(0x1200) == 23);
+    REQUIRE(vipCycles(0xD125) > vipCycles(0xF333));
+}
+
+TEST_CASE("Optimize: redundant and dead register loads", "[optimize]")
+{
+    auto result = optimizeSource(REDUNDANT, CHIP8_QUIRKS);
+    REQUIRE(result.errors.empty());
+
+    REQUIRE(line(result.source, 3) == "        ld v2 5");
+    REQUIRE(line(result.source, 5) == "; optimized out: ld v2 v0");
+    REQUIRE(line(result.source, 6) == "; optimized out: ld v0 5");
+    REQUIRE(line(result.source, 7) == "; optimized out: ld v1 v1");
+    // The label resets what is known, the dead store goes anyway
+    REQUIRE(line(result.source, 9) == "; optimized out: ld v3 v2");
+    REQUIRE(line(result.source, 10) == "        ld v3 1");
+
+    REQUIRE(result.bytes == 8);
+    REQUIRE(result.cycles == 44 + 6 + 44 + 44);
+    REQUIRE(result.routines.size() == 2);
+    REQUIRE(result.routines[0].label == "(start)");
+    REQUIRE(result.routines[0].address == 0x206);
+    REQUIRE(result.routines[0].rewrites == 3);
+    REQUIRE(result.routines[1].label == "set");
+    REQUIRE(result.routines[1].cycles == 44);
+
+    REQUIRE(assembleCached(result.source).size() == assembleCached(REDUNDANT).size() - 8);
+    requireSameResult(REDUNDANT, result.source, CHIP8_QUIRKS);
+}
+
+TEST_CASE("Optimize: ld f may change Vx", "[optimize]")
+{
+    char const SOURCE[] = R"(
+        ld v0 0x1f
+        ld f v0
+        ld v0 0x1f
+        ld v1 v0
+    end:
+        jp end
+)";
+    auto result = optimizeSource(SOURCE, CHIP8_QUIRKS);
+    REQUIRE(result.errors.empty());
+    REQUIRE(line(result.source, 4) == "        ld v0 0x1f");
+    requireSameResult(SOURCE, result.source, CHIP8_QUIRKS);
+}
+
+TEST_CASE("Optimize: add i chains become one ld i", "[optimize]")
+{
+    char const source[] = R"(
+        ld v0 3
+        ld i sprite
+        add i v0
+        add i v0
+        ld v1 [i]
+    end:
+        jp end
+    sprite:
+        db 01 02 03 04 05 06 07 08
+)";
+
+    auto result = optimizeSource(source, CHIP8_QUIRKS);
+    REQUIRE(line(result.source, 3) == "; optimized out: ld i sprite");
+    REQUIRE(line(result.source, 4) == "; optimized out: ld i sprite+3 ; optimized: add i v0");
+    REQUIRE(line(result.source, 5) == "ld i sprite+6 ; optimized: add i v0");
+    REQUIRE(result.bytes == 4);
+    REQUIRE(result.cycles == 7 + 7 + 12 + 12);
+
+    requireSameResult(source, result.source, CHIP8_QUIRKS);
+
+    Chip8 cpu;
+    cpu.init(assembleCached(result.source));
+    cpu.run(10);
+    REQUIRE(AotAccess::V(cpu)[0] == 7);
+    REQUIRE(AotAccess::V(cpu)[1] == 8);
+}
+
+TEST_CASE("Optimize: skip over a jump becomes the inverted skip", "[optimize]")
+{
+    for (auto value: {"1", "2"}) {
+        std::string source = std::string("ld v0 ") + value + R"(
+    test:
+        se v0 1
+        jp skip
+        ld v1 9
+    skip:
+        add v1 1
+    end:
+        jp end
+)";
+
+        auto result = optimizeSource(source, CHIP8_QUIRKS);
+        REQUIRE(line(result.source, 3) == "sne v0 1 ; optimized: se v0 1");
+        REQUIRE(line(result.source, 4) == "; optimized out: jp skip");
+        REQUIRE(result.routines.size() == 1);
+        REQUIRE(result.routines[0].label == "test");
+        REQUIRE(result.routines[0].cycles == 23);
+        requireSameResult(source, result.source, CHIP8_QUIRKS);
+    }
+}
+
+TEST_CASE("Optimize: conditional instructions stay", "[optimize]")
+{
+    char const source[] = R"(
+        ld v0 1
+        se v0 1
+        ld v1 v1
+        sknp v0
+        ld v2 3
+        ld v2 4
+    end:
+        jp end
+)";
+
+    auto result = optimizeSource(source, CHIP8_QUIRKS);
+    REQUIRE(result.cycles == 0);
+    REQUIRE(result.source == source);
+}
+
+TEST_CASE("Optimize: VF stores depend on the quirks", "[optimize]")
+{
+    char const source[] = R"(
+        ld vf 1
+        or v0 v1
+    end:
+        jp end
+)";
+
+    // Logic resets VF on the original interpreter, so the store is dead
+    auto chip8 = optimizeSource(source, CHIP8_QUIRKS);
+    REQUIRE(line(chip8.source, 2) == "; optimized out: ld vf 1");
+    requireSameResult(source, chip8.source, CHIP8_QUIRKS);
+
+    auto schip = optimizeSource(source, SCHIP_MODERN_QUIRKS);
+    REQUIRE(schip.source == source);
+
+    // Whether I is known after a store depends on the quirks as well
+    char const store[] = R"(
+        ld v0 1
+        ld i 0x300
+        ld [i] v0
+        add i v0
+    end:
+        jp end
+)";
+    REQUIRE(optimizeSource(store, CHIP8_QUIRKS).cycles == 0);
+    auto incremented = optimizeSource(store, SCHIP_MODERN_QUIRKS);
+    REQUIRE(line(incremented.source, 5) == "ld i 0x302 ; optimized: add i v0");
+}
+
+TEST_CASE("Optimize: numeric addresses keep the layout", "[optimize]")
+{
+    char const source[] = R"(
+        ld v1 v1
+        ld v0 2
+        ld i 0x300
+        add i v0
+        jp 0x208
+)";
+
+    auto result = optimizeSource(source, CHIP8_QUIRKS);
+    REQUIRE(line(result.source, 2) == "        ld v1 v1");
+    REQUIRE(line(result.source, 5) == "ld i 0x302 ; optimized: add i v0");
+    REQUIRE(result.bytes == 0);
+    REQUIRE(assembleCached(result.source).size() == assembleCached(source).size());
+    requireSameResult(source, result.source, CHIP8_QUIRKS);
+
+    auto errors = optimizeSource("ld v0 300", CHIP8_QUIRKS);
+    REQUIRE(errors.errors.size() == 1);
+    REQUIRE(errors.source == "ld v0 300");
+}
+
+TEST_CASE("Optimize: label offsets assemble and link", "[optimize]")
+{
+    auto program = assembleCached("ld i data+2\ndata: db 01 02 03");
+    REQUIRE(program == std::vector<uint8_t>{0xA2, 0x04, 0x01, 0x02, 0x03});
+
+    std::vector<ObjectModule> modules{assembleObject("ld i table+1", "main").module,
+                                      assembleObject("table: db 05 06", "table").module};
+    REQUIRE(modules[0].imports == std::vector<std::string>{"table"});
+    auto linked = link(modules);
+    REQUIRE(linked.ok());
+    REQUIRE(linked.bytecode == std::vector<uint8_t>{0xA2, 0x03, 0x05, 0x06});
+}
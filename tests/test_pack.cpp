@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "pack.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+std::filesystem::path packPath(char const* name)
+{
+    return std::filesystem::temp_directory_path() / name;
+}
+
+std::vector<PackRom> library()
+{
+    PackRom snake{.name = "snake", .title = "Snake", .authors = "TomR", .platform = "schip"};
+    snake.options = {.tickrate = 30, .shiftQuirks = true, .clipQuirks = false};
+    snake.rom = {0x60, 0x01, 0x12, 0x02};
+
+    PackRom copy{.name = "snake-copy"};
+    copy.rom = snake.rom;
+
+    PackRom breakout{.name = "br8kout", .title = "Br8kout", .platform = "chip8"};
+    breakout.rom = {0x00, 0xe0, 0x12, 0x00, 0xf0};
+    return {snake, copy, breakout};
+}
+
+} // namespace
+
+TEST_CASE("Pack: written ROMs are found by name and content", "[pack]")
+{
+    auto path = packPath("chipate_test.c8pk");
+    REQUIRE(writePack(path, library()));
+
+    RomPack pack;
+    REQUIRE(pack.open(path));
+    REQUIRE(pack.size() == 3);
+
+    // Sorted by name
+    REQUIRE(std::string_view(pack.string(pack[0].name)) == "br8kout");
+    REQUIRE(std::string_view(pack.string(pack[2].name)) == "snake-copy");
+
+    auto snake = pack.find("snake");
+    REQUIRE(snake);
+    auto const& entry = pack[*snake];
+    REQUIRE(std::string_view(pack.string(entry.title)) == "Snake");
+    REQUIRE(std::string_view(pack.string(entry.platform)) == "schip");
+    auto rom = pack.rom(entry);
+    REQUIRE(std::vector<uint8_t>(rom.begin(), rom.end()) == library()[0].rom);
+
+    auto options = pack.options(entry);
+    REQUIRE(options.tickrate == 30);
+    REQUIRE(options.shiftQuirks == true);
+    REQUIRE(options.clipQuirks == false);
+    REQUIRE(!options.jumpQuirks);
+
+    // A ROM without a title is listed by its name, and identical ROMs are stored once
+    auto copy = pack.find("snake-copy");
+    REQUIRE(copy);
+    REQUIRE(std::string_view(pack.string(pack[*copy].title)) == "snake-copy");
+    REQUIRE(pack[*copy].romOffset == entry.romOffset);
+    REQUIRE(!*pack.string(pack[*copy].platform));
+
+    REQUIRE(!pack.find("tetris"));
+    auto found = pack.find(rom);
+    REQUIRE(found);
+    REQUIRE(pack.rom(pack[*found]).data() == rom.data());
+    REQUIRE(!pack.find(std::vector<uint8_t>{0x12, 0x00}));
+
+    // Moving keeps the mapping
+    RomPack moved = std::move(pack);
+    REQUIRE(!pack.isOpen());
+    REQUIRE(moved.find("br8kout") == 0u);
+
+    moved.close();
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Pack: broken files are rejected", "[pack]")
+{
+    RomPack pack;
+    REQUIRE(!pack.open(packPath("chipate_missing.c8pk")));
+
+    auto path = packPath("chipate_broken.c8pk");
+    REQUIRE(writePack(path, library()));
+    // Cut off in the middle of the ROMs
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 2);
+    REQUIRE(!pack.open(path));
+    REQUIRE(!pack.isOpen());
+
+    auto twice = library();
+    twice.push_back(twice[0]);
+    REQUIRE(!writePack(path, twice));
+
+    // ROMs that do not fit in memory are neither written nor read
+    PackRom large{.name = "large"};
+    large.rom.assign(MAX_ROM_SIZE + 1, 0);
+    REQUIRE(!writePack(path, {large}));
+
+    auto halves = library();
+    for (uint8_t half = 0; half < 2; ++half) {
+        PackRom rom{.name = half ? "second" : "first"};
+        rom.rom.assign(MAX_ROM_SIZE, half);
+        halves.push_back(rom);
+    }
+    REQUIRE(writePack(path, halves));
+    REQUIRE(pack.open(path));
+    PackEntry entry = pack[*pack.find("first")];
+    REQUIRE(pack.rom(entry).size() == MAX_ROM_SIZE);
+    entry.romSize = MAX_ROM_SIZE + 1;
+    REQUIRE(pack.rom(entry).empty());
+    pack.close();
+
+    std::filesystem::remove(path);
+}
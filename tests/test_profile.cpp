@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "asm.h"
+#include "chip8.h"
+#include "link.h"
+#include "profile.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+char const SOURCE[] = R"(
+        ld v0 0
+    loop:
+        call count
+        jp loop
+    count:
+        add v1 1
+        se v1 0
+        ret
+        add v2 1
+        ret
+    sprite:
+        db f0 90
+)";
+
+} // namespace
+
+TEST_CASE("Profile: assembler source map", "[profile]")
+{
+    SourceMap map;
+    map.files = {"game.asm"};
+    auto result = assembleSource(SOURCE, 0x200, &map);
+    REQUIRE(result.ok());
+
+    REQUIRE(map.files.size() == 1);
+    REQUIRE(map.labels.size() == 3);
+    REQUIRE(map.labels[1].name == "count");
+    REQUIRE(map.labels[1].address == 0x206);
+    REQUIRE(map.entries.size() == 9);
+
+    auto first = map.find(0x200);
+    REQUIRE(first);
+    REQUIRE(first->line == 2);
+    REQUIRE(first->label == SourceMap::NO_LABEL);
+
+    auto ret = map.find(0x20b);
+    REQUIRE(ret);
+    REQUIRE(ret->address == 0x20a);
+    REQUIRE(ret->line == 9);
+    REQUIRE(map.labels[ret->label].name == "count");
+
+    auto db = map.find(0x211);
+    REQUIRE(db);
+    REQUIRE(db->size == 2);
+    REQUIRE(map.labels[db->label].name == "sprite");
+
+    REQUIRE(!map.find(0x212));
+    REQUIRE(!map.find(0x100));
+}
+
+TEST_CASE("Profile: linked maps cover every module", "[profile]")
+{
+    std::vector<ObjectModule> modules{
+        assembleObject("start: call draw\njp start", "main.asm").module,
+        assembleObject("draw: ret", "draw.asm").module};
+    auto linked = link(modules);
+    REQUIRE(linked.ok());
+
+    REQUIRE(linked.map.files == std::vector<std::string>{"main.asm", "draw.asm"});
+    auto draw = linked.map.find(0x204);
+    REQUIRE(draw);
+    REQUIRE(draw->file == 1);
+    REQUIRE(draw->line == 1);
+    REQUIRE(linked.map.labels[draw->label].name == "draw");
+    REQUIRE(linked.map.labels[draw->label].address == 0x204);
+}
+
+TEST_CASE("Profile: execution counts by routine and line", "[profile]")
+{
+    SourceMap map;
+    map.files = {"game.asm"};
+    auto program = assembleSource(SOURCE, 0x200, &map).bytecode;
+
+    Chip8 cpu;
+    cpu.init(program);
+    cpu.setPcProfiling(true);
+    cpu.run(1 + 2 * 4 + 3 * 4); // ld, 4 x (call, jp), 4 x (add, se, ret)
+
+    auto counts = cpu.pcCounts();
+    REQUIRE(counts[0x200] == 1);
+    REQUIRE(counts[0x202] == 4);
+    REQUIRE(counts[0x20a] == 4);
+    REQUIRE(counts[0x20c] == 0);
+
+    auto profile = buildProfile(counts, &map);
+    REQUIRE(profile.total == 21);
+    REQUIRE(profile.unmapped == 0);
+
+    REQUIRE(profile.routines.size() == 3);
+    REQUIRE(profile.routines[0].name == "count");
+    REQUIRE(profile.routines[0].count == 12);
+    REQUIRE(profile.routines[1].name == "loop");
+    REQUIRE(profile.routines[1].count == 8);
+    REQUIRE(profile.routines[2].name == "(game.asm)");
+
+    REQUIRE(profile.lines[0].name == "game.asm:4");
+    REQUIRE(profile.lines[0].count == 4);
+
+    // Without a map hot addresses are all there is
+    auto raw = buildProfile(counts);
+    REQUIRE(raw.routines.empty());
+    REQUIRE(raw.lines.size() == 6);
+    REQUIRE(raw.lines[0].name == "0x202");
+
+    auto report = formatProfile(profile);
+    REQUIRE(report.find("count") != std::string::npos);
+    REQUIRE(report.find("57.14%") != std::string::npos);
+}
+
+TEST_CASE("Profile: source maps survive their text form", "[profile]")
+{
+    SourceMap map;
+    map.files = {"my game.asm"};
+    REQUIRE(assembleSource(SOURCE, 0x200, &map).ok());
+
+    auto parsed = parseSourceMap(formatSourceMap(map));
+    REQUIRE(parsed);
+    REQUIRE(parsed->files == map.files);
+    REQUIRE(parsed->labels.size() == map.labels.size());
+    REQUIRE(parsed->labels[2].name == "sprite");
+    REQUIRE(parsed->entries.size() == map.entries.size());
+    REQUIRE(parsed->find(0x20a)->line == 9);
+    REQUIRE(parsed->find(0x200)->label == SourceMap::NO_LABEL);
+
+    REQUIRE(!parseSourceMap("0x200 2 0 1 -\n"));   // No such file
+    REQUIRE(!parseSourceMap("file a\n0x200 2 0\n")); // Missing fields
+}
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "rom.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace chipate;
+
+TEST_CASE("ROM profile: platform presets and archive options", "[rom]")
+{
+    auto plain = romProfile("chip8", {});
+    REQUIRE(plain.quirks == CHIP8_QUIRKS);
+    REQUIRE(plain.tickRate == DEFAULT_TICK_RATE);
+    REQUIRE(romProfile("schip", {}).quirks == SCHIP_1_0_QUIRKS);
+    REQUIRE(romProfile("xochip", {}).quirks == SCHIP_MODERN_QUIRKS);
+
+    auto tuned = romProfile("chip8", {.tickrate = 7, .shiftQuirks = true, .jumpQuirks = true});
+    REQUIRE(tuned.tickRate == 7);
+    REQUIRE(tuned.quirks.shiftVxOnly);
+    REQUIRE(tuned.quirks.jumpWithVx);
+    REQUIRE(!tuned.quirks.legacySchipScroll);
+
+    // Octo's flags name what turns the original behaviour off
+    auto octo = romProfile("chip8", {.loadStoreQuirks = false, .logicQuirks = true,
+                                     .clipQuirks = false});
+    REQUIRE(octo.quirks.loadStoreIAdd);
+    REQUIRE(!octo.quirks.logicNoVF);
+    REQUIRE(octo.quirks.spriteWrap);
+
+    REQUIRE(romProfile("chip8", {.tickrate = 0}).tickRate == DEFAULT_TICK_RATE);
+}
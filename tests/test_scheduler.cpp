@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "asm.h"
+#include "chip8.h"
+#include "scheduler.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <deque>
+#include <string>
+
+using namespace chipate;
+
+namespace {
+
+// Waits for a key and draws its hex digit at (0, 0)
+std::string const keyDigit = R"(
+    ld v0 k
+    ld f v0
+    drw v1 v1 0x5
+    cls
+    jp 0x200
+)";
+
+bool blank(Chip8 const& cpu)
+{
+    for (auto const& col: cpu.fb())
+        if (col.any())
+            return false;
+    return true;
+}
+
+} // namespace
+
+TEST_CASE("Scheduler: key waiting machines are only resumed by setKey", "[scheduler]")
+{
+    std::deque<Chip8> machines(1000);
+    Scheduler scheduler;
+
+    for (auto& m: machines) {
+        m.init(assembleCached(keyDigit));
+        scheduler.add(m, 100);
+    }
+
+    scheduler.frame();
+    REQUIRE(scheduler.waitingForKey() == machines.size());
+
+    for (size_t i = 0; i < machines.size(); i += 10)
+        scheduler.setKey(i, 8, true);
+    REQUIRE(scheduler.waitingForKey() == machines.size() - 100);
+
+    scheduler.frame();
+
+    for (size_t i = 0; i < machines.size(); ++i)
+        REQUIRE(blank(machines[i]) == (i % 10 != 0));
+}
+
+TEST_CASE("Scheduler: frame budget is split into slices", "[scheduler]")
+{
+    // DRW is the 97th instruction
+    std::string const program = R"(
+        ld v1 0x00
+        add v1 0x01
+        se v1 0x20
+        jp 0x202
+        drw v0 v0 0x1
+        jp 0x20a
+    )";
+
+    Chip8 enough;
+    Chip8 tooFew;
+    Scheduler scheduler(1, 7);
+
+    enough.init(assembleCached(program));
+    tooFew.init(assembleCached(program));
+    scheduler.add(enough, 97);
+    scheduler.add(tooFew, 96);
+
+    scheduler.frame();
+    REQUIRE(!blank(enough));
+    REQUIRE(blank(tooFew));
+
+    scheduler.frame();
+    REQUIRE(!blank(tooFew));
+}
+
+TEST_CASE("Scheduler: worker threads produce the same frames", "[scheduler]")
+{
+    std::string const program = R"(
+        ld v0 0x00
+        ld v1 0x00
+        ld f v0
+        cls
+        drw v1 v1 0x5
+        add v0 0x01
+        ld v2 0x0f
+        and v0 v2
+        jp 0x204
+    )";
+
+    std::deque<Chip8> serial(64);
+    std::deque<Chip8> parallel(64);
+    Scheduler one(1, 3);
+    Scheduler four(4, 3);
+
+    for (size_t i = 0; i < serial.size(); ++i) {
+        serial[i].init(assembleCached(program));
+        parallel[i].init(assembleCached(program));
+        one.add(serial[i], 20 + i);
+        four.add(parallel[i], 20 + i);
+    }
+
+    for (int frame = 0; frame < 30; ++frame) {
+        one.frame();
+        four.frame();
+    }
+
+    for (size_t i = 0; i < serial.size(); ++i)
+        REQUIRE(serial[i].fb() == parallel[i].fb());
+}
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: WTFPL
+
+#include "search.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <vector>
+
+using namespace chipate;
+
+TEST_CASE("Search: trigrams find titles despite case, typos and order", "[search]")
+{
+    TrigramIndex index;
+    REQUIRE(index.add("Br8kout") == 0);
+    index.add("Snake");
+    index.add("Super Snake 2");
+    index.add("Space Invaders");
+    index.add("Tetris");
+
+    std::vector<uint32_t> ids;
+    index.search("", ids);
+    REQUIRE(ids == std::vector<uint32_t>{0, 1, 2, 3, 4});
+
+    // Both snakes, the closer match first
+    index.search("SNAKE", ids);
+    REQUIRE(ids == std::vector<uint32_t>{1, 2});
+    index.search("snale", ids);
+    REQUIRE(!ids.empty());
+    REQUIRE(ids[0] == 1);
+
+    index.search("invaders space", ids);
+    REQUIRE(ids == std::vector<uint32_t>{3});
+    index.search("space-invaders!", ids);
+    REQUIRE(ids == std::vector<uint32_t>{3});
+
+    // Too short for a trigram, so anything containing it
+    index.search("sn", ids);
+    REQUIRE(ids == std::vector<uint32_t>{1, 2});
+
+    index.search("pong", ids);
+    REQUIRE(ids.empty());
+
+    // Searching leaves nothing behind for the next search
+    index.search("snake", ids);
+    REQUIRE(ids == std::vector<uint32_t>{1, 2});
+}
+
+TEST_CASE("Search: large libraries", "[search]")
+{
+    TrigramIndex index;
+    for (int i = 0; i < 50000; ++i)
+        index.add("Game " + std::to_string(i) + (i % 100 ? " Demo" : " Breakout"));
+    REQUIRE(index.size() == 50000);
+
+    std::vector<uint32_t> ids;
+    index.search("breakout", ids);
+    REQUIRE(ids.size() == 500);
+    index.search("game 4242 demo", ids);
+    REQUIRE(!ids.empty());
+    REQUIRE(ids[0] == 4242);
+}
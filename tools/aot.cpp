@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: WTFPL
+
+// Ahead-of-time translator: turns a ROM into a C++ translation unit with one function per
+// basic block of its CFG, to be linked with aot.cpp and the interpreter
+
+#include "analysis.h"
+#include "log.h"
+#include "opcode.h"
+#include "rom.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <raylib.h>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+uint16_t const ORIGIN = 0x200;
+
+// How the translator treats an instruction
+enum class Kind
+{
+    Inline,      // Emitted as C++
+    Fallback,    // Emitted as a call into the interpreter, can not stop or fault
+    Jump,        // Ends the block with a known target
+    Skip,        // Ends the block with two successors
+    Indirect,    // Emitted as C++ ending the block, the target is only known at runtime (Bnnn)
+    Interpreted, // Can stop run() or fault, left to the interpreter between blocks
+    Call,        // Interpreted, execution continues at nnn and later at the return address
+    Return,      // Interpreted, target only known at runtime
+    Invalid      // Not an instruction
+};
+
+Kind classify(uint16_t data)
+{
+    auto match = decode(data);
+    if (!match)
+        return Kind::Invalid;
+
+    switch (match->opcode) {
+    case LD:
+    case ADD:
+    case LDR:
+    case OR:
+    case AND:
+    case XOR:
+    case ADDC:
+    case SUB:
+    case SUBN:
+    case LDI:
+    case LDRD:
+    case LDDR:
+    case ADDI:
+        return Kind::Inline;
+    case CLS:
+    case SHR:
+    case SHL:
+    case RND:
+    case LDS:
+    case LDRM:
+    case HIRS:
+    case LORS:
+    case SCRD:
+    case SCRL:
+    case SCRR:
+        return Kind::Fallback;
+    case JP:
+        return Kind::Jump;
+    case SE:
+    case SNE:
+    case SER:
+    case SNER:
+    case SKP:
+    case SKNP:
+        return Kind::Skip;
+    case JPO:
+        return Kind::Indirect;
+    case CALL:
+        return Kind::Call;
+    case RET:
+        return Kind::Return;
+    case DRW:
+    case LDK:
+    case LDSR:
+    case LBCD:
+    case LDMR:
+        return Kind::Interpreted;
+    }
+    return Kind::Invalid;
+}
+
+class Translator {
+public:
+    Translator(std::vector<uint8_t> const& rom, Analysis const& analysis)
+        : rom(rom)
+    {
+        // Blocks of the CFG, split after everything the interpreter has to run on its own
+        for (auto const& [start, block]: analysis.blocks) {
+            leaders.insert(start);
+            for (uint16_t address = start; address + 2 < block.end; address += 2)
+                if (classify(word(address)) == Kind::Interpreted)
+                    leaders.insert(address + 2);
+        }
+    }
+
+    void emit(FILE* out, std::string_view name)
+    {
+        fprintf(out, "// Generated by chipate-aot from %.*s, do not edit\n\n",
+                static_cast<int>(name.size()), name.data());
+        fprintf(out, "#include \"aot.h\"\n\n");
+        fprintf(out, "using chipate::AotAccess;\nusing chipate::Chip8;\n\n");
+        fprintf(out, "namespace {\n\n");
+
+        fprintf(out, "uint8_t const rom[] = {");
+        for (size_t i = 0; i < rom.size(); ++i)
+            fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n    ", rom[i]);
+        fprintf(out, "\n};\n\n");
+
+        std::vector<std::string> table;
+        for (uint16_t leader: leaders) {
+            if (auto entry = emitBlock(out, leader); !entry.empty())
+                table.push_back(entry);
+        }
+
+        fprintf(out, "chipate::AotBlock const blocks[] = {\n");
+        for (auto const& entry: table)
+            fprintf(out, "    %s,\n", entry.c_str());
+        if (table.empty())
+            fprintf(out, "    {0, 0, 0, nullptr},\n");
+        fprintf(out, "};\n\n");
+        fprintf(out, "} // namespace\n\n");
+
+        fprintf(out, "chipate::AotProgram const& chipate::aotProgram()\n{\n");
+        fprintf(out, "    static AotProgram const program{\"%.*s\", rom, std::span(blocks, %zu)};\n",
+                static_cast<int>(name.size()), name.data(), table.size());
+        fprintf(out, "    return program;\n}\n");
+    }
+
+private:
+    std::vector<uint8_t> const& rom;
+    std::set<uint16_t> leaders;
+
+    bool inRom(uint16_t address) const
+    {
+        return address >= ORIGIN && address + 1u < ORIGIN + rom.size();
+    }
+
+    uint16_t word(uint16_t address) const
+    {
+        return rom[address - ORIGIN] << 8 | rom[address - ORIGIN + 1];
+    }
+
+    // Emits the block starting at address, returns its table entry or nothing if the first
+    // instruction has to be interpreted anyway
+    std::string emitBlock(FILE* out, uint16_t start)
+    {
+        std::string body;
+        uint16_t address = start;
+        size_t instructions = 0;
+        bool open = true;
+
+        while (open) {
+            if (address != start && leaders.contains(address))
+                break;
+            if (!inRom(address))
+                break;
+
+            uint16_t data = word(address);
+            Kind kind = classify(data);
+
+            if (kind == Kind::Interpreted || kind == Kind::Call || kind == Kind::Return ||
+                kind == Kind::Invalid)
+                break;
+
+            body += statement(address, data, kind);
+            address += 2;
+            instructions++;
+            open = kind == Kind::Inline || kind == Kind::Fallback;
+        }
+
+        if (!instructions)
+            return {};
+
+        fprintf(out, "// 0x%03x - 0x%03x\n", start, address - 1);
+        fprintf(out, "size_t block_%03x(Chip8& c)\n{\n", start);
+        fprintf(out, "    [[maybe_unused]] auto& V = AotAccess::V(c);\n");
+        fprintf(out, "    [[maybe_unused]] auto& I = AotAccess::I(c);\n");
+        fprintf(out, "    auto& PC = AotAccess::PC(c);\n\n");
+        fprintf(out, "%s", body.c_str());
+        if (open)
+            fprintf(out, "    PC = 0x%03x;\n", address);
+        fprintf(out, "    return %zu;\n}\n\n", instructions);
+
+        char entry[64];
+        snprintf(entry, sizeof(entry), "{0x%03x, %u, %zu, block_%03x}", start, address - start,
+                 instructions, start);
+        return entry;
+    }
+
+    static std::string statement(uint16_t address, uint16_t data, Kind kind)
+    {
+        unsigned x = (data & 0x0F00) >> 8;
+        unsigned y = (data & 0x00F0) >> 4;
+        unsigned kk = data & 0x00FF;
+        unsigned nnn = data & 0x0FFF;
+
+        char line[160] = "";
+
+        if (kind == Kind::Fallback) {
+            snprintf(line, sizeof(line), "    AotAccess::exec(c, 0x%03x, 0x%04x);\n", address, data);
+            return line;
+        }
+
+        switch (data & 0xF000) {
+        case 0x1000:
+            snprintf(line, sizeof(line), "    PC = 0x%03x;\n", nnn);
+            break;
+        case 0x3000:
+        case 0x4000:
+            snprintf(line, sizeof(line), "    PC = V[0x%x] %s 0x%02x ? 0x%03x : 0x%03x;\n", x,
+                     (data & 0xF000) == 0x3000 ? "==" : "!=", kk, address + 4, address + 2);
+            break;
+        case 0x5000:
+        case 0x9000:
+            snprintf(line, sizeof(line), "    PC = V[0x%x] %s V[0x%x] ? 0x%03x : 0x%03x;\n", x,
+                     (data & 0xF000) == 0x5000 ? "==" : "!=", y, address + 4, address + 2);
+            break;
+        case 0x6000:
+            snprintf(line, sizeof(line), "    V[0x%x] = 0x%02x;\n", x, kk);
+            break;
+        case 0x7000:
+            snprintf(line, sizeof(line), "    V[0x%x] += 0x%02x;\n", x, kk);
+            break;
+        case 0x8000:
+            switch (data & 0x000F) {
+            case 0x0:
+                snprintf(line, sizeof(line), "    V[0x%x] = V[0x%x];\n", x, y);
+                break;
+            case 0x1:
+            case 0x2:
+            case 0x3: {
+                char const* op = (data & 0x000F) == 1 ? "|" : (data & 0x000F) == 2 ? "&" : "^";
+                snprintf(line, sizeof(line), "    V[0x%x] %s= V[0x%x];\n    V[0xf] = 0;\n", x, op,
+                         y);
+                break;
+            }
+            case 0x4:
+                snprintf(line, sizeof(line),
+                         "    {\n        unsigned sum = V[0x%x] + V[0x%x];\n"
+                         "        V[0x%x] = sum;\n        V[0xf] = sum > 0xff;\n    }\n",
+                         x, y, x);
+                break;
+            case 0x5:
+                snprintf(line, sizeof(line),
+                         "    {\n        uint8_t carry = V[0x%x] >= V[0x%x];\n"
+                         "        V[0x%x] -= V[0x%x];\n        V[0xf] = carry;\n    }\n",
+                         x, y, x, y);
+                break;
+            case 0x7:
+                snprintf(line, sizeof(line),
+                         "    {\n        uint8_t carry = V[0x%x] >= V[0x%x];\n"
+                         "        V[0x%x] = V[0x%x] - V[0x%x];\n        V[0xf] = carry;\n    }\n",
+                         y, x, x, y, x);
+                break;
+            }
+            break;
+        case 0xA000:
+            snprintf(line, sizeof(line), "    I = 0x%03x;\n", nnn);
+            break;
+        case 0xB000:
+            snprintf(line, sizeof(line), "    PC = 0x%03x + V[0x0];\n", nnn);
+            break;
+        case 0xE000:
+            // Key state is private to the interpreter
+            snprintf(line, sizeof(line), "    AotAccess::exec(c, 0x%03x, 0x%04x);\n", address,
+                     data);
+            break;
+        case 0xF000:
+            switch (data & 0x00FF) {
+            case 0x07:
+                snprintf(line, sizeof(line), "    V[0x%x] = AotAccess::delayTimer(c);\n", x);
+                break;
+            case 0x15:
+                snprintf(line, sizeof(line), "    AotAccess::delayTimer(c) = V[0x%x];\n", x);
+                break;
+            case 0x1E:
+                snprintf(line, sizeof(line), "    I += V[0x%x];\n", x);
+                break;
+            }
+            break;
+        }
+
+        return line;
+    }
+};
+
+void usage()
+{
+    fprintf(stderr, "usage: chipate-aot <rom.ch8> -o <output.cpp>\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string romPath;
+    std::string outPath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            outPath = argv[++i];
+        else if (romPath.empty())
+            romPath = arg;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (romPath.empty() || outPath.empty()) {
+        usage();
+        return 1;
+    }
+
+    setLogLevel(LOG_WARNING);
+
+    auto rom = readRom(romPath);
+    if (rom.empty() || rom.size() > 0x1000 - ORIGIN) {
+        fprintf(stderr, "Invalid ROM: %s\n", romPath.c_str());
+        return 1;
+    }
+
+    Translator translator(rom, analyze(rom, ORIGIN));
+
+    FILE* out = fopen(outPath.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Failed to open %s\n", outPath.c_str());
+        return 1;
+    }
+
+    // Only used in a comment and a string literal
+    std::string name = romPath.substr(romPath.find_last_of("/\\") + 1);
+    std::replace_if(name.begin(), name.end(), [](char c) { return c == '"' || c == '\\'; }, '_');
+
+    translator.emit(out, name);
+    fclose(out);
+
+    return 0;
+}
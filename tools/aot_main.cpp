@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: WTFPL
+
+// Headless runner for a ROM translated by chipate-aot
+
+#include "aot.h"
+#include "log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <raylib.h>
+#include <string_view>
+#include <vector>
+
+using namespace chipate;
+
+int main(int argc, char** argv)
+{
+    size_t frames = 600;
+    size_t tickRate = 10;
+    bool interpret = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+            frames = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--tickrate" && i + 1 < argc)
+            tickRate = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--interpret")
+            interpret = true;
+        else {
+            fprintf(stderr, "usage: %s [--frames N] [--tickrate N] [--interpret]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    setLogLevel(LOG_WARNING);
+
+    auto const& program = aotProgram();
+
+    Chip8 chip8;
+    chip8.init(std::vector<uint8_t>(program.rom.begin(), program.rom.end()));
+
+    auto start = std::chrono::steady_clock::now();
+
+    size_t cycles = 0;
+    for (size_t frame = 0; frame < frames; ++frame)
+        cycles += interpret ? chip8.frame(tickRate) : frameAot(chip8, program, tickRate);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%s: %zu frames, %zu instructions in %.3f s (%.1f M instructions/s)\n", program.name,
+           frames, cycles, elapsed.count(), cycles / elapsed.count() / 1e6);
+
+    return 0;
+}
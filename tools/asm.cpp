@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: WTFPL
+
+// Assembler and linker: every source file is a relocatable module, modules are linked in the
+// order given. With a cache directory only the sources that changed since the last run are
+// assembled again. --optimize runs the peephole pass on every source before it is assembled.
+
+#include "link.h"
+#include "log.h"
+#include "optimize.h"
+#include "profile.h"
+#include "rom.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <raylib.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+void usage()
+{
+    fprintf(stderr, "usage: chipate-asm [options] <source.asm>...\n"
+                    "  -o FILE              output ROM (default: first source with .ch8)\n"
+                    "  --cache DIR          keep objects in DIR and reuse them while unchanged\n"
+                    "  --map FILE           write the source map for chipate-run --map\n"
+                    "  --origin ADDR        load address of the program (default 0x200)\n"
+                    "  --optimize QUIRKS    rewrite idioms into cheaper ones that behave the same\n"
+                    "                       under chip8, schip-1.0 or schip-modern quirks\n");
+}
+
+bool parseQuirks(std::string_view name, Quirks& quirks)
+{
+    if (name == "chip8")
+        quirks = CHIP8_QUIRKS;
+    else if (name == "schip-1.0")
+        quirks = SCHIP_1_0_QUIRKS;
+    else if (name == "schip-modern")
+        quirks = SCHIP_MODERN_QUIRKS;
+    else
+        return false;
+    return true;
+}
+
+bool writeFile(std::string const& path, std::span<uint8_t const> data)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    bool ok = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (file)
+        ok = fclose(file) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "Failed to write %s\n", path.c_str());
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> sources;
+    std::string output;
+    std::string cacheDir;
+    std::string mapPath;
+    uint16_t origin = 0x200;
+    std::optional<Quirks> optimize;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-o" && hasValue)
+            output = argv[++i];
+        else if (arg == "--cache" && hasValue)
+            cacheDir = argv[++i];
+        else if (arg == "--map" && hasValue)
+            mapPath = argv[++i];
+        else if (arg == "--origin" && hasValue)
+            origin = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--optimize" && hasValue) {
+            if (!parseQuirks(argv[++i], optimize.emplace())) {
+                fprintf(stderr, "Unknown quirks preset: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!arg.starts_with("-"))
+            sources.emplace_back(arg);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (sources.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (output.empty())
+        output = std::filesystem::path(sources[0]).replace_extension(".ch8").string();
+
+    setLogLevel(LOG_WARNING);
+
+    auto start = std::chrono::steady_clock::now();
+
+    ObjectCache cache(cacheDir);
+    std::vector<ObjectModule> modules;
+    bool failed = false;
+
+    for (auto const& path: sources) {
+        auto text = readRom(path);
+        if (text.empty() && !std::filesystem::exists(path)) {
+            failed = true;
+            continue;
+        }
+
+        std::string source(text.begin(), text.end());
+        if (optimize) {
+            auto optimized = optimizeSource(source, *optimize, origin);
+            for (auto const& routine: optimized.routines)
+                fprintf(stderr, "%s: %-24s 0x%03x %3u rewrites %6u cycles %3u bytes saved\n",
+                        path.c_str(), routine.label.c_str(), routine.address, routine.rewrites,
+                        routine.cycles, routine.bytes);
+            source = std::move(optimized.source);
+        }
+
+        auto result = cache.get(source, path);
+        for (auto const& error: result.errors)
+            fprintf(stderr, "%s:%zu: %s\n", path.c_str(), error.line, error.message.c_str());
+        failed |= !result.ok();
+        modules.push_back(std::move(result.module));
+    }
+
+    if (failed)
+        return 1;
+
+    auto linked = link(modules, origin);
+    for (auto const& error: linked.errors)
+        fprintf(stderr, "%s\n", error.c_str());
+    if (!linked.ok())
+        return 1;
+
+    if (!writeFile(output, linked.bytecode))
+        return 1;
+
+    if (!mapPath.empty()) {
+        auto map = formatSourceMap(linked.map);
+        if (!writeFile(mapPath, {reinterpret_cast<uint8_t const*>(map.data()), map.size()}))
+            return 1;
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    fprintf(stderr, "%zu modules, %zu assembled, %zu cached, %zu bytes in %.1f ms\n",
+            modules.size(), cache.misses(), cache.hits(), linked.bytecode.size(), elapsed.count());
+
+    return 0;
+}
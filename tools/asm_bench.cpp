@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: WTFPL
+
+// Assembler throughput benchmark on a generated program using every mnemonic, labels and
+// constants
+
+#include "asm.h"
+#include "log.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <raylib.h>
+#include <string>
+#include <string_view>
+
+using namespace chipate;
+
+namespace {
+std::atomic<size_t> allocations = 0;
+}
+
+void* operator new(size_t size)
+{
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+char const* const LINES[] = {
+    "cls",
+    "ld v0 0x05 ; load",
+    "ld va 255",
+    "ld v1 v2",
+    "ld i 0x208",
+    "ld v3 dt",
+    "ld dt v6",
+    "ld st v7",
+    "ld f v8",
+    "ld b va",
+    "ld [i] v5",
+    "ld v4 [i]",
+    "add v1 0x10",
+    "add v2 v3",
+    "add i vc",
+    "or v5 v6",
+    "and v7 v8",
+    "xor v9 va",
+    "sub vb vc",
+    "subn vd ve",
+    "shr v3",
+    "shl v7 v8",
+    "se v5 0x42",
+    "sne v2 v8",
+    "rnd va 0xFF",
+    "drw v0 v1 0x5",
+    "skp vb",
+    "sknp vc",
+    "jp 0x200",
+    "jp v0 0x300",
+    "call 0x400",
+    "ret",
+    "db 00 e0 12",
+    "",
+    "; comment line",
+};
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t lines = 100000;
+    size_t iterations = 20;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--lines" && i + 1 < argc)
+            lines = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--iterations" && i + 1 < argc)
+            iterations = std::strtoul(argv[++i], nullptr, 0);
+        else {
+            fprintf(stderr, "usage: chipate-asm-bench [--lines N] [--iterations N]\n");
+            return 1;
+        }
+    }
+
+    setLogLevel(LOG_WARNING);
+
+    // Every 16 lines a label and a constant, used by the lines after them
+    std::string source = "start:\n";
+    for (size_t i = 0; i < lines; ++i) {
+        auto n = std::to_string(i / 16);
+        switch (i % 16) {
+        case 0:
+            source += "l" + n + ": ";
+            break;
+        case 1:
+            source += "c" + n + " equ " + std::to_string(i % 256) + "\n";
+            continue;
+        case 2:
+            source += "    ld v1 c" + n + "\n";
+            continue;
+        case 3:
+            source += "    jp start\n";
+            continue;
+        }
+        source += "    ";
+        source += LINES[i % std::size(LINES)];
+        source += '\n';
+    }
+
+    size_t before = allocations;
+    size_t bytes = assemble(source).size();
+    size_t perRun = allocations - before;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+        bytes = assemble(source).size();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%zu lines x %zu: %zu bytes each, %.3f s (%.2f M lines/s), %.2f allocations per line\n",
+           lines, iterations, bytes, elapsed.count(), lines * iterations / elapsed.count() / 1e6,
+           double(perRun) / lines);
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: WTFPL
+
+// Finds the first frame and instruction where a ROM runs differently on two engine configurations
+
+#include "bisect.h"
+#include "disasm.h"
+#include "log.h"
+#include "rom.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <raylib.h>
+#include <string>
+#include <string_view>
+
+using namespace chipate;
+
+namespace {
+
+void usage()
+{
+    fprintf(stderr, "usage: chipate-bisect <rom.ch8> [options]\n"
+                    "  --a PRESET, --b PRESET  quirks of each run: chip8, schip-1.0 or\n"
+                    "                          schip-modern (default chip8)\n"
+                    "  --a-no-fusion           run a without instruction fusion, likewise\n"
+                    "  --b-no-fusion           for b\n"
+                    "  --frames N              frames to compare (default 600)\n"
+                    "  --tickrate N            instructions per frame (default 10)\n"
+                    "  --interval N            frames between snapshots (default 64)\n"
+                    "  --seed N                RND seed of both runs (default 1)\n");
+}
+
+bool parseQuirks(std::string_view name, Quirks& quirks)
+{
+    if (name == "chip8")
+        quirks = CHIP8_QUIRKS;
+    else if (name == "schip-1.0")
+        quirks = SCHIP_1_0_QUIRKS;
+    else if (name == "schip-modern")
+        quirks = SCHIP_MODERN_QUIRKS;
+    else
+        return false;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string romPath;
+    EngineConfig a{CHIP8_QUIRKS};
+    EngineConfig b{CHIP8_QUIRKS};
+    BisectOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if ((arg == "--a" || arg == "--b") && hasValue) {
+            if (!parseQuirks(argv[++i], arg == "--a" ? a.quirks : b.quirks)) {
+                usage();
+                return 2;
+            }
+        }
+        else if (arg == "--a-no-fusion")
+            a.fusion = false;
+        else if (arg == "--b-no-fusion")
+            b.fusion = false;
+        else if (arg == "--frames" && hasValue)
+            options.frames = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--tickrate" && hasValue)
+            options.tickRate = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--interval" && hasValue)
+            options.interval = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--seed" && hasValue)
+            options.seed = std::strtoul(argv[++i], nullptr, 0);
+        else if (romPath.empty() && !arg.starts_with("--"))
+            romPath = arg;
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (romPath.empty()) {
+        usage();
+        return 2;
+    }
+
+    setLogLevel(LOG_WARNING);
+
+    auto rom = readRom(romPath);
+    if (rom.empty())
+        return 2;
+
+    auto divergence = bisect(rom, a, b, options);
+    if (!divergence) {
+        printf("runs agree for %zu frames\n", options.frames);
+        return 0;
+    }
+
+    if (divergence->instruction)
+        printf("runs diverge in frame %zu, instruction %zu\n", divergence->frame,
+               *divergence->instruction);
+    else
+        printf("runs diverge in frame %zu, but only when run whole: stepping one instruction at "
+               "a time agrees, check the fused code\n",
+               divergence->frame);
+    printf("  @%03x %04x  %s\n", divergence->pc, divergence->opcode,
+           disassemble(divergence->opcode).c_str());
+    for (auto const& field: divergence->fields)
+        printf("  %s\n", field.c_str());
+    return 1;
+}
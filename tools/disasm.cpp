@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: WTFPL
+
+// Disassembler: turns ROMs into listings assemble() accepts, many files are processed in parallel
+
+#include "disasm.h"
+#include "log.h"
+#include "rom.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmrc/cmrc.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <raylib.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+CMRC_DECLARE(chip8archive);
+
+using namespace chipate;
+
+namespace {
+
+void usage()
+{
+    fprintf(stderr, "usage: chipate-disasm [options] <rom.ch8>...\n"
+                    "  -o DIR               write DIR/<rom>.asm for every ROM instead of stdout\n"
+                    "  --archive            disassemble every ROM of the embedded archive\n"
+                    "  --jobs N             files disassembled in parallel (default: all cores)\n"
+                    "  --origin ADDR        load address of the ROMs (default 0x200)\n");
+}
+
+struct Job {
+    std::string name;
+    std::string path;                 // Empty for ROMs from the embedded archive
+    std::span<uint8_t const> content; // Only for ROMs from the embedded archive
+};
+
+bool writeFile(std::filesystem::path const& path, std::string const& text)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    fclose(file);
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<Job> jobs;
+    std::string outDir;
+    bool archive = false;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    uint16_t origin = 0x200;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-o" && hasValue)
+            outDir = argv[++i];
+        else if (arg == "--archive")
+            archive = true;
+        else if (arg == "--jobs" && hasValue)
+            threads = std::max(1ul, std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--origin" && hasValue)
+            origin = std::strtoul(argv[++i], nullptr, 0);
+        else if (!arg.starts_with("-"))
+            jobs.push_back({std::filesystem::path(arg).stem().string(), std::string(arg), {}});
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    setLogLevel(LOG_WARNING);
+
+    if (archive) {
+        auto fs = cmrc::chip8archive::get_filesystem();
+        for (auto const& entry: fs.iterate_directory("roms")) {
+            if (!entry.is_file())
+                continue;
+            auto file = fs.open("roms/" + entry.filename());
+            jobs.push_back({std::filesystem::path(entry.filename()).stem().string(),
+                            {},
+                            {reinterpret_cast<uint8_t const*>(file.begin()), file.size()}});
+        }
+    }
+
+    if (jobs.empty() || (jobs.size() > 1 && outDir.empty())) {
+        usage();
+        return 1;
+    }
+
+    if (!outDir.empty())
+        std::filesystem::create_directories(outDir);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> bytes = 0;
+    std::atomic<bool> failed = false;
+
+    auto worker = [&] {
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            auto const& job = jobs[i];
+
+            std::vector<uint8_t> rom;
+            std::span<uint8_t const> content = job.content;
+            if (!job.path.empty()) {
+                rom = readRom(job.path);
+                content = rom;
+            }
+            bytes += content.size();
+
+            auto listing = disassemble(content, origin);
+
+            if (outDir.empty())
+                fwrite(listing.data(), 1, listing.size(), stdout);
+            else if (!writeFile(std::filesystem::path(outDir) / (job.name + ".asm"), listing))
+                failed = true;
+        }
+    };
+
+    {
+        std::vector<std::jthread> pool;
+        for (size_t t = 1; t < std::min(threads, jobs.size()); ++t)
+            pool.emplace_back(worker);
+        worker();
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (!outDir.empty())
+        fprintf(stderr, "%zu files, %zu bytes in %.1f ms\n", jobs.size(), bytes.load(),
+                elapsed.count());
+
+    return failed ? 1 : 0;
+}
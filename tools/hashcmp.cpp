@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: WTFPL
+
+// Compares the per-frame state hashes of two chipate-run --hashes runs
+
+#include "framehash.h"
+
+#include <cstdio>
+#include <utility>
+
+using namespace chipate;
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: chipate-hashcmp <a.hashes> <b.hashes>\n");
+        return 2;
+    }
+
+    auto a = readFrameHashes(argv[1]);
+    auto b = readFrameHashes(argv[2]);
+    if (!a || !b)
+        return 2;
+
+    auto frame = firstDivergence(*a, *b);
+    if (!frame) {
+        printf("identical, %zu frames\n", a->size());
+        return 0;
+    }
+
+    printf("first divergent frame: %zu\n", *frame);
+    for (auto [path, hashes]: {std::pair{argv[1], &*a}, std::pair{argv[2], &*b}}) {
+        if (*frame < hashes->size())
+            printf("  %s: %016llx\n", path, static_cast<unsigned long long>((*hashes)[*frame]));
+        else
+            printf("  %s: ended after %zu frames\n", path, hashes->size());
+    }
+    return 1;
+}
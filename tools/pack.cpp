@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: WTFPL
+
+// Builds a ROM pack for the GUI out of ROM files and directories of them
+
+#include "log.h"
+#include "pack.h"
+#include "rom.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+void usage()
+{
+    fprintf(stderr, "usage: chipate-pack [options] -o <library.c8pk> <rom.ch8|dir>...\n"
+                    "  --programs FILE      titles, authors and options by ROM name, in the\n"
+                    "                       format of chip8archive's programs.json\n");
+}
+
+// Fills in what programs.json says about the ROM of the same name
+void describe(PackRom& rom, nlohmann::json const& programs)
+{
+    auto program = programs.find(rom.name);
+    if (program == programs.end() || !program->is_object())
+        return;
+
+    auto text = [&](char const* key, std::string& value) {
+        if (program->contains(key) && (*program)[key].is_string())
+            value = (*program)[key].get<std::string>();
+    };
+    text("title", rom.title);
+    text("release", rom.release);
+    text("event", rom.event);
+    text("platform", rom.platform);
+    text("desc", rom.desc);
+    if (program->contains("authors") && (*program)["authors"].is_array()) {
+        for (auto const& author: (*program)["authors"]) {
+            if (!author.is_string())
+                continue;
+            if (!rom.authors.empty())
+                rom.authors += ", ";
+            rom.authors += author.get<std::string>();
+        }
+    }
+
+    if (!program->contains("options") || !(*program)["options"].is_object())
+        return;
+    auto const& options = (*program)["options"];
+    if (options.contains("tickrate") && options["tickrate"].is_number_integer())
+        rom.options.tickrate = options["tickrate"].get<int>();
+    auto flag = [&](char const* key, std::optional<bool>& value) {
+        if (options.contains(key) && options[key].is_boolean())
+            value = options[key].get<bool>();
+    };
+    flag("shiftQuirks", rom.options.shiftQuirks);
+    flag("loadStoreQuirks", rom.options.loadStoreQuirks);
+    flag("jumpQuirks", rom.options.jumpQuirks);
+    flag("logicQuirks", rom.options.logicQuirks);
+    flag("clipQuirks", rom.options.clipQuirks);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string output;
+    std::string programsPath;
+    std::vector<std::filesystem::path> inputs;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-o" && hasValue)
+            output = argv[++i];
+        else if (arg == "--programs" && hasValue)
+            programsPath = argv[++i];
+        else if (!arg.starts_with("-"))
+            inputs.emplace_back(arg);
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (output.empty() || inputs.empty()) {
+        usage();
+        return 1;
+    }
+
+    setLogLevel(LOG_WARNING);
+
+    nlohmann::json programs = nlohmann::json::object();
+    if (!programsPath.empty()) {
+        std::ifstream file(programsPath);
+        programs = nlohmann::json::parse(file, nullptr, false);
+        if (programs.is_discarded() || !programs.is_object()) {
+            fprintf(stderr, "Failed to parse %s\n", programsPath.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<std::filesystem::path> files;
+    for (auto const& input: inputs) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(input, error)) {
+            files.push_back(input);
+            continue;
+        }
+        for (auto const& entry: std::filesystem::recursive_directory_iterator(input, error)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".ch8")
+                files.push_back(entry.path());
+        }
+    }
+
+    std::vector<PackRom> roms;
+    std::set<std::string> names;
+    for (auto const& path: files) {
+        PackRom rom;
+        rom.name = path.stem().string();
+        if (!names.insert(rom.name).second) {
+            fprintf(stderr, "Skipping %s, there is another %s\n", path.string().c_str(),
+                    rom.name.c_str());
+            continue;
+        }
+        rom.rom = readRom(path.string());
+        if (rom.rom.empty()) {
+            fprintf(stderr, "Skipping %s, it is empty or unreadable\n", path.string().c_str());
+            continue;
+        }
+        if (rom.rom.size() > MAX_ROM_SIZE) {
+            fprintf(stderr, "Skipping %s, %zu bytes do not fit in memory\n", path.string().c_str(),
+                    rom.rom.size());
+            continue;
+        }
+        describe(rom, programs);
+        roms.push_back(std::move(rom));
+    }
+
+    size_t count = roms.size();
+    if (!writePack(output, std::move(roms)))
+        return 1;
+    printf("%zu ROMs packed into %s\n", count, output.c_str());
+    return 0;
+}
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: WTFPL
+
+// Headless runner: executes a ROM for a number of frames without a window
+
+#include "chip8.h"
+#include "detect.h"
+#include "framehash.h"
+#include "log.h"
+#include "profile.h"
+#include "rom.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <raylib.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace chipate;
+
+namespace {
+
+void usage()
+{
+    fprintf(stderr, "usage: chipate-run <rom.ch8> [options]\n"
+                    "  --frames N           frames to run (default 600)\n"
+                    "  --tickrate N         instructions per frame (default 10)\n"
+                    "  --quirks PRESET      chip8, schip-1.0, schip-modern or auto to detect them\n"
+                    "                       (default chip8)\n"
+                    "  --no-fusion          execute every instruction on its own\n"
+                    "  --fusion-profile     report which instruction fusions fired\n"
+                    "  --profile            report the hottest instructions\n"
+                    "  --map FILE           source map from chipate-asm, --profile reports\n"
+                    "                       routines and source lines\n"
+                    "  --hashes FILE        write the state hash after every frame, compare two\n"
+                    "                       runs with chipate-hashcmp\n"
+                    "  --seed N             seed of RND, runs with the same one repeat (default 0)\n");
+}
+
+bool parseQuirks(std::string_view name, Quirks& quirks)
+{
+    if (name == "chip8")
+        quirks = CHIP8_QUIRKS;
+    else if (name == "schip-1.0")
+        quirks = SCHIP_1_0_QUIRKS;
+    else if (name == "schip-modern")
+        quirks = SCHIP_MODERN_QUIRKS;
+    else
+        return false;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string romPath;
+    size_t frames = 600;
+    size_t tickRate = 10;
+    Quirks quirks = CHIP8_QUIRKS;
+    bool detect = false;
+    bool fusion = true;
+    bool fusionProfile = false;
+    bool profile = false;
+    std::string mapPath;
+    std::string hashesPath;
+    uint32_t seed = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--frames" && hasValue)
+            frames = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--tickrate" && hasValue)
+            tickRate = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--quirks" && hasValue) {
+            detect = std::string_view(argv[++i]) == "auto";
+            if (!detect && !parseQuirks(argv[i], quirks)) {
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--no-fusion")
+            fusion = false;
+        else if (arg == "--fusion-profile")
+            fusionProfile = true;
+        else if (arg == "--profile")
+            profile = true;
+        else if (arg == "--map" && hasValue)
+            mapPath = argv[++i];
+        else if (arg == "--hashes" && hasValue)
+            hashesPath = argv[++i];
+        else if (arg == "--seed" && hasValue)
+            seed = std::strtoul(argv[++i], nullptr, 0);
+        else if (romPath.empty() && !arg.starts_with("--"))
+            romPath = arg;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (romPath.empty()) {
+        usage();
+        return 1;
+    }
+
+    setLogLevel(LOG_WARNING);
+
+    auto rom = readRom(romPath);
+    if (rom.empty() || rom.size() > MAX_ROM_SIZE) {
+        fprintf(stderr, "Invalid ROM: %s\n", romPath.c_str());
+        return 1;
+    }
+
+    if (detect) {
+        auto detection = quirkCache().get(rom);
+        quirks = detection.quirks;
+        printf("Detected quirks: %s%s\n", QUIRK_PRESETS[detection.preset].name,
+               quirks == QUIRK_PRESETS[detection.preset].quirks ? "" : " with changes");
+    }
+
+    std::optional<SourceMap> map;
+    if (!mapPath.empty()) {
+        auto text = readRom(mapPath);
+        map = parseSourceMap({reinterpret_cast<char const*>(text.data()), text.size()});
+        if (!map) {
+            fprintf(stderr, "Invalid source map %s\n", mapPath.c_str());
+            return 1;
+        }
+    }
+
+    Chip8 chip8;
+    chip8.init(rom, quirks);
+    chip8.seedRandom(seed);
+    chip8.setFusion(fusion);
+    chip8.setFusionProfiling(fusionProfile);
+    chip8.setPcProfiling(profile);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint64_t> hashes;
+    if (!hashesPath.empty())
+        hashes.reserve(frames);
+
+    size_t cycles = 0;
+    for (size_t frame = 0; frame < frames; ++frame) {
+        cycles += chip8.frame(tickRate);
+        if (!hashesPath.empty())
+            hashes.push_back(chip8.stateHash());
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%zu frames, %zu instructions in %.3f s (%.1f M instructions/s)\n", frames, cycles,
+           elapsed.count(), cycles / elapsed.count() / 1e6);
+
+    if (!hashesPath.empty() && !writeFrameHashes(hashesPath, hashes))
+        return 1;
+
+    if (fusionProfile) {
+        auto const& stats = chip8.fusionStats();
+        printf("%-22s %12s\n", "fusion", "count");
+        for (size_t f = 1; f < stats.size(); ++f)
+            printf("%-22s %12llu\n", fusionName(static_cast<Fusion>(f)),
+                   static_cast<unsigned long long>(stats[f]));
+    }
+
+    if (profile) {
+        auto report = formatProfile(buildProfile(chip8.pcCounts(), map ? &*map : nullptr));
+        printf("\n%s", report.c_str());
+    }
+
+    return 0;
+}